@@ -0,0 +1,121 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_arrow.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Export of the decoded values in the Apache Arrow IPC streaming format.
+ *
+ * An Arrow writer collects the rows decoded by the receive path (the simulation time and the
+ * value of every subscribed variable) into columns of doubles and, every batch_size rows, writes
+ * them as one record batch to a file descriptor: a regular file, a pipe or a socket. The stream
+ * starts with the schema (a float64 column "time" followed by one float64 column per variable)
+ * and ends with the end-of-stream marker, so it can be read with pyarrow.ipc.open_stream() or
+ * any other Arrow implementation, and memory-mapped without copies when written to a file.
+ *
+ * The columns and the metadata buffer are allocated once and reused by every batch; the body of
+ * a batch is written straight from the columns with one scatter-gather write.
+ *
+ * @see https://arrow.apache.org/docs/format/Columnar.html#ipc-streaming-format for the format.
+ */
+
+#ifndef _trick_variable_server_arrow_h_
+#define _trick_variable_server_arrow_h_
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+
+/**
+ *   @brief a writer of an Arrow IPC stream.
+ */
+
+struct arrow_writer {
+	int fd;
+	int variables;                 /**< number of variables, i.e. of columns besides the time */
+	int batch_size;                /**< rows of a record batch */
+	int rows;                      /**< rows waiting in the columns */
+	double* columns;               /**< the time column, then one column per variable, batch_size rows each */
+	unsigned char* metadata;       /**< the buffer the message metadata is built into */
+	size_t metadata_capacity;
+	struct iovec* iov;             /**< the scatter-gather list of a message */
+
+	unsigned long batches;         /**< record batches written */
+	unsigned long long rows_written;    /**< rows written */
+	unsigned long long bytes;      /**< bytes written */
+};
+
+
+/**
+ *   @brief initializes a writer and writes the schema of the stream.
+ *
+ *   @param writer:     the writer;
+ *   @param fd:         the file descriptor to write to, which is not closed by the writer;
+ *   @param variables:  the names of the variables, i.e. of the columns after "time";
+ *   @param count:      the number of variables;
+ *   @param batch_size: the number of rows of a record batch.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_open(struct arrow_writer* writer, int fd, char** variables, int count, int batch_size);
+
+
+/**
+ *   @brief appends one row, and writes a record batch when batch_size rows are collected.
+ *
+ *   @param writer: the writer;
+ *   @param time:   the simulation time of the row;
+ *   @param values: the value of each variable (e.g. as decoded by subscription_decode()).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_append(struct arrow_writer* writer, double time, const double* values);
+
+
+/**
+ *   @brief writes the rows collected so far as a (shorter) record batch.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_flush(struct arrow_writer* writer);
+
+
+/**
+ *   @brief writes the rows left and the end-of-stream marker, then releases the writer.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_close(struct arrow_writer* writer);
+
+#endif
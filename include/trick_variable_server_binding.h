@@ -0,0 +1,206 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_binding.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Decoding of the binary messages straight into the fields of a user structure.
+ *
+ * A binding ties slots of a subscription to fields of a state structure of the caller: an
+ * offset in the structure and a C type (binding_add()), or for arrays a first offset and a
+ * stride (binding_add_array()). binding_decode() then writes every message directly into
+ * the fields, converting only when the type of the variable differs from the type of the
+ * field, with no intermediate array of values.
+ *
+ * When two copies of the structure are given, the binding is double-buffered: each message
+ * is written into the copy not published, and the "active" pointer is then swapped to it
+ * atomically, so that consumers on other threads always see a whole coherent state. A consumer
+ * takes the state with binding_acquire() and, after reading it, checks with binding_validate()
+ * that the writer has not started to overwrite it in the meantime (which happens when reading
+ * takes longer than one message period).
+ */
+
+#ifndef _trick_variable_server_binding_h_
+#define _trick_variable_server_binding_h_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "trick_variable_server_decoder.h"
+
+
+/**
+ *   @brief the C types of the bound fields.
+ */
+
+enum binding_type {
+	BINDING_DOUBLE = 0,
+	BINDING_FLOAT,
+	BINDING_INT8,
+	BINDING_INT16,
+	BINDING_INT32,
+	BINDING_INT64,
+	BINDING_UINT8,
+	BINDING_UINT16,
+	BINDING_UINT32,
+	BINDING_UINT64,
+	BINDING_BOOL
+};
+
+
+/**
+ *   @brief a slot bound to a field.
+ */
+
+struct binding_field {
+	int slot;                      /**< the slot of the variable in the subscription */
+	size_t offset;                 /**< the offset of the field in the state structure */
+	int type;                      /**< one of enum binding_type */
+};
+
+
+/**
+ *   @brief one write of the compiled binding: from the message to the field.
+ */
+
+struct binding_op {
+	unsigned int source;           /**< offset of the value in the message */
+	size_t target;                 /**< offset of the field in the state structure */
+	int kind;                      /**< plain copy of 8 or 4 bytes, or conversion */
+	int type;                      /**< type of the field, for the conversions */
+	decode_function decode;        /**< converter of the value, for the conversions */
+};
+
+
+/**
+ *   @brief the fields bound to a subscription, and the state structures they live in.
+ */
+
+struct binding {
+	struct binding_field* fields;
+	int count;
+	int capacity;
+	unsigned char* states[2];      /**< the state structure, and its second copy when double-buffered */
+	size_t size;                   /**< the size of the state structure */
+	_Atomic(void*) active;         /**< the last state completely written */
+	atomic_ulong published;        /**< the number of messages written and published */
+	atomic_ulong writing;          /**< the number of the message being written */
+	struct binding_op* ops;        /**< the compiled writes */
+	int op_count;
+	unsigned long plan_generation; /**< the decode plan the writes were compiled for */
+};
+
+
+/**
+ *   @brief initializes a binding without fields.
+ *
+ *   @param binding: the binding;
+ *   @param state:   the state structure the values are written into;
+ *   @param second:  a second copy of the structure to double-buffer the states, NULL for none;
+ *   @param size:    the size of the structure.
+ */
+
+void binding_init(struct binding* binding, void* state, void* second, size_t size);
+
+
+/**
+ *   @brief releases the fields of a binding (not the state structures).
+ *
+ *   @param binding: the binding.
+ */
+
+void binding_destroy(struct binding* binding);
+
+
+/**
+ *   @brief binds a slot of the subscription to a field.
+ *
+ *   @param binding: the binding;
+ *   @param slot:    the slot, as returned by subscription_add();
+ *   @param offset:  the offset of the field in the state structure (offsetof());
+ *   @param type:    the type of the field, one of enum binding_type.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c EINVAL if the field exceeds the structure.
+ */
+
+int binding_add(struct binding* binding, int slot, size_t offset, int type);
+
+
+/**
+ *   @brief binds consecutive slots to the elements of an array of fields.
+ *
+ *   @param binding: the binding;
+ *   @param slot:    the slot of the first element;
+ *   @param count:   the number of elements;
+ *   @param offset:  the offset of the first element in the state structure;
+ *   @param stride:  the distance in bytes between two elements;
+ *   @param type:    the type of the elements, one of enum binding_type.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c EINVAL if an element exceeds the structure.
+ */
+
+int binding_add_array(struct binding* binding, int slot, int count, size_t offset, size_t stride, int type);
+
+
+/**
+ *   @brief decodes a binary variable message into the bound fields, and publishes the state.
+ *
+ *   @param binding:      the binding;
+ *   @param subscription: the subscription the slots belong to;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message.
+ *
+ *   @return  1 if the message was decoded, 0 if it was skipped (see subscription_decode()).
+ *            Otherwise, -1 is returned and errno is set to indicate the error, @c ENOTSUP
+ *            if the layout of the message cannot be compiled (strings).
+ */
+
+int binding_decode(struct binding* binding, struct subscription* subscription, const unsigned char* frame, unsigned int length);
+
+
+/**
+ *   @brief the last state completely written.
+ *
+ *   @param binding:    the binding;
+ *   @param generation: filled with the number of the message of the state, for binding_validate().
+ *
+ *   @return  the state structure, NULL if no message has been written yet.
+ */
+
+void* binding_acquire(struct binding* binding, unsigned long* generation);
+
+
+/**
+ *   @brief tells whether a state taken with binding_acquire() is still intact.
+ *
+ *   @param binding:    the binding;
+ *   @param generation: the number returned by binding_acquire().
+ *
+ *   @return  1 if the writer has not started to overwrite the state, 0 otherwise
+ *            (always 0 for a binding that is not double-buffered while a message is written).
+ */
+
+int binding_validate(struct binding* binding, unsigned long generation);
+
+#endif
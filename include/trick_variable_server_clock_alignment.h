@@ -0,0 +1,157 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_clock_alignment.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Alignment of the simulation time carried by the frames with the host CLOCK_MONOTONIC.
+ *
+ * Each received sample is fed with its sim @c time and its host arrival time. A two-state
+ * Kalman filter tracks the host time corresponding to the current sim time and the host
+ * seconds elapsed per sim second (drift included); a lower envelope of the innovations gives
+ * the fastest observed path, against which the age of every sample is measured.
+ * The fit works with real time enabled or disabled, across freezes and sim time resets.
+ * The frames of a frame_receiver are stamped on CLOCK_REALTIME: clock_alignment_update_frame()
+ * converts their arrival time before feeding them.
+ */
+
+#ifndef _trick_variable_server_clock_alignment_h_
+#define _trick_variable_server_clock_alignment_h_
+
+struct receiver_frame;
+
+/**
+ *   @brief state of the sim time to host time estimator.
+ */
+
+struct clock_alignment {
+	double base_latency;      /**< latency of the fastest path, added to the ages (seconds, 0 if unknown) */
+	double offset_noise;      /**< process noise of the host time offset (s^2 per sim second) */
+	double rate_noise;        /**< process noise of the host/sim rate (1/s per sim second) */
+	double gate;              /**< innovations beyond gate standard deviations are down-weighted */
+	int    floor_window;      /**< number of samples after which the fastest-path envelope is renewed */
+	double freeze_timeout;    /**< host seconds without sim time progress before the sim is considered frozen */
+
+	int    samples;
+	int    frozen;
+	int    outliers;
+	double sim_time;          /**< sim time of the last sample */
+	double host_time;         /**< host arrival time of the last sample */
+	double offset;            /**< estimated host time at sim_time on the fitted line */
+	double rate;              /**< estimated host seconds per sim second */
+	double p00, p01, p11;     /**< covariance of (offset, rate) */
+	double measurement_noise;
+	double floor;             /**< lowest innovation over the current and the previous window */
+	double window_floor;
+	double previous_floor;
+	int    window_samples;
+	double last_age;
+};
+
+
+/**
+ *   @brief the estimate produced for one sample.
+ */
+
+struct clock_alignment_estimate {
+	double sample_age;        /**< host seconds between the production of the sample and its arrival */
+	double real_time_ratio;   /**< sim seconds per host second */
+	double drift;             /**< real_time_ratio - 1 */
+	double innovation;        /**< arrival time minus the arrival time predicted by the fit */
+	int    frozen;            /**< 1 while the sim time does not advance */
+	int    converged;         /**< 1 once the fit has enough samples to be trusted */
+};
+
+
+/**
+ *   @brief initializes the estimator with default tuning.
+ *
+ *   @param alignment:    the estimator;
+ *   @param base_latency: one-way latency of the fastest path in seconds, if known (e.g. half the ping time), 0 otherwise.
+ */
+
+void clock_alignment_init(struct clock_alignment* alignment, double base_latency);
+
+
+/**
+ *   @brief feeds a sample to the estimator.
+ *
+ *   @param alignment: the estimator;
+ *   @param sim_time:  the Trick @c time carried by the sample;
+ *   @param host_time: the host CLOCK_MONOTONIC arrival time of the sample, in seconds;
+ *   @param estimate:  if not NULL, filled with the estimate for this sample.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int clock_alignment_update(struct clock_alignment* alignment, double sim_time, double host_time, struct clock_alignment_estimate* estimate);
+
+
+/**
+ *   @brief converts a sim time to the host time at which the server produced it.
+ *
+ *   @param alignment: the estimator;
+ *   @param sim_time:  the sim time to convert.
+ *
+ *   @return  the estimated CLOCK_MONOTONIC time in seconds.
+ */
+
+double clock_alignment_sim_to_host(const struct clock_alignment* alignment, double sim_time);
+
+
+/**
+ *   @brief reads CLOCK_MONOTONIC.
+ *
+ *   @return  the current host time in seconds.
+ */
+
+double clock_alignment_host_time();
+
+
+/**
+ *   @brief converts the CLOCK_REALTIME arrival time of a frame (the kernel timestamp when
+ *   available, the time it was handed to the caller otherwise) to CLOCK_MONOTONIC.
+ *
+ *   @param frame: the frame, converted soon after it is received.
+ *
+ *   @return  the CLOCK_MONOTONIC arrival time of the frame in seconds.
+ */
+
+double clock_alignment_frame_time(const struct receiver_frame* frame);
+
+
+/**
+ *   @brief feeds a received frame to the estimator, with its arrival time converted by
+ *   clock_alignment_frame_time().
+ *
+ *   @param alignment: the estimator;
+ *   @param frame:     the frame;
+ *   @param sim_time:  the Trick @c time carried by the frame;
+ *   @param estimate:  if not NULL, filled with the estimate for this frame (age and real-time ratio).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int clock_alignment_update_frame(struct clock_alignment* alignment, const struct receiver_frame* frame, double sim_time, struct clock_alignment_estimate* estimate);
+
+#endif
@@ -0,0 +1,158 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_columns.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Transposition of binary messages into per-variable columns (structure of arrays).
+ *
+ * A column set stores the values of a batch of binary messages without names
+ * (set_binary_no_names()) column by column: one array of doubles per variable, with one
+ * row per message. The layout of the messages is compiled once into runs of consecutive
+ * variables of the same type. Runs of doubles are byte-swapped (when the simulation host
+ * has the other byte order) and transposed with SSSE3 or AVX2 shuffles, four messages by
+ * four variables at a time with AVX2; the other types are converted one by one.
+ */
+
+#ifndef _trick_variable_server_columns_h_
+#define _trick_variable_server_columns_h_
+
+#include <stddef.h>
+
+
+/**
+ *   @brief the implementations of the transposition.
+ */
+
+enum columns_kernel {
+	COLUMNS_AUTO = 0,              /**< the best one supported by the processor */
+	COLUMNS_SCALAR,                /**< one value at a time */
+	COLUMNS_SSE,                   /**< SSSE3: two messages by two variables */
+	COLUMNS_AVX2                   /**< AVX2: four messages by four variables */
+};
+
+
+/**
+ *   @brief consecutive variables of the same type and size.
+ */
+
+struct column_run {
+	unsigned int offset;           /**< offset of the value of the first variable in the message */
+	unsigned int stride;           /**< distance between two values (type and size fields included) */
+	int first;                     /**< index of the first variable */
+	int count;                     /**< number of variables */
+	int type;                      /**< Trick type code */
+	unsigned int size;             /**< size of each value */
+};
+
+
+/**
+ *   @brief the columns of a batch of messages.
+ */
+
+struct column_set {
+	int variables;                 /**< number of variables, i.e. of columns */
+	int capacity;                  /**< rows each column can hold */
+	int rows;                      /**< rows stored */
+	int swap;                      /**< 1 if the simulation host has the other byte order */
+	int kernel;                    /**< the implementation in use */
+	double* storage;               /**< the columns, one after the other, 32-byte aligned */
+	int valid;                     /**< 1 if the layout has been compiled */
+	unsigned int frame_length;     /**< length of the messages of the compiled layout */
+	struct column_run* runs;
+	int run_count;
+};
+
+
+/**
+ *   @brief allocates the columns.
+ *
+ *   @param set:       the column set;
+ *   @param variables: the number of variables of the messages;
+ *   @param capacity:  the number of rows of a batch;
+ *   @param swap:      1 if the simulation host has the other byte order, 0 otherwise;
+ *   @param kernel:    one of enum columns_kernel.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ENOTSUP if the kernel is not supported.
+ */
+
+int columns_init(struct column_set* set, int variables, int capacity, int swap, int kernel);
+
+
+/**
+ *   @brief releases the columns.
+ *
+ *   @param set: the column set.
+ */
+
+void columns_destroy(struct column_set* set);
+
+
+/**
+ *   @brief appends messages as new rows.
+ *
+ *   @param set:     the column set;
+ *   @param frames:  the messages;
+ *   @param lengths: the length of each message;
+ *   @param count:   the number of messages.
+ *
+ *   @return  the number of messages appended, which is smaller than count when the columns
+ *            are full or a message has a layout different from the rows already stored
+ *            (process the batch and call columns_reset()). If a message is not valid, -1 is
+ *            returned and errno is set to indicate the error.
+ */
+
+int columns_append(struct column_set* set, const unsigned char* const* frames, const unsigned int* lengths, int count);
+
+
+/**
+ *   @brief the column of a variable.
+ *
+ *   @param set:      the column set;
+ *   @param variable: the index of the variable.
+ *
+ *   @return  the rows of the variable.
+ */
+
+double* columns_column(const struct column_set* set, int variable);
+
+
+/**
+ *   @brief empties the columns for the next batch.
+ *
+ *   @param set: the column set.
+ */
+
+void columns_reset(struct column_set* set);
+
+
+/**
+ *   @brief tells whether the processor supports a kernel.
+ *
+ *   @param kernel: one of enum columns_kernel.
+ *
+ *   @return  1 if supported, 0 otherwise.
+ */
+
+int columns_kernel_supported(int kernel);
+
+#endif
@@ -0,0 +1,235 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_command_queue.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief A thread-safe queue of commands for the Trick Variable Server.
+ *
+ * Any number of threads may submit commands; one writer at a time drains the queue
+ * and sends everything pending with a single writev, so commands are never interleaved
+ * on the socket. Commands that set a piece of session state (e.g. the update period)
+ * are collapsed: only the last one of each kind in a run of such commands is sent. Any
+ * other command (var_add, var_pause, var_send, ...) ends the run, so that no command
+ * moves past it.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_command_queue_h_
+#define _trick_variable_server_command_queue_h_
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "trick_variable_server_metrics.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/**
+ *   @brief the kinds of commands that supersede the previous command of the same kind.
+ */
+
+enum command_class {
+	COMMAND_CLASS_NONE = 0,            /**< never collapsed (var_add, var_pause, ...) */
+	COMMAND_CLASS_CYCLE,               /**< trick.var_cycle() */
+	COMMAND_CLASS_COPY_MODE,           /**< trick.var_set_copy_mode() */
+	COMMAND_CLASS_FORMAT,              /**< trick.var_ascii(), trick.var_binary(), trick.var_binary_nonames() */
+	COMMAND_CLASS_REAL_TIME,           /**< trick.real_time_enable(), trick.real_time_disable() */
+	COMMAND_CLASS_DEBUG_LEVEL,         /**< trick.var_debug() */
+	COMMAND_CLASS_CLIENT_TAG,          /**< trick.var_set_client_tag() */
+	COMMAND_CLASS_VALIDATE_ADDRESSES,  /**< trick.var_validate_address() */
+	COMMAND_CLASS_COUNT
+};
+
+
+/**
+ *   @brief a queued command. The text includes the trailing newline.
+ */
+
+struct command_queue_node {
+	_Atomic(struct command_queue_node*) next;
+	struct command_queue_node* batch_next;
+	int command_class;
+	size_t length;
+	char* text;
+};
+
+
+/**
+ *   @brief a multi-producer, single-consumer command queue bound to one socket.
+ */
+
+struct command_queue {
+	int socket;
+	_Atomic(struct command_queue_node*) head;
+	struct command_queue_node* tail;
+	struct command_queue_node stub;
+	atomic_int pending;
+	atomic_flag writing;
+	struct connection_metrics* metrics;  /**< counters to update, NULL if none */
+	struct iovec iov[IOV_MAX];           /**< the commands being written, used by the draining thread only */
+};
+
+
+/**
+ *   @brief initializes an empty command queue for the given socket.
+ *
+ *   @param queue:  the queue to initialize;
+ *   @param socket: socket file descriptor.
+ *
+ *   @return  the function returns 0.
+ */
+
+int command_queue_init(struct command_queue* queue, int socket);
+
+
+/**
+ *   @brief releases the commands still pending in the queue without sending them.
+ *
+ *   @param queue: the queue to destroy.
+ */
+
+void command_queue_destroy(struct command_queue* queue);
+
+
+/**
+ *   @brief queues a command. It may be called concurrently from any thread.
+ *
+ *   @param queue:         the command queue;
+ *   @param command:       the command to queue (a newline is automatically appended);
+ *   @param command_class: the kind of the command, @c COMMAND_CLASS_NONE if it must never be collapsed.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_submit(struct command_queue* queue, const char* command, int command_class);
+
+
+/**
+ *   @brief sends all the pending commands with as few writev calls as possible.
+ *
+ *   Only one thread drains the queue at a time: if another thread is already writing,
+ *   the function returns 0 and the commands are sent by that thread.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns the number of bytes sent.
+ *            Otherwise, -1 is returned and errno is set to indicate the error; the commands
+ *            of the failed batch are discarded.
+ */
+
+int command_queue_flush(struct command_queue* queue);
+
+
+/**
+ *   @brief queues a trick.var_cycle() command.
+ *
+ *   @param queue:  the command queue;
+ *   @param period: the period at which the Trick Variable Server sends updates.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_set_cycle(struct command_queue* queue, double period);
+
+
+/**
+ *   @brief queues a trick.var_set_copy_mode() command.
+ *
+ *   @param queue: the command queue;
+ *   @param mode:  the copy mode (see set_copy_mode()).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_set_copy_mode(struct command_queue* queue, int mode);
+
+
+/**
+ *   @brief queues a trick.var_pause() command.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_pause(struct command_queue* queue);
+
+
+/**
+ *   @brief queues a trick.var_unpause() command.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_unpause(struct command_queue* queue);
+
+
+/**
+ *   @brief queues a trick.var_add() command.
+ *
+ *   @param queue:         the command queue;
+ *   @param variable_name: name of the variable to be observed.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_add_variable(struct command_queue* queue, const char* variable_name);
+
+
+/**
+ *   @brief queues a trick.var_remove() command.
+ *
+ *   @param queue:         the command queue;
+ *   @param variable_name: name of the variable to stop observing.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_remove_variable(struct command_queue* queue, const char* variable_name);
+
+
+/**
+ *   @brief queues a trick.var_clear() command.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_clear(struct command_queue* queue);
+
+#endif
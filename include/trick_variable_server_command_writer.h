@@ -0,0 +1,158 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_command_writer.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Streaming writer of commands of any length for the Trick Variable Server.
+ *
+ * A command is appended in pieces and terminated by command_writer_end(). Small pieces are
+ * copied into an internal buffer, so that many short commands leave in one write; pieces of
+ * at least COMMAND_WRITER_COPY_LIMIT bytes are not copied but referenced by the scatter-gather
+ * list, and must stay valid until the next flush. The writer flushes by itself when its buffer
+ * or its scatter-gather list is full, so a command can be longer than both.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_command_writer_h_
+#define _trick_variable_server_command_writer_h_
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "trick_variable_server_metrics.h"
+
+#define COMMAND_WRITER_BUFFER_SIZE 8192
+#define COMMAND_WRITER_IOVECS 64
+#define COMMAND_WRITER_COPY_LIMIT 512
+
+
+/**
+ *   @brief a buffered, scatter-gather command writer bound to one socket.
+ */
+
+struct command_writer {
+	int socket;
+	char buffer[COMMAND_WRITER_BUFFER_SIZE];   /**< copies of the small pieces */
+	size_t used;                               /**< bytes used in the buffer */
+	struct iovec iov[COMMAND_WRITER_IOVECS];   /**< the pending pieces, in order */
+	int count;                                 /**< entries used in iov */
+	size_t pending;                            /**< bytes waiting to be written */
+
+	unsigned long commands;                    /**< commands terminated */
+	unsigned long bytes;                       /**< bytes written */
+	unsigned long writes;                      /**< write system calls */
+	struct connection_metrics* metrics;        /**< counters to update, NULL if none */
+};
+
+
+/**
+ *   @brief initializes a writer.
+ *
+ *   @param writer: the writer;
+ *   @param socket: socket file descriptor.
+ */
+
+void command_writer_init(struct command_writer* writer, int socket);
+
+
+/**
+ *   @brief appends a piece of a command.
+ *
+ *   @param writer: the writer;
+ *   @param data:   the bytes to append; if length >= COMMAND_WRITER_COPY_LIMIT they are
+ *                  not copied and must stay valid until the next flush;
+ *   @param length: the number of bytes.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_append(struct command_writer* writer, const char* data, size_t length);
+
+
+/**
+ *   @brief appends a NUL-terminated piece of a command.
+ *
+ *   @param writer: the writer;
+ *   @param text:   the text to append.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_append_string(struct command_writer* writer, const char* text);
+
+
+/**
+ *   @brief terminates the current command with a newline.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_end(struct command_writer* writer);
+
+
+/**
+ *   @brief appends a whole command and terminates it.
+ *
+ *   @param writer:  the writer;
+ *   @param command: the command, without the newline.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_command(struct command_writer* writer, const char* command);
+
+
+/**
+ *   @brief appends commands already encoded, each terminated by its newline, and counts them.
+ *
+ *   @param writer: the writer;
+ *   @param data:   the bytes of the commands, newlines included; if length >= COMMAND_WRITER_COPY_LIMIT
+ *                  they are not copied and must stay valid until the next flush;
+ *   @param length: the number of bytes;
+ *   @param count:  the number of commands in the bytes.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_encoded(struct command_writer* writer, const char* data, size_t length, unsigned long count);
+
+
+/**
+ *   @brief writes everything pending, resuming after partial writes.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns the number of bytes written.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+long command_writer_flush(struct command_writer* writer);
+
+#endif
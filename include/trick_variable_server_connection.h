@@ -73,6 +73,8 @@ int connect_to_variable_server(int socket, char* host, int port);
 
 /**
  *   @brief sends the given command and any commands to the Trick Variable Server.     
+ *   There is no limit on the length of the command; see trick_variable_server_command_writer.h
+ *   to send many commands with few writes.
  *   
  *   @param socket:  socket file descriptor; 
  *   @param command: the comand to send. 
@@ -363,4 +365,16 @@ int receive_message_from_variable_server(int socket, void *server_reply, unsigne
 
 int socket_shutdown(int socket);
 
+
+/**
+ *   @brief releases the socket file descriptor without sending any command to the server.
+ *
+ *   @param socket: socket file descriptor. 
+ *
+ *   @return  Upon successful completion, the function returns 0. 
+ *            Otherwise, -1 is returned and errno is set to indicate the error.  
+ */
+
+int close_socket(int socket);
+
 #endif
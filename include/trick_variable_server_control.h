@@ -0,0 +1,135 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_control.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Acknowledged run and freeze of the simulation.
+ *
+ * A control keeps a dedicated session, subscribed in ASCII to the execution mode of the
+ * simulation (trick_sys.sched.mode) only. control_run() and control_freeze() send the
+ * command on it, then wait for the messages of the session until the new mode is observed
+ * or the deadline expires, and measure the transition latency: from the write of the
+ * command to the arrival of the first message showing the new mode. The resolution of the
+ * measure is the cycle of the session.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_control_h_
+#define _trick_variable_server_control_h_
+
+#include "trick_variable_server_session.h"
+
+#define CONTROL_MODE_VARIABLE "trick_sys.sched.mode"
+#define CONTROL_DEFAULT_CYCLE 0.01
+
+
+/**
+ *   @brief the execution modes of a Trick simulation (values of trick_sys.sched.mode).
+ */
+
+enum control_mode {
+	CONTROL_MODE_INITIALIZATION = 0,
+	CONTROL_MODE_FREEZE = 1,
+	CONTROL_MODE_RUN = 5
+};
+
+
+/**
+ *   @brief a control of the execution of the simulation.
+ */
+
+struct control {
+	struct session session;        /**< the session subscribed to the execution mode */
+	int mode;                      /**< the last mode observed */
+	double latency;                /**< seconds between the last command and the observation of its mode */
+};
+
+
+/**
+ *   @brief opens the session watching the execution mode and reads the current one.
+ *
+ *   @param control: the control;
+ *   @param host:    host IPv4 address of the Trick Variable Server;
+ *   @param port:    service port number;
+ *   @param cycle:   period of the mode updates in seconds, 0 for CONTROL_DEFAULT_CYCLE;
+ *   @param timeout: seconds to wait for the first mode, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int control_open(struct control* control, char* host, int port, double cycle, double timeout);
+
+
+/**
+ *   @brief closes the session.
+ *
+ *   @param control: the control.
+ */
+
+void control_close(struct control* control);
+
+
+/**
+ *   @brief sends trick.exec_run() and waits until the simulation is in run mode.
+ *
+ *   @param control: the control;
+ *   @param timeout: seconds to wait for the transition, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0 and control->latency holds
+ *            the transition latency. Otherwise, -1 is returned and errno is set to indicate
+ *            the error, @c ETIMEDOUT if the transition was not observed in time.
+ */
+
+int control_run(struct control* control, double timeout);
+
+
+/**
+ *   @brief sends trick.exec_freeze() and waits until the simulation is in freeze mode.
+ *
+ *   @param control: the control;
+ *   @param timeout: seconds to wait for the transition, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0 and control->latency holds
+ *            the transition latency. Otherwise, -1 is returned and errno is set to indicate
+ *            the error, @c ETIMEDOUT if the transition was not observed in time.
+ */
+
+int control_freeze(struct control* control, double timeout);
+
+
+/**
+ *   @brief waits until the simulation is in the given mode, without sending any command.
+ *
+ *   @param control: the control;
+ *   @param mode:    one of enum control_mode;
+ *   @param timeout: seconds to wait, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ETIMEDOUT if the mode was not observed in time.
+ */
+
+int control_wait_mode(struct control* control, int mode, double timeout);
+
+#endif
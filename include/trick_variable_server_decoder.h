@@ -0,0 +1,358 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_decoder.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Decoding of the binary messages of the Trick Variable Server.
+ *
+ * A binary variable message is: message indicator (4 bytes, 0), message size (4 bytes),
+ * number of variables (4 bytes), then for each variable its name length and name (omitted
+ * with set_binary_no_names()), its Trick type (4 bytes), its size (4 bytes) and its value.
+ *
+ * As long as the subscription set does not change, the layout of the messages does not change
+ * either: a subscription keeps the list of the subscribed variables and, on the first message
+ * after a change, compiles a decode plan, a flat array of (offset, decoder, slot) operations
+ * that decodes every following message without looking at the type codes again.
+ *
+ * subscription_resubscribe() replaces the whole set in one write: var_pause(), var_clear(),
+ * the new var_add() commands, a var_send_once() of a barrier variable and var_unpause(). The
+ * server answers commands in order on the same stream, so every variable message received
+ * before the reply to the barrier has the prior layout and is discarded, even when it has the
+ * same number of variables as the new set; the first message after it starts the new generation.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation of the message formats.
+ */
+
+#ifndef _trick_variable_server_decoder_h_
+#define _trick_variable_server_decoder_h_
+
+struct connection_metrics;
+
+/** the message indicator of the replies to var_send_once() (VS_SEND_ONCE in Trick) */
+#define SUBSCRIPTION_SEND_ONCE_INDICATOR 5
+
+/** the variable sent once by subscription_resubscribe() to mark the end of the prior layout */
+#define SUBSCRIPTION_BARRIER_VARIABLE "trick_sys.sched.time_tics"
+
+/**
+ *   @brief the Trick type codes carried by the binary messages.
+ */
+
+enum trick_type {
+	TRICK_TYPE_VOID = 0,
+	TRICK_TYPE_CHARACTER = 1,
+	TRICK_TYPE_UNSIGNED_CHARACTER = 2,
+	TRICK_TYPE_STRING = 3,
+	TRICK_TYPE_SHORT = 4,
+	TRICK_TYPE_UNSIGNED_SHORT = 5,
+	TRICK_TYPE_INTEGER = 6,
+	TRICK_TYPE_UNSIGNED_INTEGER = 7,
+	TRICK_TYPE_LONG = 8,
+	TRICK_TYPE_UNSIGNED_LONG = 9,
+	TRICK_TYPE_FLOAT = 10,
+	TRICK_TYPE_DOUBLE = 11,
+	TRICK_TYPE_BITFIELD = 12,
+	TRICK_TYPE_UNSIGNED_BITFIELD = 13,
+	TRICK_TYPE_LONG_LONG = 14,
+	TRICK_TYPE_UNSIGNED_LONG_LONG = 15,
+	TRICK_TYPE_FILE_PTR = 16,
+	TRICK_TYPE_BOOLEAN = 17,
+	TRICK_TYPE_WCHAR = 18,
+	TRICK_TYPE_WSTRING = 19,
+	TRICK_TYPE_VOID_PTR = 20,
+	TRICK_TYPE_ENUMERATED = 21,
+	TRICK_TYPE_STRUCTURED = 22,
+	TRICK_TYPE_OPAQUE_TYPE = 23,
+	TRICK_TYPE_STL = 24
+};
+
+
+/**
+ *   @brief converts a value in the message to a double.
+ */
+
+typedef double (*decode_function)(const unsigned char* value);
+
+
+/**
+ *   @brief one operation of a decode plan.
+ */
+
+struct decode_op {
+	unsigned int offset;        /**< offset of the value in the message */
+	unsigned int size;          /**< size of the value in bytes */
+	int type;                   /**< Trick type of the value */
+	int slot;                   /**< index of the variable in the subscription */
+	decode_function decode;     /**< converter selected for (type, size) */
+};
+
+
+/**
+ *   @brief a decode plan compiled for one message layout.
+ */
+
+struct decode_plan {
+	int valid;
+	int names;                  /**< 1 if the messages carry the variable names */
+	int count;                  /**< number of operations (variables) */
+	unsigned int frame_length;  /**< length of every message with this layout */
+	unsigned int stride;        /**< distance between values when the plan is uniform, 0 otherwise */
+	int kernel;                 /**< specialized loop used for the whole message */
+	struct decode_op* ops;
+	int capacity;
+	unsigned long generation;   /**< incremented by every compilation */
+};
+
+
+/**
+ *   @brief the client-side list of the variables subscribed on a connection.
+ */
+
+struct subscription {
+	int socket;
+	int names;                  /**< 1 after set_binary(), 0 after set_binary_no_names() */
+	char** variables;
+	int count;
+	int capacity;
+	struct decode_plan plan;
+	int unsupported;            /**< 1 if the layout of the set cannot be compiled (strings), until the set changes */
+	int checked;                /**< 1 once a message of the current set has been checked type by type */
+	struct connection_metrics* metrics;  /**< counters to update, NULL if none */
+
+	unsigned long generation;   /**< incremented by every subscription_resubscribe() */
+	int barriers;               /**< barrier replies still expected: until then the messages have a prior layout */
+	unsigned long stale;        /**< messages of a prior layout discarded */
+	unsigned long long switch_started;   /**< metrics_now() when the last resubscription was sent */
+	unsigned long long switch_time;      /**< nanoseconds from the last resubscription to the first message of the new set, 0 until then */
+};
+
+
+/**
+ *   @brief decodes a binary variable message walking it field by field.
+ *
+ *   @param frame:  the whole message;
+ *   @param length: the length of the message;
+ *   @param names:  1 if the message carries the variable names;
+ *   @param values: filled with the values (NaN for the non-numeric ones);
+ *   @param count:  the number of entries in values.
+ *
+ *   @return  the number of variables decoded. If the message is not valid,
+ *            -1 is returned and errno is set to @c EPROTO.
+ */
+
+int decode_frame_generic(const unsigned char* frame, unsigned int length, int names, double* values, int count);
+
+
+/**
+ *   @brief compiles the decode plan of the given message layout.
+ *
+ *   @param plan:   the plan (initialized to zero the first time);
+ *   @param frame:  a message with the layout to compile;
+ *   @param length: the length of the message;
+ *   @param names:  1 if the message carries the variable names.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error
+ *            (@c EPROTO if the message is not valid, @c ENOTSUP if its layout is not fixed).
+ */
+
+int decode_plan_compile(struct decode_plan* plan, const unsigned char* frame, unsigned int length, int names);
+
+
+/**
+ *   @brief tells whether a message has the layout a plan was compiled for: same length, same
+ *   number of variables and, variable by variable, same type code and size.
+ *
+ *   @param plan:   the plan;
+ *   @param frame:  the message;
+ *   @param length: the length of the message.
+ *
+ *   @return  1 if the plan can decode the message, 0 otherwise.
+ */
+
+int decode_plan_matches(const struct decode_plan* plan, const unsigned char* frame, unsigned int length);
+
+
+/**
+ *   @brief decodes a message with a compiled plan.
+ *
+ *   @param plan:   the compiled plan;
+ *   @param frame:  the message;
+ *   @param length: the length of the message;
+ *   @param values: filled with the values, one slot per variable.
+ *
+ *   @return  the number of variables decoded. If the message does not match the layout of the plan,
+ *            -1 is returned and errno is set to @c EPROTO.
+ */
+
+int decode_plan_decode(const struct decode_plan* plan, const unsigned char* frame, unsigned int length, double* values);
+
+
+/**
+ *   @brief releases the operations of a plan.
+ *
+ *   @param plan: the plan.
+ */
+
+void decode_plan_destroy(struct decode_plan* plan);
+
+
+/**
+ *   @brief initializes an empty subscription.
+ *
+ *   @param subscription: the subscription;
+ *   @param socket:       socket file descriptor;
+ *   @param names:        1 if the server sends the names (set_binary()), 0 otherwise (set_binary_no_names()).
+ */
+
+void subscription_init(struct subscription* subscription, int socket, int names);
+
+
+/**
+ *   @brief releases the subscription (the variables stay subscribed on the server).
+ *
+ *   @param subscription: the subscription.
+ */
+
+void subscription_destroy(struct subscription* subscription);
+
+
+/**
+ *   @brief records a variable already subscribed on the server (e.g. by session_start()), without sending anything.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_record(struct subscription* subscription, const char* variable_name);
+
+
+/**
+ *   @brief adds a variable with add_variable_to_server() and records it.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to be observed.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_add(struct subscription* subscription, const char* variable_name);
+
+
+/**
+ *   @brief adds a variable with add_variable_to_sever_with_units() and records it.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to be observed;
+ *   @param units:         units of measure of the variable to be observed.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_add_with_units(struct subscription* subscription, const char* variable_name, const char* units);
+
+
+/**
+ *   @brief removes a variable with remove_variable_from_server(). The slots of the following variables shift down by one.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to stop observing.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_remove(struct subscription* subscription, const char* variable_name);
+
+
+/**
+ *   @brief removes all the variables with clear().
+ *
+ *   @param subscription: the subscription.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_clear(struct subscription* subscription);
+
+
+/**
+ *   @brief replaces the whole set of variables in one write (var_pause(), var_clear(), var_add()
+ *   for each variable, var_send_once() of SUBSCRIPTION_BARRIER_VARIABLE, var_unpause()) and starts
+ *   a new generation: the messages received before the reply to the barrier are discarded.
+ *   The server must support var_send_once(), and the client must not send it while the barrier
+ *   is pending.
+ *
+ *   @param subscription: the subscription;
+ *   @param variables:    the names of the variables, in the order of their slots;
+ *   @param units:        the units of each variable (NULL entries for the default ones), or NULL;
+ *   @param count:        the number of variables.
+ *
+ *   @return  the new generation. Otherwise, -1 is returned and errno is set to indicate the
+ *            error; the set is unchanged if nothing was written.
+ */
+
+long subscription_resubscribe(struct subscription* subscription, const char* const* variables, const char* const* units, int count);
+
+
+/**
+ *   @brief makes sure that the decode plan of the subscription matches a message (length, number
+ *   of variables and type codes), compiling it again otherwise. The type codes are checked only
+ *   on the first message after the set changes; to replace variables keeping the same number and
+ *   length, use subscription_resubscribe(), whose barrier keeps the prior layout out.
+ *
+ *   @param subscription: the subscription;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message.
+ *
+ *   @return  1 if the plan matches the message, 0 if the message must be skipped because it
+ *            is not a variable message (or is the barrier of a resubscription) or it still has
+ *            the layout prior to the last change. Otherwise, -1 is returned and errno is set to
+ *            indicate the error (@c EPROTO if the message is not valid, @c ENOTSUP if its layout
+ *            cannot be compiled).
+ */
+
+int subscription_prepare(struct subscription* subscription, const unsigned char* frame, unsigned int length);
+
+
+/**
+ *   @brief decodes a binary variable message, compiling the plan first if the set has changed.
+ *
+ *   @param subscription: the subscription;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message;
+ *   @param values:       filled with the values, one slot per subscribed variable.
+ *
+ *   @return  1 if the message was decoded, 0 if it was skipped because it is not a variable
+ *            message or it still has the layout prior to the last change. If the message is
+ *            not valid, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_decode(struct subscription* subscription, const unsigned char* frame, unsigned int length, double* values);
+
+#endif
@@ -0,0 +1,260 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_health.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Health monitor of the links with the Trick Variable Server.
+ *
+ * The monitor compares the messages received on each link with the period requested with
+ * set_cycle(). The receive path only counts its messages: health_frame() is one relaxed
+ * atomic increment, and a link can instead read the METRIC_FRAMES counter of the metrics
+ * already attached to its receiver. All the links share one timerfd ticking at the
+ * resolution of the monitor, and a hashed timer wheel: each link is checked once per
+ * window of a few periods, when its bucket comes up, without reading any clock.
+ *
+ * At each check a link is stalled if no message arrived for HEALTH_STALL_PERIODS periods,
+ * slow if it received less than HEALTH_SLOW_RATIO of the messages expected in the window,
+ * healthy otherwise; every change raises an event (stall, slow, recovered) to the handler.
+ * The ticks are processed either by the single thread of health_start() or by the event
+ * loop of the application, polling health_fd() and calling health_process().
+ */
+
+#ifndef _trick_variable_server_health_h_
+#define _trick_variable_server_health_h_
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "trick_variable_server_metrics.h"
+
+#define HEALTH_WHEEL_SIZE 512
+#define HEALTH_WINDOW_PERIODS 4
+#define HEALTH_STALL_PERIODS 10
+#define HEALTH_SLOW_RATIO 0.5
+
+
+/**
+ *   @brief the state of a link.
+ */
+
+enum health_state {
+	HEALTH_OK = 0,                     /**< messages arrive at the expected rate */
+	HEALTH_SLOW,                       /**< messages arrive, at less than HEALTH_SLOW_RATIO of the expected rate */
+	HEALTH_STALLED                     /**< no message for HEALTH_STALL_PERIODS periods */
+};
+
+
+/**
+ *   @brief the events raised to the handler.
+ */
+
+enum health_event_type {
+	HEALTH_EVENT_STALL = 0,            /**< the link became stalled */
+	HEALTH_EVENT_SLOW,                 /**< the link became slow (or resumed slowly after a stall) */
+	HEALTH_EVENT_RECOVERED             /**< the link is healthy again */
+};
+
+
+/**
+ *   @brief a change of state of a link.
+ */
+
+struct health_event {
+	int link;                          /**< the link */
+	const char* name;                  /**< the name of the link */
+	int type;                          /**< one of enum health_event_type */
+	double time;                       /**< monitor time of the check, in seconds since health_init() */
+	double period;                     /**< the expected period */
+	double observed_period;            /**< mean interval between the messages of the window, 0 if none arrived */
+	double silence;                    /**< seconds since the last message seen */
+};
+
+
+/**
+ *   @brief callback receiving the events, from the thread processing the ticks.
+ */
+
+typedef void (*health_handler)(void* context, const struct health_event* event);
+
+
+/**
+ *   @brief a monitored link.
+ */
+
+struct health_link {
+	_Alignas(METRICS_CACHE_LINE) atomic_ulong frames;   /**< counted by health_frame() */
+	_Alignas(METRICS_CACHE_LINE) struct connection_metrics* metrics;   /**< if not NULL, its METRIC_FRAMES counter is read instead */
+	const char* name;
+	double period;                     /**< the expected period, as requested with set_cycle() */
+	int active;
+	int state;                         /**< one of enum health_state */
+	unsigned long seen;                /**< messages counted at the last check */
+	unsigned long long window_start;   /**< tick of the last check */
+	unsigned long long last_progress;  /**< tick of the last check that saw new messages */
+	unsigned long long due;            /**< tick of the next check */
+	int next;                          /**< next link in the same bucket of the wheel, -1 for none */
+};
+
+
+/**
+ *   @brief the monitor of a set of links.
+ */
+
+struct health_monitor {
+	int timer;                         /**< the timerfd */
+	double tick;                       /**< seconds per tick */
+	unsigned long long now;            /**< ticks elapsed since health_init() */
+	int wheel[HEALTH_WHEEL_SIZE];      /**< first link of each bucket, -1 for none */
+	struct health_link* links;
+	int capacity;
+	struct health_event* events;       /**< events of the tick being processed */
+	health_handler handler;
+	void* context;
+	pthread_mutex_t lock;              /**< protects the links (not their counters) and the wheel */
+	pthread_t thread;
+	atomic_int running;
+	unsigned long ticks;               /**< ticks processed */
+	unsigned long checks;              /**< link checks performed */
+};
+
+
+/**
+ *   @brief creates the timer and the links of a monitor.
+ *
+ *   @param monitor:  the monitor;
+ *   @param capacity: the largest number of links;
+ *   @param tick:     the resolution of the monitor in seconds (e.g. 0.005);
+ *   @param handler:  the callback receiving the events;
+ *   @param context:  passed to the handler.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_init(struct health_monitor* monitor, int capacity, double tick, health_handler handler, void* context);
+
+
+/**
+ *   @brief stops the thread of the monitor, if any, and releases the monitor.
+ *
+ *   @param monitor: the monitor.
+ */
+
+void health_destroy(struct health_monitor* monitor);
+
+
+/**
+ *   @brief starts monitoring a link.
+ *
+ *   @param monitor: the monitor;
+ *   @param name:    the name of the link, reported in the events; it is not copied;
+ *   @param period:  the period requested with set_cycle(), in seconds;
+ *   @param metrics: the metrics attached to the receiver of the link, whose frames are counted,
+ *                   or NULL to count them with health_frame().
+ *
+ *   @return  the index of the link. Otherwise, -1 is returned and errno is set to indicate the
+ *            error, @c ENOSPC if the monitor is full.
+ */
+
+int health_add(struct health_monitor* monitor, const char* name, double period, struct connection_metrics* metrics);
+
+
+/**
+ *   @brief stops monitoring a link.
+ *
+ *   @param monitor: the monitor;
+ *   @param link:    the index of the link.
+ */
+
+void health_remove(struct health_monitor* monitor, int link);
+
+
+/**
+ *   @brief changes the expected period of a link, after a new set_cycle(); its window and its
+ *   silence start again.
+ *
+ *   @param monitor: the monitor;
+ *   @param link:    the index of the link;
+ *   @param period:  the new period in seconds.
+ */
+
+void health_set_period(struct health_monitor* monitor, int link, double period);
+
+
+/**
+ *   @brief counts a message received on a link. No system call.
+ *
+ *   @param monitor: the monitor;
+ *   @param link:    the index of the link.
+ */
+
+static inline void health_frame(struct health_monitor* monitor, int link) {
+	atomic_fetch_add_explicit(&monitor->links[link].frames, 1, memory_order_relaxed);
+}
+
+
+/**
+ *   @brief the file descriptor of the timer, readable when ticks are due: to be polled by the
+ *   event loop of the application, which then calls health_process().
+ *
+ *   @param monitor: the monitor.
+ *
+ *   @return  the timerfd.
+ */
+
+int health_fd(const struct health_monitor* monitor);
+
+
+/**
+ *   @brief processes the ticks elapsed and raises the events of the links checked.
+ *
+ *   @param monitor: the monitor;
+ *   @param wait:    1 to wait for the next tick if none is due, 0 to return at once.
+ *
+ *   @return  the number of events raised. Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_process(struct health_monitor* monitor, int wait);
+
+
+/**
+ *   @brief starts the single thread processing the ticks of all the links.
+ *
+ *   @param monitor: the monitor.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_start(struct health_monitor* monitor);
+
+
+/**
+ *   @brief stops the thread of the monitor, within one tick.
+ *
+ *   @param monitor: the monitor.
+ */
+
+void health_stop(struct health_monitor* monitor);
+
+#endif
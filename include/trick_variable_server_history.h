@@ -0,0 +1,152 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_history.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief In-memory history of the decoded values, with windowed queries.
+ *
+ * A history keeps, for every slot of a subscription, the last values received in a ring
+ * preallocated at a power-of-two size; the receive path appends one row per decoded message
+ * (the time and the values of all the slots) in constant time, without allocating.
+ * The ring is split into blocks of a power-of-two number of samples, and the minimum, the
+ * maximum, the sum and the last value of every block are kept up to date while appending.
+ * A windowed query (min, max, mean and last value over a time range) combines the summaries
+ * of the blocks that lie entirely inside the range, and reads the raw samples only of the
+ * (at most two) blocks that straddle its ends, so that its result covers exactly the samples
+ * in the range.
+ * The values of a slot and its summaries are contiguous, so a query touches few cache lines.
+ */
+
+#ifndef _trick_variable_server_history_h_
+#define _trick_variable_server_history_h_
+
+
+/**
+ *   @brief the summary of one block of samples of one slot.
+ */
+
+struct history_summary {
+	double min;
+	double max;
+	double sum;
+	double last;
+};
+
+
+/**
+ *   @brief the result of a windowed query.
+ */
+
+struct history_stats {
+	double min;
+	double max;
+	double mean;
+	double last;                   /**< the value of the last sample in the range */
+	double from;                   /**< the time of the first sample covered */
+	double to;                     /**< the time of the last sample covered */
+	unsigned long count;           /**< the number of samples covered */
+};
+
+
+/**
+ *   @brief the history of the slots of a subscription.
+ */
+
+struct history {
+	int slots;                     /**< number of slots (variables) */
+	unsigned int capacity;         /**< samples per slot, a power of two */
+	unsigned int block;            /**< samples per block, a power of two */
+	unsigned int shift;            /**< log2(block) */
+	unsigned int blocks;           /**< capacity / block */
+	unsigned long long head;       /**< number of rows appended since the creation */
+	double* times;                 /**< the time of each sample */
+	double* values;                /**< the samples, slot after slot */
+	double* block_first;           /**< the time of the first sample of each block */
+	double* block_last;            /**< the time of the last sample of each block */
+	unsigned int* block_count;     /**< the samples in each block */
+	struct history_summary* summaries;  /**< the summaries, slot after slot */
+};
+
+
+/**
+ *   @brief allocates a history. The sizes are rounded up to powers of two.
+ *
+ *   @param history:  the history;
+ *   @param slots:    the number of slots;
+ *   @param capacity: the number of samples to keep for each slot;
+ *   @param block:    the number of samples summarized together (at most capacity / 2).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int history_init(struct history* history, int slots, unsigned int capacity, unsigned int block);
+
+
+/**
+ *   @brief releases a history.
+ *
+ *   @param history: the history.
+ */
+
+void history_destroy(struct history* history);
+
+
+/**
+ *   @brief appends one row: the values of all the slots at the given time. The oldest
+ *   block is dropped when the ring is full.
+ *
+ *   @param history: the history;
+ *   @param time:    the time of the values, not earlier than the one of the previous row;
+ *   @param values:  the value of each slot (e.g. as decoded by subscription_decode()).
+ */
+
+void history_append(struct history* history, double time, const double* values);
+
+
+/**
+ *   @brief computes the minimum, maximum, mean and last value of a slot over a time range.
+ *
+ *   @param history: the history;
+ *   @param slot:    the index of the slot;
+ *   @param from:    the start of the range;
+ *   @param to:      the end of the range;
+ *   @param stats:   filled with the result, which covers the samples in the range.
+ *
+ *   @return  the number of samples covered, 0 if no sample falls in the range.
+ */
+
+unsigned long history_query(const struct history* history, int slot, double from, double to, struct history_stats* stats);
+
+
+/**
+ *   @brief the time of the newest sample.
+ *
+ *   @param history: the history.
+ *
+ *   @return  the time of the last row appended, NaN if the history is empty.
+ */
+
+double history_last_time(const struct history* history);
+
+#endif
@@ -0,0 +1,166 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_injector.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Batched injection of values into simulation variables.
+ *
+ * An injector binds a set of writable variables once: the text of the command of each one,
+ * trick.var_set("name", value[, "units"]), is prepared up to the value. Every cycle the caller
+ * sets the new values (injector_set_double(), injector_set_integer()), then injector_send()
+ * writes one trick.var_set() per updated variable, all in one packed write.
+ *
+ * The doubles are written as the shortest text that reads back to the same double (Grisu2,
+ * which is the shortest in the vast majority of cases and always round-trips), without the
+ * locale-dependent and much slower printf() machinery.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_injector_h_
+#define _trick_variable_server_injector_h_
+
+#include <stddef.h>
+
+#include "trick_variable_server_metrics.h"
+
+#define INJECTOR_NUMBER_SIZE 32         /* room for the text of a value */
+
+
+/**
+ *   @brief the types of value that can be injected.
+ */
+
+enum injector_type {
+	INJECTOR_DOUBLE = 0,
+	INJECTOR_INTEGER
+};
+
+
+/**
+ *   @brief a bound variable.
+ */
+
+struct injector_slot {
+	size_t prefix;                 /**< offset of the text trick.var_set("name",  in the texts of the injector */
+	size_t prefix_length;
+	size_t suffix;                 /**< offset of the text  , "units")  or  )  in the texts of the injector */
+	size_t suffix_length;
+	int type;                      /**< one of enum injector_type */
+	int updated;                   /**< 1 if set since the last send */
+	double value;
+	long long integer;
+};
+
+
+/**
+ *   @brief an injector bound to a set of variables on one connection.
+ */
+
+struct injector {
+	int socket;
+	int count;                     /**< number of variables */
+	struct injector_slot* slots;
+	char* texts;                   /**< the fixed parts of the commands */
+	char* buffer;                  /**< the packed commands of a send, large enough for all of them */
+	int* updated;                  /**< the indexes of the variables set since the last send, in order */
+	int updated_count;
+
+	unsigned long sends;           /**< injector_send() calls that wrote */
+	unsigned long long values;     /**< values written */
+	struct connection_metrics* metrics;  /**< counters to update, NULL if none */
+};
+
+
+/**
+ *   @brief binds an injector to a set of variables.
+ *
+ *   @param injector:  the injector;
+ *   @param socket:    socket file descriptor;
+ *   @param variables: the names of the variables;
+ *   @param units:     the units of the values of each variable, NULL (or a NULL entry) for none;
+ *   @param count:     the number of variables.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int injector_bind(struct injector* injector, int socket, char** variables, char** units, int count);
+
+
+/**
+ *   @brief releases an injector.
+ *
+ *   @param injector: the injector.
+ */
+
+void injector_destroy(struct injector* injector);
+
+
+/**
+ *   @brief sets the value of a variable of floating-point type for the next send.
+ *
+ *   @param injector: the injector;
+ *   @param index:    the index of the variable;
+ *   @param value:    the value.
+ */
+
+void injector_set_double(struct injector* injector, int index, double value);
+
+
+/**
+ *   @brief sets the value of a variable of integer type for the next send.
+ *
+ *   @param injector: the injector;
+ *   @param index:    the index of the variable;
+ *   @param value:    the value.
+ */
+
+void injector_set_integer(struct injector* injector, int index, long long value);
+
+
+/**
+ *   @brief writes the values set since the last send, in one write.
+ *
+ *   @param injector: the injector.
+ *
+ *   @return  the number of values written (0 if none was set). Otherwise, -1 is
+ *            returned and errno is set to indicate the error.
+ */
+
+int injector_send(struct injector* injector);
+
+
+/**
+ *   @brief writes a double as the shortest Python literal that reads back to it
+ *   (e.g. 0.1, 1e+300, -0.0, float('nan')).
+ *
+ *   @param value:  the value;
+ *   @param buffer: at least INJECTOR_NUMBER_SIZE characters; the text is not null-terminated.
+ *
+ *   @return  the number of characters written.
+ */
+
+int injector_format_double(double value, char* buffer);
+
+#endif
@@ -0,0 +1,169 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_merge.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Time-ordered merge of the frames received from several simulations.
+ *
+ * Each connection (source) pushes its frames, tagged with their sim @c time, into a bounded
+ * queue; the merge emits them in global sim time order with a k-way merge over a min-heap
+ * of the queue heads. A frame is emitted only when every other source has either a frame
+ * buffered, already passed its sim time, or been silent for longer than the lateness tolerance.
+ * Frames within a source must arrive in non-decreasing sim time, as the Trick Variable Server sends them.
+ */
+
+#ifndef _trick_variable_server_merge_h_
+#define _trick_variable_server_merge_h_
+
+/**
+ *   @brief a buffered frame.
+ */
+
+struct merge_item {
+	double sim_time;             /**< the sim time of the frame */
+	double arrival_time;         /**< host time at which the frame was pushed */
+	int source;                  /**< index of the source the frame comes from */
+	int late;                    /**< 1 if an older frame was already emitted when this one arrived */
+	unsigned int length;         /**< length of the frame */
+	unsigned char* data;         /**< copy of the frame */
+};
+
+
+/**
+ *   @brief the bounded queue of one source.
+ */
+
+struct merge_source {
+	struct merge_item* items;
+	unsigned char* storage;
+	int head;
+	int count;
+	int finished;
+	double last_sim_time;        /**< sim time of the last frame pushed */
+	double last_arrival;         /**< host time of the last frame pushed */
+	unsigned long pushed;
+	unsigned long rejected;      /**< frames refused because the queue was full */
+};
+
+
+/**
+ *   @brief the merge stage.
+ */
+
+struct stream_merge {
+	int sources;
+	int depth;                   /**< frames buffered per source */
+	unsigned int max_frame;      /**< largest frame accepted */
+	double lateness;             /**< seconds to wait for a silent source before emitting without it */
+	struct merge_source* source;
+	int* heap;                   /**< indices of the non-empty sources, ordered by the sim time of their head */
+	int heap_size;
+	double last_emitted;         /**< sim time of the last frame emitted */
+
+	unsigned long emitted;       /**< frames emitted */
+	unsigned long late_frames;   /**< frames that arrived after a newer frame had been emitted */
+	unsigned long forced;        /**< frames emitted without waiting because a queue was full */
+	unsigned long timeouts;      /**< frames emitted without waiting for a source silent beyond the lateness */
+	double skew;                 /**< current spread of the latest sim times of the sources */
+	double max_skew;             /**< largest spread observed */
+	double skew_sum;
+	unsigned long skew_samples;
+};
+
+
+/**
+ *   @brief initializes the merge stage and preallocates all its buffers.
+ *
+ *   @param merge:     the merge stage;
+ *   @param sources:   the number of connections;
+ *   @param depth:     the number of frames buffered per connection;
+ *   @param max_frame: the largest frame accepted, in bytes;
+ *   @param lateness:  seconds to wait for a silent connection before emitting without it.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int merge_init(struct stream_merge* merge, int sources, int depth, unsigned int max_frame, double lateness);
+
+
+/**
+ *   @brief releases the buffers of the merge stage.
+ *
+ *   @param merge: the merge stage.
+ */
+
+void merge_destroy(struct stream_merge* merge);
+
+
+/**
+ *   @brief buffers a frame received from a source.
+ *
+ *   @param merge:        the merge stage;
+ *   @param source:       index of the source;
+ *   @param sim_time:     the sim time of the frame;
+ *   @param data:         the frame;
+ *   @param length:       the length of the frame;
+ *   @param arrival_time: the host CLOCK_MONOTONIC time of arrival, in seconds.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to @c EAGAIN if the queue of the source is full (call merge_pop() first),
+ *            @c EMSGSIZE if the frame is too large, @c EINVAL if the source is not valid.
+ */
+
+int merge_push(struct stream_merge* merge, int source, double sim_time, const void* data, unsigned int length, double arrival_time);
+
+
+/**
+ *   @brief emits the next frame in sim time order, if it is safe to do so.
+ *
+ *   @param merge: the merge stage;
+ *   @param now:   the current host CLOCK_MONOTONIC time, in seconds;
+ *   @param item:  filled with the frame; its data stays valid until the next merge_push() on the same source.
+ *
+ *   @return  1 if a frame was emitted, 0 if the merge must wait for more frames.
+ */
+
+int merge_pop(struct stream_merge* merge, double now, struct merge_item* item);
+
+
+/**
+ *   @brief marks a source as ended: the merge no longer waits for it.
+ *
+ *   @param merge:  the merge stage;
+ *   @param source: index of the source.
+ */
+
+void merge_finish(struct stream_merge* merge, int source);
+
+
+/**
+ *   @brief the average spread of the latest sim times of the sources.
+ *
+ *   @param merge: the merge stage.
+ *
+ *   @return  the mean skew in sim seconds.
+ */
+
+double merge_mean_skew(const struct stream_merge* merge);
+
+#endif
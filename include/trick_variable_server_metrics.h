@@ -0,0 +1,172 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_metrics.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Per-connection counters of the traffic with the Trick Variable Server.
+ *
+ * A struct connection_metrics is attached to the objects of one connection (the frame
+ * receiver, the command writer, the command queue, the subscription) by setting their
+ * @c metrics field; they then count what they do. Each counter sits on its own cache line,
+ * so that the receiving thread and the writing threads do not contend, and is updated
+ * with a relaxed atomic add. The counters can be rendered at any time, from any thread,
+ * as Prometheus text or JSON into a buffer provided by the caller.
+ */
+
+#ifndef _trick_variable_server_metrics_h_
+#define _trick_variable_server_metrics_h_
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define METRICS_CACHE_LINE 64
+
+
+/**
+ *   @brief the counters of a connection. The times are in nanoseconds.
+ */
+
+enum metrics_counter_id {
+	METRIC_COMMANDS_SENT = 0,      /**< commands written */
+	METRIC_SEND_CALLS,             /**< write system calls */
+	METRIC_BYTES_SENT,             /**< bytes written */
+	METRIC_RECV_CALLS,             /**< receive system calls */
+	METRIC_BYTES_RECEIVED,         /**< bytes received */
+	METRIC_FRAMES,                 /**< complete messages extracted */
+	METRIC_PARSE_ERRORS,           /**< corrupted or undecodable messages */
+	METRIC_PARTIAL_CARRYOVERS,     /**< reads that started with an incomplete message left from the previous one */
+	METRIC_CYCLE_CHANGES,          /**< update periods changed by the rate controller */
+	METRIC_SEND_TIME,              /**< time spent writing */
+	METRIC_RECEIVE_TIME,           /**< time spent in the receive system calls, waiting included */
+	METRIC_PARSE_TIME,             /**< time spent extracting messages */
+	METRIC_DECODE_TIME,            /**< time spent decoding values */
+	METRIC_DISPATCH_TIME,          /**< time spent in the handlers of the application */
+	METRIC_COUNT
+};
+
+
+/**
+ *   @brief the output formats of metrics_render().
+ */
+
+enum metrics_format {
+	METRICS_PROMETHEUS = 0,        /**< Prometheus text exposition format */
+	METRICS_JSON                   /**< a JSON array with one object per connection */
+};
+
+
+/**
+ *   @brief a counter alone on its cache line.
+ */
+
+struct metrics_counter {
+	_Alignas(METRICS_CACHE_LINE) _Atomic unsigned long long value;
+	char padding[METRICS_CACHE_LINE - sizeof(unsigned long long)];
+};
+
+
+/**
+ *   @brief the counters of one connection.
+ */
+
+struct connection_metrics {
+	const char* name;                                  /**< value of the "connection" label */
+	struct metrics_counter counter[METRIC_COUNT];
+};
+
+
+/**
+ *   @brief initializes the counters of a connection to zero.
+ *
+ *   @param metrics: the counters;
+ *   @param name:    the name of the connection, used as label; it is not copied.
+ */
+
+void metrics_init(struct connection_metrics* metrics, const char* name);
+
+
+/**
+ *   @brief sets all the counters of a connection back to zero.
+ *
+ *   @param metrics: the counters.
+ */
+
+void metrics_reset(struct connection_metrics* metrics);
+
+
+/**
+ *   @brief reads all the counters of a connection.
+ *
+ *   @param metrics: the counters;
+ *   @param values:  filled with METRIC_COUNT values, indexed by enum metrics_counter_id.
+ */
+
+void metrics_snapshot(const struct connection_metrics* metrics, unsigned long long* values);
+
+
+/**
+ *   @brief renders the counters of several connections into a buffer, without allocating memory.
+ *
+ *   @param metrics: the connections;
+ *   @param count:   the number of connections;
+ *   @param format:  @c METRICS_PROMETHEUS or @c METRICS_JSON;
+ *   @param buffer:  the output, NUL-terminated;
+ *   @param size:    the size of the buffer.
+ *
+ *   @return  Upon successful completion, the function returns the length of the text.
+ *            Otherwise, -1 is returned and errno is set to @c ENOSPC if the buffer is too
+ *            small, or to @c EINVAL if the format is not valid.
+ */
+
+int metrics_render(struct connection_metrics* const* metrics, int count, int format, char* buffer, size_t size);
+
+
+/**
+ *   @brief adds to a counter; does nothing if no counters are attached.
+ *
+ *   @param metrics: the counters, or NULL;
+ *   @param id:      the counter;
+ *   @param amount:  the amount to add.
+ */
+
+static inline void metrics_add(struct connection_metrics* metrics, int id, unsigned long long amount) {
+	if (metrics != NULL) {
+		atomic_fetch_add_explicit(&metrics->counter[id].value, amount, memory_order_relaxed);
+	}
+}
+
+
+/**
+ *   @brief reads CLOCK_MONOTONIC in nanoseconds, for the time counters.
+ *
+ *   @return  the current time, in nanoseconds.
+ */
+
+static inline unsigned long long metrics_now() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,183 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_multirate.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Variables at several rates, with one connection per rate group.
+ *
+ * The Trick Variable Server sends all the variables of a connection at the cycle of that
+ * connection. A multirate session assigns each variable to a rate group: every group has
+ * its own connection, started with session_start() with the cycle and the copy mode of the
+ * group (binary messages without names), and its own subscription. Towards the user the
+ * groups are one set of variables with stable slots: multirate_poll() waits on all the
+ * connections at once and keeps the latest value of every variable, with the arrival time
+ * of the message that carried it.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_multirate_h_
+#define _trick_variable_server_multirate_h_
+
+#include "trick_variable_server_session.h"
+#include "trick_variable_server_decoder.h"
+
+#define MULTIRATE_MAX_EVENTS 16
+
+
+/**
+ *   @brief the setup of a rate group.
+ */
+
+struct multirate_group_config {
+	double cycle;                      /**< period of the updates in seconds, 0 to keep the default of the server */
+	int copy_mode;                     /**< argument of trick.var_set_copy_mode(), -1 to keep the default */
+	const char* client_tag;            /**< NULL to leave the tag unset */
+};
+
+
+/**
+ *   @brief a variable and the group it belongs to.
+ */
+
+struct multirate_variable {
+	const char* name;
+	const char* units;                 /**< NULL for the default units */
+	int group;                         /**< index of the rate group */
+};
+
+
+/**
+ *   @brief a rate group: its connection and its variables.
+ */
+
+struct multirate_group {
+	struct session session;            /**< the connection of the group */
+	struct subscription subscription;  /**< the variables of the group, in the order of its messages */
+	int* slots;                        /**< the slot of each variable of the group in the session */
+	double* values;                    /**< the values of the last message of the group */
+	int capacity;
+	unsigned long messages;            /**< messages decoded */
+	double last_arrival;               /**< CLOCK_MONOTONIC time of the last message, in seconds */
+};
+
+
+/**
+ *   @brief a session whose variables are spread over rate groups.
+ */
+
+struct multirate_session {
+	struct multirate_group* groups;
+	int group_count;
+	int epoll;                         /**< waits on the connections of all the groups */
+	int count;                         /**< slots used, removed variables included */
+	int capacity;
+	double* latest;                    /**< the latest value of every slot, NaN until received */
+	double* updated;                   /**< CLOCK_MONOTONIC arrival time of the latest value of every slot, 0 until received */
+	int* group_of;                     /**< the group of every slot, -1 once removed */
+};
+
+
+/**
+ *   @brief starts one connection per group, each with the pipelined setup of session_start(),
+ *   and stores the values of their first messages.
+ *
+ *   @param session:     the session;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param groups:      the setup of each group;
+ *   @param group_count: the number of groups;
+ *   @param variables:   the variables, each with its group: their slots follow this order;
+ *   @param count:       the number of variables;
+ *   @param timeout:     seconds to wait for the first message of each group, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to indicate the error, @c EINVAL if a group has no variables.
+ */
+
+int multirate_open(struct multirate_session* session, char* host, int port, const struct multirate_group_config* groups, int group_count,
+	const struct multirate_variable* variables, int count, double timeout);
+
+
+/**
+ *   @brief closes the connections of all the groups and releases the session.
+ *
+ *   @param session: the session.
+ */
+
+void multirate_close(struct multirate_session* session);
+
+
+/**
+ *   @brief adds a variable to a group.
+ *
+ *   @param session:       the session;
+ *   @param variable_name: name of the variable to be observed;
+ *   @param units:         units of measure of the variable, NULL for the default ones;
+ *   @param group:         index of the rate group.
+ *
+ *   @return  the slot of the variable. Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int multirate_add(struct multirate_session* session, const char* variable_name, const char* units, int group);
+
+
+/**
+ *   @brief removes a variable from its group. The slots of the other variables do not change.
+ *
+ *   @param session: the session;
+ *   @param slot:    the slot of the variable.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int multirate_remove(struct multirate_session* session, int slot);
+
+
+/**
+ *   @brief decodes the messages received on all the connections, waiting for some if there is none.
+ *
+ *   @param session: the session;
+ *   @param timeout: seconds to wait when nothing has been received, 0 not to wait, -1 to wait forever.
+ *
+ *   @return  the number of messages decoded (0 on timeout). Otherwise, -1 is returned and errno
+ *            is set to indicate the error, @c ECONNRESET if a connection was closed.
+ */
+
+int multirate_poll(struct multirate_session* session, double timeout);
+
+
+/**
+ *   @brief the latest value of a variable, whatever its group.
+ *
+ *   @param session: the session;
+ *   @param slot:    the slot of the variable;
+ *   @param updated: if not NULL, filled with the CLOCK_MONOTONIC arrival time of the value (0 if none yet).
+ *
+ *   @return  the value, NaN if none has been received yet or the slot is not valid.
+ */
+
+double multirate_latest(const struct multirate_session* session, int slot, double* updated);
+
+#endif
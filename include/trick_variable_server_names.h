@@ -0,0 +1,174 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_names.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Interned variable names with their commands encoded once.
+ *
+ * A name table stores each variable name once and hands out a compact identifier for it.
+ * Along with the name, the table keeps the complete bytes of its trick.var_add() and
+ * trick.var_remove() commands, newline included, built when the name is interned: adding
+ * and removing the same variables over and over is then a copy of cached bytes into a
+ * command writer, without scanning nor formatting the names again. The bytes of all the
+ * names live in large blocks and never move; the lookups use an open-addressing hash table.
+ */
+
+#ifndef _trick_variable_server_names_h_
+#define _trick_variable_server_names_h_
+
+#include <stddef.h>
+
+#include "trick_variable_server_command_writer.h"
+
+#define NAMES_BLOCK_SIZE (64 * 1024)
+
+
+/**
+ *   @brief an interned name and its commands: "trick.var_add(\"<name>\")\n",
+ *   "trick.var_remove(\"<name>\")\n" and the name, NUL-terminated, one after the other.
+ */
+
+struct name_entry {
+	const char* add;               /**< the var_add command */
+	const char* remove;            /**< the var_remove command */
+	const char* name;              /**< the name */
+	unsigned int add_length;
+	unsigned int remove_length;
+	unsigned int name_length;
+	unsigned int hash;
+};
+
+
+/**
+ *   @brief a block of storage for the bytes of the names.
+ */
+
+struct name_block {
+	struct name_block* next;
+	size_t used;
+	size_t size;
+	char data[];
+};
+
+
+/**
+ *   @brief the table of the interned names.
+ */
+
+struct name_table {
+	struct name_entry* entries;    /**< indexed by identifier */
+	int count;
+	int capacity;
+	int* buckets;                  /**< identifier + 1 of the name in each bucket, 0 if empty */
+	unsigned int mask;             /**< number of buckets - 1 */
+	struct name_block* blocks;     /**< the current block first */
+};
+
+
+/**
+ *   @brief initializes an empty table.
+ *
+ *   @param table:    the table;
+ *   @param capacity: the number of names expected (the table grows beyond it).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_init(struct name_table* table, int capacity);
+
+
+/**
+ *   @brief releases the table and all its names.
+ *
+ *   @param table: the table.
+ */
+
+void names_destroy(struct name_table* table);
+
+
+/**
+ *   @brief the identifier of a name, interning it and encoding its commands the first time.
+ *
+ *   @param table: the table;
+ *   @param name:  the name of the variable.
+ *
+ *   @return  the identifier, from 0 in order of interning. Otherwise, -1 is returned and
+ *            errno is set to indicate the error.
+ */
+
+int names_intern(struct name_table* table, const char* name);
+
+
+/**
+ *   @brief the identifier of a name already interned.
+ *
+ *   @param table: the table;
+ *   @param name:  the name of the variable.
+ *
+ *   @return  the identifier. Otherwise, -1 is returned and errno is set to @c ENOENT.
+ */
+
+int names_find(const struct name_table* table, const char* name);
+
+
+/**
+ *   @brief the name of an identifier.
+ *
+ *   @param table: the table;
+ *   @param id:    the identifier.
+ *
+ *   @return  the name, NULL if the identifier is not valid.
+ */
+
+const char* names_name(const struct name_table* table, int id);
+
+
+/**
+ *   @brief appends the cached trick.var_add() command of a name to a writer.
+ *
+ *   @param table:  the table;
+ *   @param writer: the command writer;
+ *   @param id:     the identifier.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_write_add(const struct name_table* table, struct command_writer* writer, int id);
+
+
+/**
+ *   @brief appends the cached trick.var_remove() command of a name to a writer.
+ *
+ *   @param table:  the table;
+ *   @param writer: the command writer;
+ *   @param id:     the identifier.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_write_remove(const struct name_table* table, struct command_writer* writer, int id);
+
+#endif
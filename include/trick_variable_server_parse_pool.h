@@ -0,0 +1,247 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_parse_pool.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Work-stealing pool of threads decoding the binary messages of many connections.
+ *
+ * The receive thread of each connection submits its frames to the pool, which copies them
+ * into a ring of slots of the connection and queues one task per frame on the queue of the
+ * home worker of the connection. A worker that finds its own queue empty steals tasks from
+ * the queues of the others, so the frames of the busiest connections are decoded on every
+ * core, several of them at the same time. The results are collected per connection in
+ * submission order: a result is handed out only when all the frames submitted before it on
+ * the same connection have been collected.
+ *
+ * Each connection has one decode plan, compiled by the first worker that meets its layout and
+ * shared by all the others. A plan replaced after a change of layout is freed once every
+ * worker that might still be decoding with it has finished its frame: each worker publishes
+ * the epoch of the pool in which it started its current frame, and a plan retired in an
+ * epoch is freed when no worker is still in that epoch or an earlier one. The queues are bounded multi-producer multi-consumer arrays; an
+ * idle worker spins for a while, then sleeps until a frame is queued for it.
+ */
+
+#ifndef _trick_variable_server_parse_pool_h_
+#define _trick_variable_server_parse_pool_h_
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "trick_variable_server_decoder.h"
+
+#define PARSE_POOL_CACHE_LINE 64
+
+
+/**
+ *   @brief the state of a slot of a connection.
+ */
+
+enum parse_slot_state {
+	PARSE_SLOT_FREE = 0,         /**< available to the receive thread */
+	PARSE_SLOT_QUEUED,           /**< holds a frame waiting for a worker */
+	PARSE_SLOT_DONE              /**< holds a result waiting to be collected */
+};
+
+
+/**
+ *   @brief a frame of a connection and, once decoded, its result.
+ */
+
+struct parse_slot {
+	atomic_int state;            /**< one of enum parse_slot_state */
+	int status;                  /**< 1 decoded, 0 skipped (not a variable message), -1 not valid */
+	int count;                   /**< values decoded */
+	int worker;                  /**< index of the worker that decoded the frame */
+	unsigned long sequence;      /**< position of the frame in the connection */
+	unsigned int length;         /**< length of the frame */
+	unsigned char* data;         /**< copy of the frame */
+	double* values;              /**< the values decoded */
+};
+
+
+/**
+ *   @brief a decode plan shared by the workers.
+ */
+
+struct parse_plan {
+	struct decode_plan plan;
+	struct parse_plan* next;     /**< next plan waiting to be freed */
+	unsigned long retired;       /**< epoch of the pool in which the plan was replaced */
+};
+
+
+/**
+ *   @brief the ring of slots of a connection.
+ */
+
+struct parse_connection {
+	struct parse_slot* slots;
+	_Atomic(struct parse_plan*) plan;
+	_Alignas(PARSE_POOL_CACHE_LINE) unsigned long tail;   /**< next frame to submit, owned by the receive thread */
+	unsigned long submitted;
+	_Alignas(PARSE_POOL_CACHE_LINE) unsigned long head;   /**< next result to collect, owned by the collecting thread */
+	unsigned long collected;
+};
+
+
+/**
+ *   @brief an entry of a task queue: the slot it refers to and the lap in which it is valid.
+ */
+
+struct parse_cell {
+	atomic_size_t sequence;
+	unsigned int task;           /**< connection * depth + slot */
+};
+
+
+/**
+ *   @brief a worker thread and its task queue.
+ */
+
+struct parse_worker {
+	struct parse_pool* pool;
+	int index;
+	pthread_t thread;
+	struct parse_cell* cells;
+	size_t mask;
+	_Alignas(PARSE_POOL_CACHE_LINE) atomic_size_t enqueue_position;
+	_Alignas(PARSE_POOL_CACHE_LINE) atomic_size_t dequeue_position;
+	_Alignas(PARSE_POOL_CACHE_LINE) atomic_long queued;   /**< tasks in the queue */
+	atomic_int sleeping;
+	atomic_ulong epoch;          /**< epoch of the pool when the current frame was started, 0 between frames */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	unsigned long parsed;        /**< frames decoded by the worker */
+	unsigned long stolen;        /**< frames taken from the queues of the other workers */
+};
+
+
+/**
+ *   @brief the pool.
+ */
+
+struct parse_pool {
+	int workers;
+	int connections;
+	int depth;                   /**< slots per connection */
+	unsigned int max_frame;      /**< largest frame accepted */
+	int max_variables;           /**< values per result */
+	int names;                   /**< 1 if the messages carry the variable names */
+	int steal;                   /**< 1 if the idle workers steal, 0 to keep each connection on its home worker */
+	struct parse_connection* connection;
+	struct parse_worker* worker;
+	unsigned char* storage;
+	atomic_long queued;          /**< tasks in all the queues */
+	atomic_int stopping;
+	atomic_ulong epoch;          /**< advanced every time a plan is replaced */
+	pthread_mutex_t retired_lock;
+	struct parse_plan* retired;  /**< replaced plans that a worker may still be using */
+};
+
+
+/**
+ *   @brief a result, in submission order.
+ */
+
+struct parse_result {
+	int connection;              /**< index of the connection */
+	unsigned long sequence;      /**< position of the frame in the connection, from 0 */
+	int status;                  /**< 1 decoded, 0 skipped (not a variable message), -1 not valid */
+	int count;                   /**< values decoded */
+	const double* values;        /**< the values, valid until parse_pool_release() */
+	const unsigned char* data;   /**< the frame, valid until parse_pool_release() */
+	unsigned int length;         /**< length of the frame */
+	int worker;                  /**< index of the worker that decoded the frame */
+};
+
+
+/**
+ *   @brief allocates the slots and the queues and starts the workers.
+ *
+ *   @param pool:          the pool;
+ *   @param workers:       the number of worker threads;
+ *   @param connections:   the number of connections;
+ *   @param depth:         the number of frames in flight per connection;
+ *   @param max_frame:     the largest frame accepted, in bytes;
+ *   @param max_variables: the largest number of variables of a frame;
+ *   @param names:         1 if the messages carry the variable names (set_binary()), 0 otherwise;
+ *   @param steal:         1 to let the idle workers steal, 0 to decode every connection on its home worker.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int parse_pool_init(struct parse_pool* pool, int workers, int connections, int depth, unsigned int max_frame, int max_variables, int names, int steal);
+
+
+/**
+ *   @brief stops the workers, dropping the frames not yet decoded, and releases the pool.
+ *
+ *   @param pool: the pool.
+ */
+
+void parse_pool_destroy(struct parse_pool* pool);
+
+
+/**
+ *   @brief copies a frame into the next slot of a connection and queues it. Only one thread
+ *   at a time may submit on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection;
+ *   @param frame:      the frame, e.g. from receiver_next_frame();
+ *   @param length:     the length of the frame.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to @c EAGAIN if all the slots of the connection are in use (collect
+ *            first), @c EMSGSIZE if the frame is too large, @c EINVAL if the connection is not valid.
+ */
+
+int parse_pool_submit(struct parse_pool* pool, int connection, const void* frame, unsigned int length);
+
+
+/**
+ *   @brief the next result of a connection, in submission order. Only one thread at a time
+ *   may collect on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection;
+ *   @param result:     filled with the result.
+ *
+ *   @return  1 if the next result is ready, 0 if its frame has not been decoded yet.
+ */
+
+int parse_pool_collect(struct parse_pool* pool, int connection, struct parse_result* result);
+
+
+/**
+ *   @brief frees the slot of the result returned by the last parse_pool_collect() on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection.
+ */
+
+void parse_pool_release(struct parse_pool* pool, int connection);
+
+#endif
@@ -0,0 +1,148 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_rate_control.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Adaptive control of the Trick Variable Server update period.
+ *
+ * The controller is fed once per processed frame with the client backlog and the processing
+ * time; it also samples the bytes waiting in the socket receive buffer (SIOCINQ), once per
+ * adjustment interval rather than on every frame. When the client falls behind, the period is
+ * raised through set_cycle(); when it keeps up again, the period is lowered back, always within
+ * the user bounds and with hysteresis. The changes are counted in METRIC_CYCLE_CHANGES when
+ * counters are attached.
+ */
+
+#ifndef _trick_variable_server_rate_control_h_
+#define _trick_variable_server_rate_control_h_
+
+#define RATE_CONTROLLER_LOG_SIZE 32
+
+struct connection_metrics;
+
+/**
+ *   @brief why the period was changed.
+ */
+
+enum rate_controller_reason {
+	RATE_CONTROLLER_SOCKET_BUFFER = 1,  /**< too many bytes waiting in the socket receive buffer */
+	RATE_CONTROLLER_BACKLOG = 2,        /**< too many frames waiting in the client queue */
+	RATE_CONTROLLER_PROCESSING = 4,     /**< processing takes too large a share of the period */
+	RATE_CONTROLLER_RECOVERY = 8        /**< the client has kept up long enough to speed up again */
+};
+
+
+/**
+ *   @brief a logged period change.
+ */
+
+struct rate_controller_adjustment {
+	double host_time;              /**< CLOCK_MONOTONIC time of the change, in seconds */
+	double old_period;
+	double new_period;
+	int reasons;                   /**< OR of rate_controller_reason values */
+	unsigned int socket_queued;    /**< bytes in the socket receive buffer */
+	unsigned int backlog;          /**< frames in the client queue */
+	double processing_time;        /**< seconds spent on the last frame */
+};
+
+
+/**
+ *   @brief state and tuning of the rate controller.
+ */
+
+struct rate_controller {
+	int socket;
+	double min_period;                  /**< fastest period the controller may set */
+	double max_period;                  /**< slowest period the controller may set */
+	double period;                      /**< period currently requested to the server */
+
+	double backoff_factor;              /**< period multiplier when falling behind (> 1) */
+	double recovery_factor;             /**< period multiplier when keeping up (< 1) */
+	unsigned int high_water_bytes;      /**< socket buffer occupancy considered as pressure */
+	unsigned int low_water_bytes;       /**< socket buffer occupancy considered as relief */
+	unsigned int high_backlog;          /**< client backlog considered as pressure */
+	unsigned int low_backlog;           /**< client backlog considered as relief */
+	double high_busy_fraction;          /**< processing time / period considered as pressure */
+	double low_busy_fraction;           /**< processing time / period considered as relief */
+	int raise_after;                    /**< consecutive pressured observations (samples, for the socket buffer) before backing off */
+	int lower_after;                    /**< consecutive relieved observations before speeding up */
+	double hold_time;                   /**< minimum seconds between two adjustments, and between two samples of the socket buffer */
+	struct connection_metrics* metrics; /**< counters to update, NULL if none */
+
+	int pressure_count;
+	int relief_count;
+	double last_adjustment_time;
+	double last_sample_time;            /**< time of the last SIOCINQ */
+	unsigned int socket_queued;         /**< bytes in the socket receive buffer at the last sample */
+
+	unsigned long observations;         /**< calls to rate_controller_observe() */
+	unsigned long increases;            /**< times the period was raised */
+	unsigned long decreases;            /**< times the period was lowered */
+	unsigned long failures;             /**< set_cycle() or SIOCINQ failures */
+	unsigned long adjustments;          /**< total entries written to the log */
+	struct rate_controller_adjustment log[RATE_CONTROLLER_LOG_SIZE]; /**< the last adjustments, indexed by adjustments % RATE_CONTROLLER_LOG_SIZE */
+};
+
+
+/**
+ *   @brief initializes the controller with default tuning and sets the initial period.
+ *
+ *   @param controller: the controller;
+ *   @param socket:     socket file descriptor;
+ *   @param period:     the initial period;
+ *   @param min_period: the fastest period the controller may set;
+ *   @param max_period: the slowest period the controller may set.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int rate_controller_init(struct rate_controller* controller, int socket, double period, double min_period, double max_period);
+
+
+/**
+ *   @brief feeds an observation to the controller and adjusts the period if needed.
+ *
+ *   @param controller:      the controller;
+ *   @param backlog:         frames received but not yet processed by the client;
+ *   @param processing_time: seconds spent processing the last frame.
+ *
+ *   @return  1 if the period was changed, 0 if not. If set_cycle() fails, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int rate_controller_observe(struct rate_controller* controller, unsigned int backlog, double processing_time);
+
+
+/**
+ *   @brief gives access to a logged adjustment.
+ *
+ *   @param controller: the controller;
+ *   @param age:        0 for the most recent adjustment, 1 for the previous one, ...
+ *
+ *   @return  the adjustment, or NULL if it is not (or no longer) in the log.
+ */
+
+const struct rate_controller_adjustment* rate_controller_adjustment(const struct rate_controller* controller, unsigned int age);
+
+#endif
@@ -0,0 +1,109 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_realtime.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Real-time profile for the receiving thread.
+ *
+ * realtime_apply() prepares the calling thread for hard real-time reception: it locks the
+ * memory of the process, prefaults the stack, pins the thread to a CPU, switches it to
+ * SCHED_FIFO and reduces its timer slack. realtime_prepare_receiver() then sizes and touches
+ * the receive buffer so that neither a page fault nor an allocation happens while receiving.
+ *
+ * After the setup, the receive path (receiver_read(), receiver_next_frame(), receiver_wait_for_frame(),
+ * subscription_decode() with an already compiled plan, the metrics and, once the thread has
+ * called trace_thread_name(), the tracer) does not allocate. Changing the subscription set, a
+ * frame larger than the buffer, and command_queue_submit() do allocate: from the real-time
+ * thread, send commands with the command writer.
+ *
+ * To check it, build the library with -DTRICK_VS_MALLOC_GUARD: malloc(), calloc(), realloc() and
+ * the aligned allocations (aligned_alloc(), posix_memalign(), memalign(), valloc(), pvalloc()) are
+ * then wrapped, and while realtime_guard_allocations() is enabled on a thread, every
+ * allocation made by that thread fails with ENOMEM and is counted as a violation.
+ */
+
+#ifndef _trick_variable_server_realtime_h_
+#define _trick_variable_server_realtime_h_
+
+#include <stddef.h>
+
+#include "trick_variable_server_receiver.h"
+
+
+/**
+ *   @brief the real-time setup of a thread.
+ */
+
+struct realtime_profile {
+	int cpu;                        /**< CPU to pin the thread to, -1 to keep the affinity */
+	int priority;                   /**< SCHED_FIFO priority (1-99), 0 to keep the scheduling policy */
+	int lock_memory;                /**< 1 to lock the current and future pages of the process with mlockall() */
+	size_t stack_size;              /**< bytes of stack to prefault, 0 for none */
+	unsigned long timer_slack;      /**< timer slack of the thread in nanoseconds, 0 to keep it */
+};
+
+
+/**
+ *   @brief applies a real-time profile to the calling thread. Every step is attempted
+ *   even if a previous one failed (e.g. for lack of privileges).
+ *
+ *   @param profile: the profile.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error of the first step that failed.
+ */
+
+int realtime_apply(const struct realtime_profile* profile);
+
+
+/**
+ *   @brief grows the receive buffer to the given capacity and touches all its pages.
+ *
+ *   @param receiver: the receiver;
+ *   @param capacity: the size of the buffer, at least the largest backlog expected.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int realtime_prepare_receiver(struct frame_receiver* receiver, size_t capacity);
+
+
+/**
+ *   @brief makes every allocation of the calling thread fail while enabled. Effective only
+ *   when the library is built with -DTRICK_VS_MALLOC_GUARD.
+ *
+ *   @param enabled: 1 to forbid the allocations, 0 to allow them again.
+ */
+
+void realtime_guard_allocations(int enabled);
+
+
+/**
+ *   @brief the number of allocations attempted by guarded threads.
+ *
+ *   @return  the number of violations since the start of the process.
+ */
+
+unsigned long realtime_allocation_violations();
+
+#endif
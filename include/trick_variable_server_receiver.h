@@ -0,0 +1,216 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_receiver.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Reception of whole frames from the Trick Variable Server.
+ *
+ * The receiver accumulates the bytes read from the socket and splits them into frames:
+ * newline-terminated lines in ASCII mode (set_ascii()), size-prefixed messages in binary
+ * mode (set_binary(), set_binary_no_names()). Bytes of an incomplete frame are carried over
+ * to the next read. Optionally the kernel receive timestamps (SO_TIMESTAMPNS, SO_TIMESTAMPING)
+ * are collected with recvmsg() and attached to the frames completed by each read.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation of the message formats.
+ */
+
+#ifndef _trick_variable_server_receiver_h_
+#define _trick_variable_server_receiver_h_
+
+#include <stddef.h>
+#include <time.h>
+
+#include "trick_variable_server_metrics.h"
+
+#define RECEIVER_READ_MARKS 16
+
+/** size of the binary message header: message indicator, message size, number of variables */
+#define RECEIVER_BINARY_HEADER_SIZE 12
+
+/**
+ *   @brief the format in which the Trick Variable Server sends the data.
+ */
+
+enum receiver_format {
+	RECEIVER_ASCII = 0,    /**< set_ascii(): one newline-terminated line per message */
+	RECEIVER_BINARY = 1    /**< set_binary(), set_binary_no_names(): size-prefixed messages */
+};
+
+
+/**
+ *   @brief the kernel timestamping modes.
+ */
+
+enum receiver_timestamping {
+	RECEIVER_TIMESTAMP_NONE = 0,     /**< no kernel timestamps, plain recv() */
+	RECEIVER_TIMESTAMP_NS = 1,       /**< SO_TIMESTAMPNS: software receive timestamp */
+	RECEIVER_TIMESTAMP_KERNEL = 2    /**< SO_TIMESTAMPING: hardware receive timestamp when the NIC provides one, software otherwise */
+};
+
+
+/**
+ *   @brief a complete frame. The data points into the receiver buffer and is valid until the next read.
+ */
+
+struct receiver_frame {
+	const unsigned char* data;    /**< the whole message; in ASCII mode the newline is replaced by a NUL */
+	unsigned int length;          /**< length of the message in bytes (without the newline in ASCII mode) */
+	int message_type;             /**< the message indicator (0 for variable values) */
+	struct timespec kernel_time;  /**< CLOCK_REALTIME kernel arrival time of the read that completed the frame, zero if not available */
+	struct timespec user_time;    /**< CLOCK_REALTIME time at which the frame was handed to the caller */
+};
+
+
+/**
+ *   @brief kernel timestamp of a read and the buffer offset at which its bytes end.
+ */
+
+struct receiver_read_mark {
+	size_t end;
+	struct timespec kernel_time;
+};
+
+
+/**
+ *   @brief the frame receiver of a connection.
+ */
+
+struct frame_receiver {
+	int socket;
+	int format;
+	int timestamping;
+	unsigned char* buffer;
+	size_t capacity;
+	size_t start;                 /**< offset of the first byte not yet returned as a frame */
+	size_t end;                   /**< offset after the last byte received */
+	size_t scanned;               /**< ASCII mode: offset up to which no newline was found */
+	struct receiver_read_mark marks[RECEIVER_READ_MARKS];
+	int mark_count;
+	struct connection_metrics* metrics;  /**< counters to update, NULL if none */
+	unsigned long superseded;     /**< frames skipped by receiver_wait_for_frame() because a newer one was available */
+};
+
+
+/**
+ *   @brief callback receiving the frames.
+ */
+
+typedef void (*receiver_handler)(void* context, const struct receiver_frame* frame);
+
+
+/**
+ *   @brief initializes a receiver for the given socket.
+ *
+ *   @param receiver: the receiver;
+ *   @param socket:   socket file descriptor;
+ *   @param format:   @c RECEIVER_ASCII or @c RECEIVER_BINARY, as requested to the server;
+ *   @param capacity: initial size of the receive buffer in bytes; the buffer grows if a frame does not fit.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int receiver_init(struct frame_receiver* receiver, int socket, int format, size_t capacity);
+
+
+/**
+ *   @brief releases the receive buffer.
+ *
+ *   @param receiver: the receiver.
+ */
+
+void receiver_destroy(struct frame_receiver* receiver);
+
+
+/**
+ *   @brief enables the kernel receive timestamps on the socket.
+ *
+ *   @param receiver: the receiver;
+ *   @param mode:     one of the receiver_timestamping values.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int receiver_enable_timestamps(struct frame_receiver* receiver, int mode);
+
+
+/**
+ *   @brief performs one read from the socket into the receive buffer.
+ *
+ *   @param receiver: the receiver;
+ *   @param flags:    the flags of recv() (e.g. @c MSG_DONTWAIT).
+ *
+ *   @return  the number of bytes received, 0 if the peer has performed an orderly shutdown,
+ *            -1 if an error occurred (errno is set to indicate the error).
+ */
+
+int receiver_read(struct frame_receiver* receiver, int flags);
+
+
+/**
+ *   @brief extracts the next complete frame from the receive buffer, without reading the socket.
+ *
+ *   @param receiver: the receiver;
+ *   @param frame:    filled with the frame.
+ *
+ *   @return  1 if a frame was extracted, 0 if no complete frame is buffered,
+ *            -1 if the data is not a valid message (errno is set to @c EPROTO).
+ */
+
+int receiver_next_frame(struct frame_receiver* receiver, struct receiver_frame* frame);
+
+
+/**
+ *   @brief performs one read and hands every frame it completes to the handler.
+ *
+ *   @param receiver: the receiver;
+ *   @param handler:  the callback receiving the frames;
+ *   @param context:  passed to the handler;
+ *   @param flags:    the flags of recv() (e.g. @c MSG_DONTWAIT).
+ *
+ *   @return  the number of bytes received, 0 if the peer has performed an orderly shutdown,
+ *            -1 if an error occurred (errno is set to indicate the error).
+ */
+
+int receiver_dispatch(struct frame_receiver* receiver, receiver_handler handler, void* context, int flags);
+
+
+/**
+ *   @brief waits until a complete frame is available or an absolute deadline expires, and
+ *   returns the latest frame received, skipping the older ones.
+ *
+ *   The socket is first polled without blocking for at most spin_budget nanoseconds, then
+ *   the thread sleeps in ppoll() until data arrives or the deadline expires.
+ *
+ *   @param receiver:    the receiver;
+ *   @param deadline:    absolute CLOCK_MONOTONIC time at which to give up, NULL to wait without limit;
+ *   @param spin_budget: nanoseconds of busy polling before sleeping, 0 to sleep at once;
+ *   @param frame:       filled with the latest frame; it is valid until the next read.
+ *
+ *   @return  1 if a frame was returned, 0 if the deadline expired, -1 if an error occurred
+ *            (errno is set to indicate the error, @c ECONNRESET if the peer closed the connection).
+ */
+
+int receiver_wait_for_frame(struct frame_receiver* receiver, const struct timespec* deadline, long spin_budget, struct receiver_frame* frame);
+
+#endif
@@ -0,0 +1,264 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_schema.hpp
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Compile-time subscription schemas for C++ (C++20).
+ *
+ * A schema declares, as constant data, the variables of a fixed telemetry layout: for each
+ * one its name, its units and the member of a user structure receiving its value, whose C++
+ * type gives the type of the variable. From the declaration the compiler generates:
+ *   - the text of the whole subscription (trick.var_pause(), trick.var_binary_nonames(), one
+ *     trick.var_add() per variable, trick.var_unpause()), sent in one write by subscribe()
+ *     with send_command_to_variable_server();
+ *   - the offsets of every value in the binary messages, and a parser that copies each value
+ *     into its member at a constant offset, fully unrolled, without looking at the type codes.
+ *
+ * @code
+ * struct ball { double x; double y; int mode; };
+ * using ball_schema = trick_vs::schema<ball,
+ *     trick_vs::field<"ball.obj.state.output.position[0]", &ball::x, "m">,
+ *     trick_vs::field<"ball.obj.state.output.position[1]", &ball::y, "m">,
+ *     trick_vs::field<"ball.obj.mode", &ball::mode>>;
+ *
+ * ball_schema::subscribe(socket);
+ * ...
+ * ball state;
+ * if (ball_schema::parse(frame.data, frame.length, state)) ...
+ * @endcode
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_schema_hpp_
+#define _trick_variable_server_schema_hpp_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "trick_variable_server_connection.h"
+#include "trick_variable_server_decoder.h"
+}
+
+namespace trick_vs {
+
+
+/**
+ *   @brief a string usable as a template argument.
+ */
+
+template <std::size_t N>
+struct fixed_string {
+	char value[N] {};
+
+	constexpr fixed_string(const char (&text)[N]) {
+		for (std::size_t i = 0; i < N; i++) value[i] = text[i];
+	}
+
+	static constexpr std::size_t length = N - 1;
+};
+
+
+/**
+ *   @brief the Trick type codes accepted for a C++ type, which must have the size of the values.
+ */
+
+template <typename T>
+constexpr bool accepts(int type) {
+	if constexpr (std::is_same_v<T, double>) return type == TRICK_TYPE_DOUBLE;
+	else if constexpr (std::is_same_v<T, float>) return type == TRICK_TYPE_FLOAT;
+	else if constexpr (std::is_same_v<T, bool>) return type == TRICK_TYPE_BOOLEAN;
+	else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+		return type == TRICK_TYPE_CHARACTER || type == TRICK_TYPE_SHORT || type == TRICK_TYPE_INTEGER || type == TRICK_TYPE_LONG
+			|| type == TRICK_TYPE_LONG_LONG || type == TRICK_TYPE_ENUMERATED || type == TRICK_TYPE_BITFIELD;
+	else if constexpr (std::is_integral_v<T> && std::is_unsigned_v<T>)
+		return type == TRICK_TYPE_UNSIGNED_CHARACTER || type == TRICK_TYPE_UNSIGNED_SHORT || type == TRICK_TYPE_UNSIGNED_INTEGER
+			|| type == TRICK_TYPE_UNSIGNED_LONG || type == TRICK_TYPE_UNSIGNED_LONG_LONG || type == TRICK_TYPE_UNSIGNED_BITFIELD
+			|| type == TRICK_TYPE_WCHAR;
+	else static_assert(std::is_arithmetic_v<T>, "a schema field must be of arithmetic type");
+}
+
+
+template <typename M>
+struct member_traits;
+
+template <typename C, typename T>
+struct member_traits<T C::*> {
+	using owner = C;
+	using type = T;
+};
+
+
+/**
+ *   @brief a variable of a schema: its name, the member receiving its value and its units ("" for the default ones).
+ */
+
+template <fixed_string Name, auto Member, fixed_string Units = "">
+struct field {
+	using owner = typename member_traits<decltype(Member)>::owner;
+	using type = typename member_traits<decltype(Member)>::type;
+
+	static constexpr auto name = Name;
+	static constexpr auto units = Units;
+	static constexpr auto member = Member;
+	static constexpr std::size_t size = sizeof(type);
+
+	/* trick.var_add("<name>"[, "<units>"])\n */
+	static constexpr std::size_t command_length = 16 + Name.length + (Units.length > 0 ? 4 + Units.length : 0) + 2 + 1;
+};
+
+
+/**
+ *   @brief a subscription schema: the state structure and its fields, in the order of the subscription.
+ */
+
+template <typename State, typename... Fields>
+struct schema {
+	static_assert(sizeof...(Fields) > 0, "a schema needs at least one field");
+	static_assert((std::is_same_v<typename Fields::owner, State> && ...), "every field must be a member of the state structure");
+
+	static constexpr int count = sizeof...(Fields);
+
+	/** the length of every binary message (set_binary_no_names()) of the schema */
+	static constexpr unsigned int frame_length = 12 + (0 + ... + (8 + static_cast<unsigned int>(Fields::size)));
+
+	/** the offset of the type field of every variable in the messages */
+	static constexpr std::array<unsigned int, sizeof...(Fields)> offsets = [] {
+		std::array<unsigned int, sizeof...(Fields)> result {};
+		std::size_t sizes[] = { Fields::size... };
+		unsigned int offset = 12;
+		for (std::size_t i = 0; i < sizeof...(Fields); i++) {
+			result[i] = offset;
+			offset += 8 + static_cast<unsigned int>(sizes[i]);
+		}
+		return result;
+	}();
+
+private:
+	static constexpr char prologue[] = "trick.var_pause()\ntrick.var_binary_nonames()\n";
+	static constexpr char epilogue[] = "trick.var_unpause()";
+
+	template <std::size_t N>
+	static constexpr std::size_t append(char* out, std::size_t at, const char (&text)[N]) {
+		for (std::size_t i = 0; i + 1 < N; i++) out[at++] = text[i];
+		return at;
+	}
+
+	template <typename F>
+	static constexpr std::size_t append_add(char* out, std::size_t at) {
+		at = append(out, at, "trick.var_add(\"");
+		for (std::size_t i = 0; i < F::name.length; i++) out[at++] = F::name.value[i];
+		if constexpr (F::units.length > 0) {
+			at = append(out, at, "\", \"");
+			for (std::size_t i = 0; i < F::units.length; i++) out[at++] = F::units.value[i];
+		}
+		return append(out, at, "\")\n");
+	}
+
+	static constexpr std::size_t commands_length = sizeof(prologue) - 1 + (0 + ... + (Fields::command_length - 1)) + sizeof(epilogue) - 1;
+
+public:
+	/** the text of the whole subscription, one command per line, null-terminated */
+	static constexpr std::array<char, commands_length + 1> commands = [] {
+		std::array<char, commands_length + 1> result {};
+		std::size_t at = append(result.data(), 0, prologue);
+		((at = append_add<Fields>(result.data(), at)), ...);
+		append(result.data(), at, epilogue);
+		return result;
+	}();
+
+	/**
+	 *   @brief sends the whole subscription in one write.
+	 *
+	 *   @param socket: socket file descriptor.
+	 *
+	 *   @return  Upon successful completion, the function returns 0.
+	 *            Otherwise, -1 is returned and errno is set to indicate the error.
+	 */
+
+	static int subscribe(int socket) {
+		/* the last newline is added by send_command_to_variable_server(), which does not modify the text */
+		return send_command_to_variable_server(socket, const_cast<char*>(commands.data()));
+	}
+
+	/**
+	 *   @brief checks the type codes and sizes of a message against the schema; run it on the
+	 *   first message, parse() does not look at them.
+	 *
+	 *   @param frame:  the message;
+	 *   @param length: the length of the message.
+	 *
+	 *   @return  true if the message has the layout of the schema.
+	 */
+
+	static bool validate(const unsigned char* frame, unsigned int length) {
+		return length == frame_length && load(frame) == 0 && load(frame + 8) == static_cast<std::uint32_t>(count)
+			&& validate_fields(frame, std::index_sequence_for<Fields...> {});
+	}
+
+	/**
+	 *   @brief copies the values of a message into the state structure.
+	 *
+	 *   @param frame:  the message;
+	 *   @param length: the length of the message;
+	 *   @param state:  the structure receiving the values.
+	 *
+	 *   @return  true if the message was parsed, false if it is not a variable message of the schema length.
+	 */
+
+	static bool parse(const unsigned char* frame, unsigned int length, State& state) {
+		if (length != frame_length || load(frame) != 0 || load(frame + 8) != static_cast<std::uint32_t>(count)) {
+			return false;
+		}
+		parse_fields(frame, state, std::index_sequence_for<Fields...> {});
+		return true;
+	}
+
+private:
+	static std::uint32_t load(const unsigned char* data) {
+		std::uint32_t value;
+
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	template <std::size_t... I>
+	static bool validate_fields(const unsigned char* frame, std::index_sequence<I...>) {
+		return ((accepts<typename Fields::type>(static_cast<int>(load(frame + offsets[I])))
+			&& load(frame + offsets[I] + 4) == Fields::size) && ...);
+	}
+
+	template <std::size_t... I>
+	static void parse_fields(const unsigned char* frame, State& state, std::index_sequence<I...>) {
+		(std::memcpy(&(state.*Fields::member), frame + offsets[I] + 8, Fields::size), ...);
+	}
+};
+
+}
+
+#endif
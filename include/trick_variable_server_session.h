@@ -0,0 +1,122 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_session.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Pipelined start of a session with the Trick Variable Server.
+ *
+ * The whole setup of a session is described by a struct session_config. session_start()
+ * connects and sends it as a single write: trick.var_pause(), the client tag, the message
+ * format, the copy mode, the cycle, every trick.var_add() and trick.var_unpause(). Since
+ * the server is paused while the set is built, the first variable message it sends carries
+ * the whole set; session_start() returns when it arrives and reports the time to first data.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_session_h_
+#define _trick_variable_server_session_h_
+
+#include <stddef.h>
+
+#include "trick_variable_server_receiver.h"
+
+#define SESSION_RECEIVE_BUFFER (64 * 1024)
+
+
+/**
+ *   @brief the message formats of a session.
+ */
+
+enum session_format {
+	SESSION_ASCII = 0,                 /**< trick.var_ascii() */
+	SESSION_BINARY,                    /**< trick.var_binary() */
+	SESSION_BINARY_NO_NAMES            /**< trick.var_binary_nonames() */
+};
+
+
+/**
+ *   @brief the setup of a session.
+ */
+
+struct session_config {
+	const char* client_tag;            /**< NULL to leave the tag unset */
+	int format;                        /**< one of enum session_format */
+	double cycle;                      /**< period of the updates in seconds, 0 to keep the default of the server */
+	int copy_mode;                     /**< argument of trick.var_set_copy_mode(), -1 to keep the default */
+	char** variables;                  /**< the names of the variables */
+	char** units;                      /**< NULL, or the units of each variable (NULL entries for the default units) */
+	int count;                         /**< the number of variables */
+	double timeout;                    /**< seconds to wait for the first message, 0 to wait forever */
+	size_t receive_buffer;             /**< initial size of the receive buffer, 0 for SESSION_RECEIVE_BUFFER */
+};
+
+
+/**
+ *   @brief wall-clock duration of the phases of the start, in seconds.
+ */
+
+struct session_timing {
+	double connect;                    /**< socket creation and connection */
+	double write;                      /**< writing the pipelined setup */
+	double first_data;                 /**< from the end of the write to the first message of the set */
+	double total;                      /**< time to first data, from the start of the connection */
+};
+
+
+/**
+ *   @brief a started session.
+ */
+
+struct session {
+	int socket;
+	struct frame_receiver receiver;    /**< receiver of the session, holding the first message */
+	struct receiver_frame first_frame; /**< the first message of the variable set */
+	struct session_timing timing;
+};
+
+
+/**
+ *   @brief connects, sends the whole setup in one write and waits for the first message
+ *   carrying the requested variable set.
+ *
+ *   @param session: filled with the connection, its receiver and the first message;
+ *   @param host:    host IPv4 address of the Trick Variable Server;
+ *   @param port:    service port number;
+ *   @param config:  the setup of the session.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ETIMEDOUT if no message arrived in time.
+ */
+
+int session_start(struct session* session, char* host, int port, const struct session_config* config);
+
+
+/**
+ *   @brief leaves the session with trick.var_exit() and releases it.
+ *
+ *   @param session: the session.
+ */
+
+void session_close(struct session* session);
+
+#endif
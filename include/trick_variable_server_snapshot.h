@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_snapshot.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Capture of the values of a large set of variables in one shot.
+ *
+ * The variable list is split into chunks, one per connection. On every connection, in its
+ * own thread, a single write pipelines trick.var_pause(), trick.var_ascii(), the trick.var_add()
+ * of the whole chunk and trick.var_send(); the reply is read and split, then the connection is
+ * left with trick.var_exit(). The values are returned as text, as sent by the server.
+ * The replies can be awaited until a deadline: the chunks that miss it fail on their own.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+#ifndef _trick_variable_server_snapshot_h_
+#define _trick_variable_server_snapshot_h_
+
+/**
+ *   @brief wall-clock duration of the phases of a snapshot, in seconds.
+ *   Each phase is the longest among the connections.
+ */
+
+struct snapshot_timing {
+	double connect;     /**< socket creation and connection */
+	double subscribe;   /**< writing the pipelined commands */
+	double receive;     /**< waiting for and reading the reply */
+	double release;     /**< leaving the connection */
+	double total;       /**< the whole capture */
+};
+
+
+/**
+ *   @brief a captured snapshot.
+ */
+
+struct snapshot {
+	int count;                  /**< number of variables */
+	char** values;              /**< the value of each variable, in the order of the request */
+	int chunks;
+	char** texts;               /**< the replies the values point into */
+	int* errors;                /**< the error of each chunk (e.g. @c ETIMEDOUT), 0 if it was captured */
+	struct snapshot_timing timing;
+};
+
+
+/**
+ *   @brief captures the values of the given variables over several parallel connections,
+ *   waiting for the replies without limit.
+ *
+ *   @param snapshot:    filled with the values, the error of each chunk and the timing;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param variables:   the names of the variables;
+ *   @param count:       the number of variables;
+ *   @param connections: the number of parallel connections.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error; the chunks
+ *            captured are kept and the snapshot must be released with snapshot_destroy().
+ */
+
+int snapshot_capture(struct snapshot* snapshot, char* host, int port, char** variables, int count, int connections);
+
+
+/**
+ *   @brief captures the values of the given variables over several parallel connections,
+ *   waiting for all the replies until one deadline.
+ *
+ *   @param snapshot:    filled with the values, the error of each chunk and the timing;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param variables:   the names of the variables;
+ *   @param count:       the number of variables;
+ *   @param connections: the number of parallel connections;
+ *   @param timeout:     seconds from the call within which the replies must arrive, 0 for no limit.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to the error of the first chunk that
+ *            failed (@c ETIMEDOUT if its reply missed the deadline); the values of the failed
+ *            chunks are NULL, the others are kept, and the snapshot must be released with
+ *            snapshot_destroy().
+ */
+
+int snapshot_capture_timeout(struct snapshot* snapshot, char* host, int port, char** variables, int count, int connections, double timeout);
+
+
+/**
+ *   @brief releases the values of a snapshot.
+ *
+ *   @param snapshot: the snapshot.
+ */
+
+void snapshot_destroy(struct snapshot* snapshot);
+
+#endif
@@ -0,0 +1,96 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_trace.h
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Tracing of the receive, parse and dispatch stages in the Chrome trace-event format.
+ *
+ * The stages of the library are marked with TRACE_BEGIN() and TRACE_END(). When the library
+ * is compiled with -DTRICK_VS_TRACE, every mark records a timestamped event into a ring
+ * buffer owned by the calling thread, without locks; otherwise the marks expand to nothing.
+ * The ring of a thread that exits is recycled by the next thread that starts recording.
+ * The application can mark its own stages with the same macros. trace_write_json() saves
+ * the events of all the threads in the Chrome trace-event JSON format, which can be opened
+ * with chrome://tracing or https://ui.perfetto.dev.
+ */
+
+#ifndef _trick_variable_server_trace_h_
+#define _trick_variable_server_trace_h_
+
+/** events kept per thread; older events are overwritten. Must be a power of two. */
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 16384
+#endif
+
+#ifdef TRICK_VS_TRACE
+#define TRACE_BEGIN(name) trace_event((name), 'B')
+#define TRACE_END(name)   trace_event((name), 'E')
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name)   ((void)0)
+#endif
+
+
+/**
+ *   @brief records an event in the ring buffer of the calling thread. The ring is allocated
+ *   (or recycled from a thread that has exited) at the first event of each thread, or by
+ *   trace_thread_name().
+ *
+ *   @param name:  the name of the stage; it must be a string literal or stay valid until the trace is written;
+ *   @param phase: 'B' at the beginning of the stage, 'E' at its end.
+ */
+
+void trace_event(const char* name, char phase);
+
+
+/**
+ *   @brief names the calling thread in the trace and allocates its ring buffer.
+ *
+ *   @param name: the name of the thread.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int trace_thread_name(const char* name);
+
+
+/**
+ *   @brief writes the events of all the threads to a file, in the Chrome trace-event JSON format.
+ *   Threads still recording may overwrite the events being written: call it when they are idle.
+ *
+ *   @param path: the file to write.
+ *
+ *   @return  Upon successful completion, the function returns the number of events written.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+long trace_write_json(const char* path);
+
+
+/**
+ *   @brief discards the events recorded so far by all the threads.
+ */
+
+void trace_clear();
+
+#endif
@@ -0,0 +1,524 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_arrow.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Export of the decoded values in the Apache Arrow IPC streaming format.
+ *
+ * The metadata of the messages (Schema and RecordBatch) are flatbuffers, built here by hand
+ * front to back: a table is written before the objects it refers to, whose offsets are then
+ * patched, and its vtable is written right before it.
+ *
+ * @see https://github.com/apache/arrow/blob/main/format/Message.fbs and Schema.fbs for the tables.
+ */
+
+#define _GNU_SOURCE           //IOV_MAX
+
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //memcpy,...
+#include<stdint.h>        //uint32_t,...
+#include<errno.h>         //errno,...
+#include<limits.h>        //IOV_MAX
+#include<unistd.h>        //write,...
+#include<sys/uio.h>       //writev,...
+
+#include "../include/trick_variable_server_arrow.h"
+
+#define PREFIX_SIZE 8                  /* continuation marker and metadata length */
+#define METADATA_VERSION_V5 4
+#define HEADER_SCHEMA 1
+#define HEADER_RECORD_BATCH 3
+#define TYPE_FLOATING_POINT 3
+#define PRECISION_DOUBLE 2
+
+
+/**
+ *   @brief the state of the flatbuffer being built into the metadata buffer of a writer.
+ */
+
+struct builder {
+	struct arrow_writer* writer;
+	size_t used;                       /* bytes of the flatbuffer */
+};
+
+
+/**
+ * Function: at
+ * ----------------------------
+ *   the address of a position of the flatbuffer.
+ */
+
+static unsigned char* at(struct builder* builder, size_t position) {
+	return builder->writer->metadata + PREFIX_SIZE + position;
+}
+
+
+/**
+ * Function: grow
+ * ----------------------------
+ *   appends the given number of zero bytes, growing the metadata buffer if needed.
+ *
+ *   @return  the position of the first byte, (size_t)-1 if the buffer cannot grow.
+ */
+
+static size_t grow(struct builder* builder, size_t length) {
+	struct arrow_writer* writer = builder->writer;
+	size_t position = builder->used, capacity;
+	unsigned char* metadata;
+
+	if (PREFIX_SIZE + position + length + 8 > writer->metadata_capacity) {
+		capacity = writer->metadata_capacity * 2;
+		while (capacity < PREFIX_SIZE + position + length + 8) capacity *= 2;
+		metadata = realloc(writer->metadata, capacity);
+		if (metadata == NULL) {
+			return (size_t)-1;
+		}
+		writer->metadata = metadata;
+		writer->metadata_capacity = capacity;
+	}
+	memset(at(builder, position), 0, length);
+	builder->used += length;
+	return position;
+}
+
+
+/**
+ * Function: align
+ * ----------------------------
+ *   pads the flatbuffer so that the object starting after skip more bytes is aligned.
+ */
+
+static int align(struct builder* builder, size_t alignment, size_t skip) {
+	size_t padding = (alignment - (builder->used + skip) % alignment) % alignment;
+
+	return grow(builder, padding) == (size_t)-1 ? -1 : 0;
+}
+
+
+/**
+ * Function: put_u16, put_u32, put_i64
+ * ----------------------------
+ *   writes a little-endian scalar at a position of the flatbuffer.
+ */
+
+static void put_u16(struct builder* builder, size_t position, uint16_t value) {
+	memcpy(at(builder, position), &value, sizeof(value));
+}
+
+static void put_u32(struct builder* builder, size_t position, uint32_t value) {
+	memcpy(at(builder, position), &value, sizeof(value));
+}
+
+static void put_i64(struct builder* builder, size_t position, int64_t value) {
+	memcpy(at(builder, position), &value, sizeof(value));
+}
+
+
+/**
+ * Function: refer
+ * ----------------------------
+ *   sets the offset at a position to point to a later object.
+ */
+
+static void refer(struct builder* builder, size_t position, size_t target) {
+	put_u32(builder, position, (uint32_t)(target - position));
+}
+
+
+/**
+ * Function: table
+ * ----------------------------
+ *   writes a vtable and an empty table with the given fields; a field of size 0 is absent.
+ *   The fields are laid out by decreasing size, so that each one is aligned to its size.
+ *
+ *   @return  the position of the table, (size_t)-1 on failure; positions is filled with
+ *            the position of each field.
+ */
+
+static size_t table(struct builder* builder, int fields, const int* sizes, size_t* positions) {
+	size_t offsets[8], vtable, start, offset = 4;
+	int size, i, wide = 0;
+
+	for (i = 0; i < fields; i++) {
+		if (sizes[i] == 8) wide = 1;
+	}
+	/* the table starts 4 bytes before an 8-byte boundary when it has 8-byte fields */
+	for (size = 8; size >= 1; size /= 2) {
+		for (i = 0; i < fields; i++) {
+			if (sizes[i] != size) continue;
+			while ((offset + (wide ? 4 : 0)) % size != 0) offset++;
+			offsets[i] = offset;
+			offset += size;
+		}
+	}
+	offset = (offset + 3) & ~(size_t)3;
+
+	if (align(builder, 2, 0) < 0 || (vtable = grow(builder, 4 + 2 * fields)) == (size_t)-1) {
+		return (size_t)-1;
+	}
+	put_u16(builder, vtable, (uint16_t)(4 + 2 * fields));
+	put_u16(builder, vtable + 2, (uint16_t)offset);
+	for (i = 0; i < fields; i++) {
+		put_u16(builder, vtable + 4 + 2 * i, sizes[i] > 0 ? (uint16_t)offsets[i] : 0);
+	}
+	if (align(builder, wide ? 8 : 4, wide ? 4 : 0) < 0 || (start = grow(builder, offset)) == (size_t)-1) {
+		return (size_t)-1;
+	}
+	put_u32(builder, start, (uint32_t)(start - vtable));
+	for (i = 0; i < fields; i++) {
+		positions[i] = start + offsets[i];
+	}
+	return start;
+}
+
+
+/**
+ * Function: vector
+ * ----------------------------
+ *   writes a vector of count zeroed elements of the given size and alignment.
+ *
+ *   @return  the position of the vector (its length), (size_t)-1 on failure.
+ */
+
+static size_t vector(struct builder* builder, size_t count, size_t size, size_t alignment) {
+	size_t position;
+
+	if (align(builder, alignment > 4 ? alignment : 4, 4) < 0 || (position = grow(builder, 4 + count * size)) == (size_t)-1) {
+		return (size_t)-1;
+	}
+	put_u32(builder, position, (uint32_t)count);
+	return position;
+}
+
+
+/**
+ * Function: string
+ * ----------------------------
+ *   writes a string.
+ *
+ *   @return  the position of the string (its length), (size_t)-1 on failure.
+ */
+
+static size_t string(struct builder* builder, const char* text) {
+	size_t length = strlen(text), position = vector(builder, length + 1, 1, 1);
+
+	if (position == (size_t)-1) {
+		return position;
+	}
+	put_u32(builder, position, (uint32_t)length);
+	memcpy(at(builder, position + 4), text, length);
+	return position;
+}
+
+
+/**
+ * Function: message
+ * ----------------------------
+ *   starts a flatbuffer with a Message table as root.
+ *
+ *   @return  the position of the offset to the header, (size_t)-1 on failure.
+ */
+
+static size_t message(struct builder* builder, int header_type, long long body_length) {
+	static const int sizes[4] = { 2, 1, 4, 8 };        /* version, header_type, header, bodyLength */
+	size_t positions[4], root, start;
+
+	builder->used = 0;
+	if ((root = grow(builder, 4)) == (size_t)-1 || (start = table(builder, 4, sizes, positions)) == (size_t)-1) {
+		return (size_t)-1;
+	}
+	refer(builder, root, start);
+	put_u16(builder, positions[0], METADATA_VERSION_V5);
+	*at(builder, positions[1]) = (unsigned char)header_type;
+	put_i64(builder, positions[3], body_length);
+	return positions[2];
+}
+
+
+/**
+ * Function: build_schema
+ * ----------------------------
+ *   builds the Schema message: a non-nullable float64 field per column.
+ */
+
+static int build_schema(struct builder* builder, char** variables, int count) {
+	static const int schema_sizes[2] = { 0, 4 };                  /* endianness (little), fields */
+	static const int field_sizes[7] = { 4, 0, 1, 4, 0, 4, 0 };    /* name, nullable, type_type, type, dictionary, children, custom_metadata */
+	static const int precision_sizes[1] = { 2 };
+	size_t header, schema[2], fields, field[7], type[1], target;
+	int i;
+
+	if ((header = message(builder, HEADER_SCHEMA, 0)) == (size_t)-1
+		|| (target = table(builder, 2, schema_sizes, schema)) == (size_t)-1) {
+		return -1;
+	}
+	refer(builder, header, target);
+	if ((fields = vector(builder, count + 1, 4, 4)) == (size_t)-1) {
+		return -1;
+	}
+	refer(builder, schema[1], fields);
+	for (i = 0; i <= count; i++) {
+		if ((target = table(builder, 7, field_sizes, field)) == (size_t)-1) return -1;
+		refer(builder, fields + 4 + 4 * i, target);
+		*at(builder, field[2]) = TYPE_FLOATING_POINT;
+		if ((target = string(builder, i == 0 ? "time" : variables[i - 1])) == (size_t)-1) return -1;
+		refer(builder, field[0], target);
+		if ((target = table(builder, 1, precision_sizes, type)) == (size_t)-1) return -1;
+		refer(builder, field[3], target);
+		put_u16(builder, type[0], PRECISION_DOUBLE);
+		if ((target = vector(builder, 0, 4, 4)) == (size_t)-1) return -1;
+		refer(builder, field[5], target);
+	}
+	return 0;
+}
+
+
+/**
+ * Function: build_record_batch
+ * ----------------------------
+ *   builds the RecordBatch message of the first rows of the columns: per column, one field node
+ *   and two buffers (an empty validity bitmap, since there are no nulls, and the values).
+ */
+
+static int build_record_batch(struct builder* builder, int rows) {
+	static const int batch_sizes[4] = { 8, 4, 4, 0 };             /* length, nodes, buffers, compression */
+	int columns = builder->writer->variables + 1, i;
+	long long length = (long long)rows * (long long)sizeof(double);
+	size_t header, batch[4], nodes, buffers, target;
+
+	if ((header = message(builder, HEADER_RECORD_BATCH, length * columns)) == (size_t)-1
+		|| (target = table(builder, 4, batch_sizes, batch)) == (size_t)-1) {
+		return -1;
+	}
+	refer(builder, header, target);
+	put_i64(builder, batch[0], rows);
+	if ((nodes = vector(builder, columns, 16, 8)) == (size_t)-1) {
+		return -1;
+	}
+	refer(builder, batch[1], nodes);
+	for (i = 0; i < columns; i++) {
+		put_i64(builder, nodes + 4 + 16 * i, rows);
+	}
+	if ((buffers = vector(builder, 2 * columns, 16, 8)) == (size_t)-1) {
+		return -1;
+	}
+	refer(builder, batch[2], buffers);
+	for (i = 0; i < columns; i++) {
+		put_i64(builder, buffers + 4 + 32 * i, length * i);
+		put_i64(builder, buffers + 4 + 32 * i + 16, length * i);
+		put_i64(builder, buffers + 4 + 32 * i + 24, length);
+	}
+	return 0;
+}
+
+
+/**
+ * Function: write_message
+ * ----------------------------
+ *   writes the message built into the metadata buffer, followed by body_count body buffers.
+ */
+
+static int write_message(struct arrow_writer* writer, struct builder* builder, int body_count, size_t body_length) {
+	struct iovec* iov = writer->iov;
+	uint32_t marker = 0xFFFFFFFFu, size;
+	int count = body_count + 1, chunk, i;
+	ssize_t written;
+
+	if (align(builder, 8, 0) < 0) {
+		return -1;
+	}
+	size = (uint32_t)builder->used;
+	memcpy(writer->metadata, &marker, 4);
+	memcpy(writer->metadata + 4, &size, 4);
+	iov[0].iov_base = writer->metadata;
+	iov[0].iov_len = PREFIX_SIZE + builder->used;
+	for (i = 1; i < count; i++) {
+		iov[i].iov_base = writer->columns + (size_t)(i - 1) * writer->batch_size;
+		iov[i].iov_len = body_length;
+	}
+	while (count > 0) {
+		chunk = count < IOV_MAX ? count : IOV_MAX;
+		written = writev(writer->fd, iov, chunk);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		writer->bytes += written;
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: arrow_writer_open
+ * ----------------------------
+ *   initializes a writer and writes the schema of the stream.
+ *
+ *   @param writer:     the writer;
+ *   @param fd:         the file descriptor to write to, which is not closed by the writer;
+ *   @param variables:  the names of the variables, i.e. of the columns after "time";
+ *   @param count:      the number of variables;
+ *   @param batch_size: the number of rows of a record batch.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_open(struct arrow_writer* writer, int fd, char** variables, int count, int batch_size) {
+	struct builder builder = { writer, 0 };
+
+	memset(writer, 0, sizeof(struct arrow_writer));
+	if (count < 0 || batch_size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	writer->fd = fd;
+	writer->variables = count;
+	writer->batch_size = batch_size;
+	writer->metadata_capacity = 256 + 64 * (size_t)(count + 1);
+	writer->columns = malloc(sizeof(double) * (size_t)batch_size * (size_t)(count + 1));
+	writer->metadata = malloc(writer->metadata_capacity);
+	writer->iov = malloc(sizeof(struct iovec) * (size_t)(count + 2));
+	if (writer->columns == NULL || writer->metadata == NULL || writer->iov == NULL) {
+		arrow_writer_close(writer);
+		errno = ENOMEM;
+		return -1;
+	}
+	if (build_schema(&builder, variables, count) < 0 || write_message(writer, &builder, 0, 0) < 0) {
+		free(writer->columns);
+		free(writer->metadata);
+		free(writer->iov);
+		memset(writer, 0, sizeof(struct arrow_writer));
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: arrow_writer_append
+ * ----------------------------
+ *   appends one row, and writes a record batch when batch_size rows are collected.
+ *
+ *   @param writer: the writer;
+ *   @param time:   the simulation time of the row;
+ *   @param values: the value of each variable (e.g. as decoded by subscription_decode()).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_append(struct arrow_writer* writer, double time, const double* values) {
+	double* cell = writer->columns + writer->rows;
+	int i;
+
+	*cell = time;
+	for (i = 0; i < writer->variables; i++) {
+		cell += writer->batch_size;
+		*cell = values[i];
+	}
+	if (++writer->rows == writer->batch_size) {
+		return arrow_writer_flush(writer);
+	}
+	return 0;
+}
+
+
+/**
+ * Function: arrow_writer_flush
+ * ----------------------------
+ *   writes the rows collected so far as a (shorter) record batch.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_flush(struct arrow_writer* writer) {
+	struct builder builder = { writer, 0 };
+	int rows = writer->rows;
+
+	if (rows == 0) {
+		return 0;
+	}
+	/* the rows are dropped if they cannot be written */
+	writer->rows = 0;
+	if (build_record_batch(&builder, rows) < 0 || write_message(writer, &builder, writer->variables + 1, sizeof(double) * (size_t)rows) < 0) {
+		return -1;
+	}
+	writer->batches++;
+	writer->rows_written += rows;
+	return 0;
+}
+
+
+/**
+ * Function: arrow_writer_close
+ * ----------------------------
+ *   writes the rows left and the end-of-stream marker, then releases the writer.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int arrow_writer_close(struct arrow_writer* writer) {
+	static const uint32_t end_of_stream[2] = { 0xFFFFFFFFu, 0 };
+	const char* data = (const char*)end_of_stream;
+	size_t left = sizeof(end_of_stream);
+	ssize_t written;
+	int result = 0;
+
+	if (writer->columns != NULL && writer->metadata != NULL && writer->iov != NULL) {
+		result = arrow_writer_flush(writer);
+		while (result == 0 && left > 0) {
+			written = write(writer->fd, data, left);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				result = -1;
+				break;
+			}
+			writer->bytes += written;
+			data += written;
+			left -= written;
+		}
+	}
+	free(writer->columns);
+	free(writer->metadata);
+	free(writer->iov);
+	writer->columns = NULL;
+	writer->metadata = NULL;
+	writer->iov = NULL;
+	return result;
+}
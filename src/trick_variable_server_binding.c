@@ -0,0 +1,365 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_binding.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Decoding of the binary messages straight into the fields of a user structure.
+ */
+
+
+#include<stdlib.h>        //realloc,...
+#include<string.h>        //memcpy,...
+#include<stdint.h>        //int64_t,...
+#include<errno.h>         //errno,...
+
+#include "../include/trick_variable_server_binding.h"
+#include "../include/trick_variable_server_trace.h"
+
+#define BINDING_COPY8 0
+#define BINDING_COPY4 1
+#define BINDING_CONVERT 2
+
+
+static const size_t field_sizes[] = { 8, 4, 1, 2, 4, 8, 1, 2, 4, 8, 1 };
+
+
+/**
+ * Function: is_signed_integer
+ * ----------------------------
+ *   tells whether a Trick type is a signed integer.
+ */
+
+static int is_signed_integer(int type) {
+	return type == TRICK_TYPE_CHARACTER || type == TRICK_TYPE_SHORT || type == TRICK_TYPE_INTEGER || type == TRICK_TYPE_LONG
+		|| type == TRICK_TYPE_LONG_LONG || type == TRICK_TYPE_ENUMERATED || type == TRICK_TYPE_BITFIELD;
+}
+
+
+/**
+ * Function: is_unsigned_integer
+ * ----------------------------
+ *   tells whether a Trick type is an unsigned integer.
+ */
+
+static int is_unsigned_integer(int type) {
+	return type == TRICK_TYPE_UNSIGNED_CHARACTER || type == TRICK_TYPE_UNSIGNED_SHORT || type == TRICK_TYPE_UNSIGNED_INTEGER
+		|| type == TRICK_TYPE_UNSIGNED_LONG || type == TRICK_TYPE_UNSIGNED_LONG_LONG || type == TRICK_TYPE_UNSIGNED_BITFIELD;
+}
+
+
+/**
+ * Function: select_kind
+ * ----------------------------
+ *   a plain copy when the value already has the representation of the field, a conversion otherwise.
+ */
+
+static int select_kind(const struct decode_op* source, int type) {
+	if (source->size == 8 && ((source->type == TRICK_TYPE_DOUBLE && type == BINDING_DOUBLE)
+		|| (is_signed_integer(source->type) && type == BINDING_INT64)
+		|| (is_unsigned_integer(source->type) && type == BINDING_UINT64))) {
+		return BINDING_COPY8;
+	}
+	if (source->size == 4 && ((source->type == TRICK_TYPE_FLOAT && type == BINDING_FLOAT)
+		|| (is_signed_integer(source->type) && type == BINDING_INT32)
+		|| (is_unsigned_integer(source->type) && type == BINDING_UINT32))) {
+		return BINDING_COPY4;
+	}
+	return BINDING_CONVERT;
+}
+
+
+/**
+ * Function: store
+ * ----------------------------
+ *   converts a value to the type of a field and writes it.
+ */
+
+static void store(unsigned char* field, int type, double value) {
+	float f;
+	int8_t i8;
+	int16_t i16;
+	int32_t i32;
+	int64_t i64;
+	uint8_t u8;
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+
+	switch (type) {
+	case BINDING_DOUBLE: memcpy(field, &value, 8); break;
+	case BINDING_FLOAT: f = (float)value; memcpy(field, &f, 4); break;
+	case BINDING_INT8: i8 = (int8_t)value; memcpy(field, &i8, 1); break;
+	case BINDING_INT16: i16 = (int16_t)value; memcpy(field, &i16, 2); break;
+	case BINDING_INT32: i32 = (int32_t)value; memcpy(field, &i32, 4); break;
+	case BINDING_INT64: i64 = (int64_t)value; memcpy(field, &i64, 8); break;
+	case BINDING_UINT8: u8 = (uint8_t)value; memcpy(field, &u8, 1); break;
+	case BINDING_UINT16: u16 = (uint16_t)value; memcpy(field, &u16, 2); break;
+	case BINDING_UINT32: u32 = (uint32_t)value; memcpy(field, &u32, 4); break;
+	case BINDING_UINT64: u64 = (uint64_t)value; memcpy(field, &u64, 8); break;
+	case BINDING_BOOL: *field = value != 0.0; break;
+	}
+}
+
+
+/**
+ * Function: compile
+ * ----------------------------
+ *   turns the fields into writes from the offsets of the current decode plan.
+ *   The fields of slots absent from the messages are left untouched.
+ */
+
+static int compile(struct binding* binding, const struct decode_plan* plan) {
+	struct binding_op* ops;
+	const struct decode_op* source;
+	const struct binding_field* field;
+	int i;
+
+	if (binding->count > 0 && binding->ops == NULL) {
+		ops = malloc(sizeof(struct binding_op) * binding->capacity);
+		if (ops == NULL) {
+			return -1;
+		}
+		binding->ops = ops;
+	}
+	binding->op_count = 0;
+	for (i = 0; i < binding->count; i++) {
+		field = &binding->fields[i];
+		if (field->slot >= plan->count) {
+			continue;
+		}
+		source = &plan->ops[field->slot];
+		binding->ops[binding->op_count].source = source->offset;
+		binding->ops[binding->op_count].target = field->offset;
+		binding->ops[binding->op_count].type = field->type;
+		binding->ops[binding->op_count].kind = select_kind(source, field->type);
+		binding->ops[binding->op_count].decode = source->decode;
+		binding->op_count++;
+	}
+	binding->plan_generation = plan->generation;
+	return 0;
+}
+
+
+/**
+ * Function: binding_init
+ * ----------------------------
+ *   initializes a binding without fields.
+ *
+ *   @param binding: the binding;
+ *   @param state:   the state structure the values are written into;
+ *   @param second:  a second copy of the structure to double-buffer the states, NULL for none;
+ *   @param size:    the size of the structure.
+ */
+
+void binding_init(struct binding* binding, void* state, void* second, size_t size) {
+	memset(binding, 0, sizeof(struct binding));
+	binding->states[0] = state;
+	binding->states[1] = second;
+	binding->size = size;
+	atomic_init(&binding->active, NULL);
+	atomic_init(&binding->published, 0);
+	atomic_init(&binding->writing, 0);
+}
+
+
+/**
+ * Function: binding_destroy
+ * ----------------------------
+ *   releases the fields of a binding (not the state structures).
+ *
+ *   @param binding: the binding.
+ */
+
+void binding_destroy(struct binding* binding) {
+	free(binding->fields);
+	free(binding->ops);
+	binding->fields = NULL;
+	binding->ops = NULL;
+	binding->count = 0;
+	binding->capacity = 0;
+	binding->op_count = 0;
+}
+
+
+/**
+ * Function: binding_add
+ * ----------------------------
+ *   binds a slot of the subscription to a field. The writes are compiled again
+ *   on the next message.
+ *
+ *   @param binding: the binding;
+ *   @param slot:    the slot, as returned by subscription_add();
+ *   @param offset:  the offset of the field in the state structure (offsetof());
+ *   @param type:    the type of the field, one of enum binding_type.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c EINVAL if the field exceeds the structure.
+ */
+
+int binding_add(struct binding* binding, int slot, size_t offset, int type) {
+	struct binding_field* fields;
+	int capacity;
+
+	if (slot < 0 || type < BINDING_DOUBLE || type > BINDING_BOOL || offset + field_sizes[type] > binding->size) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (binding->count == binding->capacity) {
+		capacity = binding->capacity > 0 ? binding->capacity * 2 : 16;
+		fields = realloc(binding->fields, sizeof(struct binding_field) * capacity);
+		if (fields == NULL) {
+			return -1;
+		}
+		binding->fields = fields;
+		binding->capacity = capacity;
+		free(binding->ops);
+		binding->ops = NULL;
+	}
+	binding->fields[binding->count].slot = slot;
+	binding->fields[binding->count].offset = offset;
+	binding->fields[binding->count].type = type;
+	binding->count++;
+	binding->plan_generation = 0;
+	return 0;
+}
+
+
+/**
+ * Function: binding_add_array
+ * ----------------------------
+ *   binds consecutive slots to the elements of an array of fields.
+ *
+ *   @param binding: the binding;
+ *   @param slot:    the slot of the first element;
+ *   @param count:   the number of elements;
+ *   @param offset:  the offset of the first element in the state structure;
+ *   @param stride:  the distance in bytes between two elements;
+ *   @param type:    the type of the elements, one of enum binding_type.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c EINVAL if an element exceeds the structure.
+ */
+
+int binding_add_array(struct binding* binding, int slot, int count, size_t offset, size_t stride, int type) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (binding_add(binding, slot + i, offset + (size_t)i * stride, type) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: binding_decode
+ * ----------------------------
+ *   decodes a binary variable message into the bound fields, and publishes the state.
+ *   When double-buffered, the message is written into the copy that is not active, which
+ *   then becomes the active one.
+ *
+ *   @param binding:      the binding;
+ *   @param subscription: the subscription the slots belong to;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message.
+ *
+ *   @return  1 if the message was decoded, 0 if it was skipped (see subscription_decode()).
+ *            Otherwise, -1 is returned and errno is set to indicate the error, @c ENOTSUP
+ *            if the layout of the message cannot be compiled (strings).
+ */
+
+int binding_decode(struct binding* binding, struct subscription* subscription, const unsigned char* frame, unsigned int length) {
+	const struct binding_op* op;
+	const struct binding_op* last;
+	unsigned long number;
+	unsigned char* state;
+	int result;
+
+	result = subscription_prepare(subscription, frame, length);
+	if (result <= 0) {
+		return result;
+	}
+	if (binding->plan_generation != subscription->plan.generation && compile(binding, &subscription->plan) < 0) {
+		return -1;
+	}
+
+	TRACE_BEGIN("decode");
+	number = atomic_load_explicit(&binding->published, memory_order_relaxed) + 1;
+	state = binding->states[1] != NULL ? binding->states[number & 1] : binding->states[0];
+	atomic_store_explicit(&binding->writing, number, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	last = binding->ops + binding->op_count;
+	for (op = binding->ops; op < last; op++) {
+		if (op->kind == BINDING_COPY8) memcpy(state + op->target, frame + op->source, 8);
+		else if (op->kind == BINDING_COPY4) memcpy(state + op->target, frame + op->source, 4);
+		else store(state + op->target, op->type, op->decode(frame + op->source));
+	}
+
+	atomic_store_explicit(&binding->active, state, memory_order_release);
+	atomic_store_explicit(&binding->published, number, memory_order_release);
+	TRACE_END("decode");
+	return 1;
+}
+
+
+/**
+ * Function: binding_acquire
+ * ----------------------------
+ *   the last state completely written.
+ *
+ *   @param binding:    the binding;
+ *   @param generation: filled with the number of the message of the state, for binding_validate().
+ *
+ *   @return  the state structure, NULL if no message has been written yet.
+ */
+
+void* binding_acquire(struct binding* binding, unsigned long* generation) {
+	/* the number is read first: if the state is newer, the validation is only stricter */
+	*generation = atomic_load_explicit(&binding->published, memory_order_acquire);
+	return atomic_load_explicit(&binding->active, memory_order_acquire);
+}
+
+
+/**
+ * Function: binding_validate
+ * ----------------------------
+ *   tells whether a state taken with binding_acquire() is still intact: a copy is
+ *   overwritten from the second message after the one that published it (from the
+ *   next one when not double-buffered).
+ *
+ *   @param binding:    the binding;
+ *   @param generation: the number returned by binding_acquire().
+ *
+ *   @return  1 if the writer has not started to overwrite the state, 0 otherwise
+ *            (always 0 for a binding that is not double-buffered while a message is written).
+ */
+
+int binding_validate(struct binding* binding, unsigned long generation) {
+	unsigned long writing;
+
+	atomic_thread_fence(memory_order_acquire);
+	writing = atomic_load_explicit(&binding->writing, memory_order_relaxed);
+	return writing - generation <= (binding->states[1] != NULL ? 1UL : 0UL);
+}
@@ -0,0 +1,322 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_clock_alignment.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Alignment of the simulation time carried by the frames with the host CLOCK_MONOTONIC.
+ *
+ * The filter state is (offset, rate): offset is the host arrival time predicted for the sim
+ * time of the last sample, rate the host seconds per sim second. The filter steps in sim time,
+ * so a freeze (sim time standing still) simply produces no update.
+ */
+
+
+#include<math.h>      //fabs,...
+#include<errno.h>     //errno,...
+#include<time.h>      //clock_gettime,...
+
+#include "../include/trick_variable_server_clock_alignment.h"
+#include "../include/trick_variable_server_receiver.h"
+
+#define INITIAL_MEASUREMENT_NOISE  1.0e-6
+#define MINIMUM_MEASUREMENT_NOISE  1.0e-12
+#define INITIAL_RATE_VARIANCE      1.0
+#define CONVERGENCE_SAMPLES        16
+#define MAXIMUM_OUTLIERS           8
+
+
+/**
+ * Function: reset_floor
+ * ----------------------------
+ *   forgets the fastest-path envelope.
+ */
+
+static void reset_floor(struct clock_alignment* alignment) {
+	alignment->floor = 0.0;
+	alignment->window_floor = HUGE_VAL;
+	alignment->previous_floor = HUGE_VAL;
+	alignment->window_samples = 0;
+}
+
+
+/**
+ * Function: anchor
+ * ----------------------------
+ *   restarts the fit from the given sample, keeping the tuning parameters.
+ *   The rate is kept if it is already known.
+ */
+
+static void anchor(struct clock_alignment* alignment, double sim_time, double host_time, int keep_rate) {
+	alignment->sim_time = sim_time;
+	alignment->host_time = host_time;
+	alignment->offset = host_time;
+	alignment->p00 = alignment->measurement_noise;
+	alignment->p01 = 0.0;
+	if (!keep_rate) {
+		alignment->rate = 1.0;
+		alignment->p11 = INITIAL_RATE_VARIANCE;
+		alignment->samples = 0;
+	}
+	reset_floor(alignment);
+	alignment->outliers = 0;
+	alignment->frozen = 0;
+}
+
+
+/**
+ * Function: clock_alignment_init
+ * ----------------------------
+ *   initializes the estimator with default tuning: 1 ms^2/s offset noise,
+ *   1e-6/s rate noise, a 3 sigma gate, a fastest-path envelope over windows of 128 samples
+ *   and a freeze declared after 0.5 s without sim time progress.
+ *
+ *   @param alignment:    the estimator;
+ *   @param base_latency: one-way latency of the fastest path in seconds, if known (e.g. half the ping time), 0 otherwise.
+ */
+
+void clock_alignment_init(struct clock_alignment* alignment, double base_latency) {
+	alignment->base_latency = base_latency;
+	alignment->offset_noise = 1.0e-6;
+	alignment->rate_noise = 1.0e-6;
+	alignment->gate = 3.0;
+	alignment->floor_window = 128;
+	alignment->freeze_timeout = 0.5;
+	alignment->measurement_noise = INITIAL_MEASUREMENT_NOISE;
+	alignment->last_age = 0.0;
+	anchor(alignment, 0.0, 0.0, 0);
+	alignment->samples = -1;
+}
+
+
+/**
+ * Function: clock_alignment_update
+ * ----------------------------
+ *   feeds a sample to the estimator. The sample age is the arrival time minus the time at which
+ *   the fastest observed path would have delivered the sample, plus the base latency.
+ *   A sim time going backwards (restart, checkpoint reload) restarts the fit; a repeated sim time
+ *   leaves the fit and the age untouched, and after freeze_timeout host seconds the samples are
+ *   reported as frozen; when the sim time advances again the offset is re-anchored while the
+ *   rate is kept. A long run of same-sign outliers (e.g. real time toggled with set_real_time())
+ *   reopens the covariance so that the fit re-converges quickly.
+ *
+ *   @param alignment: the estimator;
+ *   @param sim_time:  the Trick @c time carried by the sample;
+ *   @param host_time: the host CLOCK_MONOTONIC arrival time of the sample, in seconds;
+ *   @param estimate:  if not NULL, filled with the estimate for this sample.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to EINVAL.
+ */
+
+int clock_alignment_update(struct clock_alignment* alignment, double sim_time, double host_time, struct clock_alignment_estimate* estimate) {
+	double ds, innovation, deviation, s, k0, k1, p00, p01, noise;
+	int gated = 0;
+	int advanced = 1;
+
+	if (!isfinite(sim_time) || !isfinite(host_time)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (alignment->samples < 0 || sim_time < alignment->sim_time) {
+		anchor(alignment, sim_time, host_time, 0);
+		alignment->samples = 1;
+		innovation = 0.0;
+	}
+	else if (sim_time == alignment->sim_time) {
+		/* repeated sim times are normal when the cycle is shorter than the sim frame */
+		if (host_time - alignment->host_time > alignment->freeze_timeout) {
+			alignment->frozen = 1;
+		}
+		innovation = host_time - alignment->offset;
+		advanced = 0;
+	}
+	else if (alignment->frozen) {
+		anchor(alignment, sim_time, host_time, 1);
+		innovation = 0.0;
+	}
+	else {
+		ds = sim_time - alignment->sim_time;
+
+		/* predict: constant rate model stepped in sim time */
+		alignment->offset += alignment->rate * ds;
+		alignment->p00 += 2.0 * ds * alignment->p01 + ds * ds * alignment->p11 + alignment->offset_noise * ds;
+		alignment->p01 += ds * alignment->p11;
+		alignment->p11 += alignment->rate_noise * ds;
+
+		/* update with a Huber-weighted measurement */
+		innovation = host_time - alignment->offset;
+		noise = alignment->measurement_noise;
+		s = alignment->p00 + noise;
+		deviation = alignment->gate * sqrt(s);
+		if (fabs(innovation) > deviation) {
+			noise *= (innovation / deviation) * (innovation / deviation);
+			s = alignment->p00 + noise;
+			gated = innovation > 0.0 ? 1 : -1;
+		}
+		p00 = alignment->p00;
+		p01 = alignment->p01;
+		k0 = p00 / s;
+		k1 = p01 / s;
+		alignment->offset += k0 * innovation;
+		alignment->rate += k1 * innovation;
+		alignment->p00 = p00 - k0 * p00;
+		alignment->p01 = p01 - k0 * p01;
+		alignment->p11 -= k1 * p01;
+
+		if (!gated) {
+			alignment->measurement_noise = 0.99 * alignment->measurement_noise + 0.01 * innovation * innovation;
+			if (alignment->measurement_noise < MINIMUM_MEASUREMENT_NOISE) {
+				alignment->measurement_noise = MINIMUM_MEASUREMENT_NOISE;
+			}
+			alignment->outliers = 0;
+		}
+		else if (alignment->outliers * gated >= 0) {
+			alignment->outliers += gated;
+		}
+		else {
+			alignment->outliers = gated;
+		}
+		if (alignment->outliers >= MAXIMUM_OUTLIERS || alignment->outliers <= -MAXIMUM_OUTLIERS) {
+			alignment->p00 += alignment->measurement_noise + innovation * innovation;
+			alignment->p11 += INITIAL_RATE_VARIANCE;
+			reset_floor(alignment);
+			alignment->outliers = 0;
+		}
+
+		/* the fastest-path envelope is the lowest innovation over the last one or two windows */
+		if (innovation < alignment->window_floor) {
+			alignment->window_floor = innovation;
+		}
+		if (++alignment->window_samples >= alignment->floor_window) {
+			alignment->previous_floor = alignment->window_floor;
+			alignment->window_floor = HUGE_VAL;
+			alignment->window_samples = 0;
+		}
+		alignment->floor = alignment->window_floor < alignment->previous_floor ? alignment->window_floor : alignment->previous_floor;
+
+		alignment->sim_time = sim_time;
+		alignment->host_time = host_time;
+		alignment->samples++;
+	}
+
+	if (advanced) {
+		alignment->last_age = innovation - alignment->floor;
+		if (alignment->last_age < 0.0) alignment->last_age = 0.0;
+		alignment->last_age += alignment->base_latency;
+	}
+
+	if (estimate != NULL) {
+		estimate->sample_age = alignment->last_age;
+		estimate->real_time_ratio = alignment->rate > 0.0 ? 1.0 / alignment->rate : 0.0;
+		estimate->drift = estimate->real_time_ratio - 1.0;
+		estimate->innovation = innovation;
+		estimate->frozen = alignment->frozen;
+		estimate->converged = alignment->samples >= CONVERGENCE_SAMPLES;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: clock_alignment_sim_to_host
+ * ----------------------------
+ *   converts a sim time to the host time at which the server produced it,
+ *   i.e. the fastest-path arrival time minus the base latency.
+ *
+ *   @param alignment: the estimator;
+ *   @param sim_time:  the sim time to convert.
+ *
+ *   @return  the estimated CLOCK_MONOTONIC time in seconds.
+ */
+
+double clock_alignment_sim_to_host(const struct clock_alignment* alignment, double sim_time) {
+	return alignment->offset + alignment->rate * (sim_time - alignment->sim_time)
+		+ alignment->floor - alignment->base_latency;
+}
+
+
+/**
+ * Function: clock_alignment_host_time
+ * ----------------------------
+ *   reads CLOCK_MONOTONIC.
+ *
+ *   @return  the current host time in seconds.
+ */
+
+double clock_alignment_host_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: clock_alignment_frame_time
+ * ----------------------------
+ *   converts the arrival time of a frame, taken on CLOCK_REALTIME by the receiver, to
+ *   CLOCK_MONOTONIC. The kernel timestamp is used when available, the time at which the
+ *   frame was handed to the caller otherwise. The distance between the two clocks is read
+ *   now, with CLOCK_REALTIME read between two readings of CLOCK_MONOTONIC, so the frame must
+ *   be converted soon after it is received (before a step of the system clock can occur).
+ *
+ *   @param frame: the frame.
+ *
+ *   @return  the CLOCK_MONOTONIC arrival time of the frame in seconds.
+ */
+
+double clock_alignment_frame_time(const struct receiver_frame* frame) {
+	const struct timespec* arrival = &frame->kernel_time;
+	struct timespec before, real, after;
+	double monotonic;
+
+	if (arrival->tv_sec == 0 && arrival->tv_nsec == 0) {
+		arrival = &frame->user_time;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &after);
+	monotonic = ((double)(before.tv_sec + after.tv_sec) + (double)(before.tv_nsec + after.tv_nsec) * 1.0e-9) * 0.5;
+	return monotonic - (double)(real.tv_sec - arrival->tv_sec) - (double)(real.tv_nsec - arrival->tv_nsec) * 1.0e-9;
+}
+
+
+/**
+ * Function: clock_alignment_update_frame
+ * ----------------------------
+ *   feeds a received frame to the estimator: its arrival time is converted to CLOCK_MONOTONIC
+ *   with clock_alignment_frame_time(), so that the age of the sample does not include the
+ *   time the frame spent in the receive buffer when kernel timestamps are enabled.
+ *
+ *   @param alignment: the estimator;
+ *   @param frame:     the frame;
+ *   @param sim_time:  the Trick @c time carried by the frame;
+ *   @param estimate:  if not NULL, filled with the estimate for this frame (age and real-time ratio).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to EINVAL.
+ */
+
+int clock_alignment_update_frame(struct clock_alignment* alignment, const struct receiver_frame* frame, double sim_time, struct clock_alignment_estimate* estimate) {
+	return clock_alignment_update(alignment, sim_time, clock_alignment_frame_time(frame), estimate);
+}
@@ -0,0 +1,502 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_columns.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Transposition of binary messages into per-variable columns (structure of arrays).
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation of the message formats.
+ */
+
+
+#include<stdlib.h>        //posix_memalign,...
+#include<string.h>        //memcpy,...
+#include<stdint.h>        //uint64_t,...
+#include<math.h>          //NAN,...
+#include<errno.h>         //errno,...
+#include<immintrin.h>     //_mm256_shuffle_epi8,...
+
+#include "../include/trick_variable_server_decoder.h"
+#include "../include/trick_variable_server_columns.h"
+
+#define BINARY_HEADER_SIZE 12
+
+
+/**
+ * Function: read_u32
+ * ----------------------------
+ *   reads a 4-byte field of the message in the byte order of the simulation host.
+ */
+
+static unsigned int read_u32(const unsigned char* data, int swap) {
+	unsigned int value;
+
+	memcpy(&value, data, sizeof(value));
+	return swap ? __builtin_bswap32(value) : value;
+}
+
+
+/**
+ * Function: convert
+ * ----------------------------
+ *   converts one value of any numeric type to double.
+ */
+
+static double convert(const unsigned char* value, int type, unsigned int size, int swap) {
+	unsigned char bytes[8];
+	uint64_t bits = 0;
+	int64_t sign;
+	float f;
+	double d;
+	unsigned int i;
+
+	if (size == 0 || size > 8) {
+		return NAN;
+	}
+	for (i = 0; i < size; i++) {
+		bytes[i] = value[swap ? size - 1 - i : i];
+	}
+	if (type == TRICK_TYPE_DOUBLE && size == 8) {
+		memcpy(&d, bytes, 8);
+		return d;
+	}
+	if (type == TRICK_TYPE_FLOAT && size == 4) {
+		memcpy(&f, bytes, 4);
+		return f;
+	}
+	memcpy(&bits, bytes, size);
+	switch (type) {
+	case TRICK_TYPE_CHARACTER:
+	case TRICK_TYPE_SHORT:
+	case TRICK_TYPE_INTEGER:
+	case TRICK_TYPE_LONG:
+	case TRICK_TYPE_LONG_LONG:
+	case TRICK_TYPE_ENUMERATED:
+	case TRICK_TYPE_BITFIELD:
+		sign = (int64_t)(bits << (64 - 8 * size)) >> (64 - 8 * size);
+		return (double)sign;
+	case TRICK_TYPE_UNSIGNED_CHARACTER:
+	case TRICK_TYPE_UNSIGNED_SHORT:
+	case TRICK_TYPE_UNSIGNED_INTEGER:
+	case TRICK_TYPE_UNSIGNED_LONG:
+	case TRICK_TYPE_UNSIGNED_LONG_LONG:
+	case TRICK_TYPE_UNSIGNED_BITFIELD:
+	case TRICK_TYPE_BOOLEAN:
+	case TRICK_TYPE_WCHAR:
+		return (double)bits;
+	default:
+		return NAN;
+	}
+}
+
+
+/**
+ * Function: compile
+ * ----------------------------
+ *   splits the layout of a message into runs of consecutive variables of the same type and size.
+ */
+
+static int compile(struct column_set* set, const unsigned char* frame, unsigned int length) {
+	struct column_run* run = NULL;
+	unsigned int offset = BINARY_HEADER_SIZE, size;
+	int i, type;
+
+	set->valid = 0;
+	set->run_count = 0;
+	if (length < BINARY_HEADER_SIZE || read_u32(frame, set->swap) != 0
+		|| read_u32(frame + 4, set->swap) != length - 4 || read_u32(frame + 8, set->swap) != (unsigned int)set->variables) {
+		errno = EPROTO;
+		return -1;
+	}
+	for (i = 0; i < set->variables; i++) {
+		if (offset + 8 > length) {
+			errno = EPROTO;
+			return -1;
+		}
+		type = (int)read_u32(frame + offset, set->swap);
+		size = read_u32(frame + offset + 4, set->swap);
+		if (size > length - offset - 8) {
+			errno = EPROTO;
+			return -1;
+		}
+		if (run == NULL || run->type != type || run->size != size) {
+			run = &set->runs[set->run_count++];
+			run->offset = offset + 8;
+			run->stride = 8 + size;
+			run->first = i;
+			run->count = 0;
+			run->type = type;
+			run->size = size;
+		}
+		run->count++;
+		offset += 8 + size;
+	}
+	if (offset != length) {
+		errno = EPROTO;
+		return -1;
+	}
+	set->frame_length = length;
+	set->valid = 1;
+	return 0;
+}
+
+
+/**
+ * Function: runs_match
+ * ----------------------------
+ *   tells whether a message of the compiled length has the compiled types: the type code
+ *   and the size of the first variable of every run are compared.
+ */
+
+static int runs_match(const struct column_set* set, const unsigned char* frame) {
+	const struct column_run* run;
+	int r;
+
+	for (r = 0, run = set->runs; r < set->run_count; r++, run++) {
+		if (read_u32(frame + run->offset - 8, set->swap) != (unsigned int)run->type || read_u32(frame + run->offset - 4, set->swap) != run->size) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Function: append_scalar
+ * ----------------------------
+ *   stores the variables [from, run->count) of a run of one message, one value at a time.
+ */
+
+static void append_scalar(struct column_set* set, const struct column_run* run, int from, const unsigned char* frame, int row) {
+	const unsigned char* value = frame + run->offset + (size_t)from * run->stride;
+	double* column = set->storage + (size_t)(run->first + from) * set->capacity + row;
+	uint64_t bits;
+	int k;
+
+	if (run->type == TRICK_TYPE_DOUBLE && run->size == 8) {
+		for (k = from; k < run->count; k++, value += run->stride, column += set->capacity) {
+			memcpy(&bits, value, 8);
+			if (set->swap) bits = __builtin_bswap64(bits);
+			memcpy(column, &bits, 8);
+		}
+		return;
+	}
+	for (k = from; k < run->count; k++, value += run->stride, column += set->capacity) {
+		*column = convert(value, run->type, run->size, set->swap);
+	}
+}
+
+
+/**
+ * Function: sse_mask
+ * ----------------------------
+ *   the byte shuffle that moves the value of a 16-byte entry (type, size, double)
+ *   into the low half of the register, reversing its bytes if needed.
+ */
+
+__attribute__((target("ssse3")))
+static __m128i sse_mask(int swap) {
+	return swap ? _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1, -1)
+	            : _mm_setr_epi8(8, 9, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+}
+
+
+/**
+ * Function: append_sse
+ * ----------------------------
+ *   stores a run of doubles of two messages (or one, when second is NULL) into two rows,
+ *   transposing two messages by two variables at a time.
+ */
+
+__attribute__((target("ssse3")))
+static void append_sse(struct column_set* set, const struct column_run* run, const unsigned char* first, const unsigned char* second, int row) {
+	__m128i mask = sse_mask(set->swap);
+	const unsigned char* a = first + run->offset - 8;
+	const unsigned char* b = second != NULL ? second + run->offset - 8 : NULL;
+	double* column = set->storage + (size_t)run->first * set->capacity + row;
+	size_t capacity = (size_t)set->capacity;
+	__m128d x, y;
+	int k;
+
+	for (k = 0; k + 2 <= run->count; k += 2, a += 32, column += 2 * capacity) {
+		x = _mm_castsi128_pd(_mm_unpacklo_epi64(
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)a), mask),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(a + 16)), mask)));
+		if (b == NULL) {
+			_mm_storel_pd(column, x);
+			_mm_storeh_pd(column + capacity, x);
+			continue;
+		}
+		y = _mm_castsi128_pd(_mm_unpacklo_epi64(
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)b), mask),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(b + 16)), mask)));
+		b += 32;
+		_mm_storeu_pd(column, _mm_unpacklo_pd(x, y));
+		_mm_storeu_pd(column + capacity, _mm_unpackhi_pd(x, y));
+	}
+	if (k < run->count) {
+		append_scalar(set, run, k, first, row);
+		if (second != NULL) append_scalar(set, run, k, second, row + 1);
+	}
+}
+
+
+/**
+ * Function: avx2_row
+ * ----------------------------
+ *   loads the values of four consecutive 16-byte entries into one register, in order.
+ */
+
+__attribute__((target("avx2")))
+static __m256d avx2_row(const unsigned char* entries, __m256i mask) {
+	__m256i x = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)entries), mask);
+	__m256i y = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(entries + 32)), mask);
+
+	/* x = [v0 . | v1 .], y = [v2 . | v3 .]: unpack gives [v0 v2 | v1 v3], the permutation [v0 v1 v2 v3] */
+	return _mm256_castsi256_pd(_mm256_permute4x64_epi64(_mm256_unpacklo_epi64(x, y), 0xD8));
+}
+
+
+/**
+ * Function: append_avx2
+ * ----------------------------
+ *   stores a run of doubles of four messages into four rows, transposing four messages
+ *   by four variables at a time.
+ */
+
+__attribute__((target("avx2")))
+static void append_avx2(struct column_set* set, const struct column_run* run, const unsigned char* const* frames, int row) {
+	__m256i mask = _mm256_broadcastsi128_si256(sse_mask(set->swap));
+	const unsigned char* p0 = frames[0] + run->offset - 8;
+	const unsigned char* p1 = frames[1] + run->offset - 8;
+	const unsigned char* p2 = frames[2] + run->offset - 8;
+	const unsigned char* p3 = frames[3] + run->offset - 8;
+	double* column = set->storage + (size_t)run->first * set->capacity + row;
+	size_t capacity = (size_t)set->capacity;
+	size_t step = 4 * (size_t)run->stride;
+	__m256d r0, r1, r2, r3, t0, t1, t2, t3;
+	int k, i;
+
+	for (k = 0; k + 4 <= run->count; k += 4, p0 += step, p1 += step, p2 += step, p3 += step, column += 4 * capacity) {
+		r0 = avx2_row(p0, mask);
+		r1 = avx2_row(p1, mask);
+		r2 = avx2_row(p2, mask);
+		r3 = avx2_row(p3, mask);
+		t0 = _mm256_unpacklo_pd(r0, r1);
+		t1 = _mm256_unpackhi_pd(r0, r1);
+		t2 = _mm256_unpacklo_pd(r2, r3);
+		t3 = _mm256_unpackhi_pd(r2, r3);
+		_mm256_storeu_pd(column, _mm256_permute2f128_pd(t0, t2, 0x20));
+		_mm256_storeu_pd(column + capacity, _mm256_permute2f128_pd(t1, t3, 0x20));
+		_mm256_storeu_pd(column + 2 * capacity, _mm256_permute2f128_pd(t0, t2, 0x31));
+		_mm256_storeu_pd(column + 3 * capacity, _mm256_permute2f128_pd(t1, t3, 0x31));
+	}
+	if (k < run->count) {
+		for (i = 0; i < 4; i++) {
+			append_scalar(set, run, k, frames[i], row + i);
+		}
+	}
+}
+
+
+/**
+ * Function: columns_kernel_supported
+ * ----------------------------
+ *   tells whether the processor supports a kernel.
+ *
+ *   @param kernel: one of enum columns_kernel.
+ *
+ *   @return  1 if supported, 0 otherwise.
+ */
+
+int columns_kernel_supported(int kernel) {
+	__builtin_cpu_init();
+	switch (kernel) {
+	case COLUMNS_AUTO:
+	case COLUMNS_SCALAR:
+		return 1;
+	case COLUMNS_SSE:
+		return __builtin_cpu_supports("ssse3");
+	case COLUMNS_AVX2:
+		return __builtin_cpu_supports("avx2");
+	default:
+		return 0;
+	}
+}
+
+
+/**
+ * Function: columns_init
+ * ----------------------------
+ *   allocates the columns. The layout is compiled on the first message appended.
+ *
+ *   @param set:       the column set;
+ *   @param variables: the number of variables of the messages;
+ *   @param capacity:  the number of rows of a batch;
+ *   @param swap:      1 if the simulation host has the other byte order, 0 otherwise;
+ *   @param kernel:    one of enum columns_kernel.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ENOTSUP if the kernel is not supported.
+ */
+
+int columns_init(struct column_set* set, int variables, int capacity, int swap, int kernel) {
+	void* storage;
+	int error;
+
+	memset(set, 0, sizeof(struct column_set));
+	if (variables <= 0 || capacity <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!columns_kernel_supported(kernel)) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	if (kernel == COLUMNS_AUTO) {
+		kernel = columns_kernel_supported(COLUMNS_AVX2) ? COLUMNS_AVX2 : columns_kernel_supported(COLUMNS_SSE) ? COLUMNS_SSE : COLUMNS_SCALAR;
+	}
+	error = posix_memalign(&storage, 32, sizeof(double) * (size_t)variables * (size_t)capacity);
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	set->runs = malloc(sizeof(struct column_run) * variables);
+	if (set->runs == NULL) {
+		free(storage);
+		return -1;
+	}
+	set->storage = storage;
+	set->variables = variables;
+	set->capacity = capacity;
+	set->swap = swap;
+	set->kernel = kernel;
+	return 0;
+}
+
+
+/**
+ * Function: columns_destroy
+ * ----------------------------
+ *   releases the columns.
+ *
+ *   @param set: the column set.
+ */
+
+void columns_destroy(struct column_set* set) {
+	free(set->storage);
+	free(set->runs);
+	set->storage = NULL;
+	set->runs = NULL;
+	set->rows = 0;
+	set->valid = 0;
+}
+
+
+/**
+ * Function: columns_append
+ * ----------------------------
+ *   appends messages as new rows. Every message is checked against the compiled layout:
+ *   its length and, for each run, the type code and the size of the first variable. The
+ *   layout is compiled again when a message that does not match arrives while the columns
+ *   are empty.
+ *
+ *   @param set:     the column set;
+ *   @param frames:  the messages;
+ *   @param lengths: the length of each message;
+ *   @param count:   the number of messages.
+ *
+ *   @return  the number of messages appended, which is smaller than count when the columns
+ *            are full or a message has a layout different from the rows already stored
+ *            (process the batch and call columns_reset()). If a message is not valid, -1 is
+ *            returned and errno is set to indicate the error.
+ */
+
+int columns_append(struct column_set* set, const unsigned char* const* frames, const unsigned int* lengths, int count) {
+	const struct column_run* run;
+	int n, i, r, group;
+
+	if (count > set->capacity - set->rows) {
+		count = set->capacity - set->rows;
+	}
+	for (n = 0; n < count; n++) {
+		if (!set->valid || lengths[n] != set->frame_length || !runs_match(set, frames[n])) {
+			if (set->rows > 0 || n > 0) break;
+			if (compile(set, frames[n], lengths[n]) < 0) return -1;
+		}
+		if (read_u32(frames[n], set->swap) != 0 || read_u32(frames[n] + 8, set->swap) != (unsigned int)set->variables) {
+			if (n > 0) break;
+			errno = EPROTO;
+			return -1;
+		}
+	}
+	count = n;
+
+	for (n = 0; n < count; n += group) {
+		group = set->kernel == COLUMNS_AVX2 && count - n >= 4 ? 4 : set->kernel != COLUMNS_SCALAR && count - n >= 2 ? 2 : 1;
+		for (r = 0; r < set->run_count; r++) {
+			run = &set->runs[r];
+			if (run->type != TRICK_TYPE_DOUBLE || run->size != 8 || group == 1) {
+				for (i = 0; i < group; i++) {
+					append_scalar(set, run, 0, frames[n + i], set->rows + i);
+				}
+			}
+			else if (group == 4) {
+				append_avx2(set, run, frames + n, set->rows);
+			}
+			else {
+				append_sse(set, run, frames[n], frames[n + 1], set->rows);
+			}
+		}
+		set->rows += group;
+	}
+	return count;
+}
+
+
+/**
+ * Function: columns_column
+ * ----------------------------
+ *   the column of a variable.
+ *
+ *   @param set:      the column set;
+ *   @param variable: the index of the variable.
+ *
+ *   @return  the rows of the variable.
+ */
+
+double* columns_column(const struct column_set* set, int variable) {
+	return set->storage + (size_t)variable * set->capacity;
+}
+
+
+/**
+ * Function: columns_reset
+ * ----------------------------
+ *   empties the columns for the next batch; the compiled layout is kept.
+ *
+ *   @param set: the column set.
+ */
+
+void columns_reset(struct column_set* set) {
+	set->rows = 0;
+}
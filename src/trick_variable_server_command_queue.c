@@ -0,0 +1,489 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_command_queue.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief A thread-safe queue of commands for the Trick Variable Server.
+ *
+ * The queue is an intrusive multi-producer, single-consumer linked list: producers
+ * only exchange the head pointer, the writer owns the tail.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+
+#include<stdio.h>     //vsnprintf,...
+#include<stdarg.h>    //va_list,...
+#include<stdlib.h>    //malloc,...
+#include<string.h>    //strlen,...
+#include<errno.h>     //errno,...
+#include<limits.h>    //IOV_MAX,...
+#include<sys/uio.h>   //writev,...
+
+#include "../include/trick_variable_server_command_queue.h"
+#include "../include/trick_variable_server_trace.h"
+
+
+/**
+ * Function: new_node
+ * ----------------------------
+ *   allocates a node with room for a command of the given length plus the newline.
+ */
+
+static struct command_queue_node* new_node(size_t length, int command_class) {
+	struct command_queue_node* node = malloc(sizeof(struct command_queue_node) + length + 1);
+
+	if (node == NULL) {
+		return NULL;
+	}
+	atomic_init(&node->next, NULL);
+	node->batch_next = NULL;
+	node->command_class = (command_class > COMMAND_CLASS_NONE && command_class < COMMAND_CLASS_COUNT) ? command_class : COMMAND_CLASS_NONE;
+	node->length = length + 1;
+	node->text = (char*)(node + 1);
+	node->text[length] = '\n';
+	return node;
+}
+
+
+/**
+ * Function: push_node
+ * ----------------------------
+ *   links a node at the head of the queue. Wait-free for the producers.
+ */
+
+static void push_node(struct command_queue* queue, struct command_queue_node* node) {
+	struct command_queue_node* previous;
+
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	previous = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+	atomic_store_explicit(&previous->next, node, memory_order_release);
+	atomic_fetch_add_explicit(&queue->pending, 1, memory_order_seq_cst);
+}
+
+
+/**
+ * Function: pop_node
+ * ----------------------------
+ *   unlinks the oldest node of the queue. Must only be called by the writer.
+ *   Returns NULL when the queue is empty or a producer is halfway through a push.
+ */
+
+static struct command_queue_node* pop_node(struct command_queue* queue) {
+	struct command_queue_node* tail = queue->tail;
+	struct command_queue_node* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if (tail == &queue->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		queue->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	}
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+	if (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+		return NULL;
+	}
+	push_node(queue, &queue->stub);
+	atomic_fetch_sub_explicit(&queue->pending, 1, memory_order_relaxed);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+
+/**
+ * Function: submit_formatted
+ * ----------------------------
+ *   formats a command straight into a new node and queues it.
+ */
+
+static int submit_formatted(struct command_queue* queue, int command_class, const char* format, ...) {
+	struct command_queue_node* node;
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (length < 0) {
+		return -1;
+	}
+	node = new_node((size_t)length, command_class);
+	if (node == NULL) {
+		return -1;
+	}
+	va_start(args, format);
+	vsnprintf(node->text, (size_t)length + 1, format, args);
+	va_end(args);
+	node->text[length] = '\n';
+	push_node(queue, node);
+	return 0;
+}
+
+
+/**
+ * Function: write_batch
+ * ----------------------------
+ *   writes a batch of iovecs entirely, resuming after partial writes.
+ */
+
+static int write_batch(int socket, struct iovec* iov, int count, struct connection_metrics* metrics) {
+	int total = 0;
+	ssize_t written;
+
+	while (count > 0) {
+		TRACE_BEGIN("send");
+		written = writev(socket, iov, count < IOV_MAX ? count : IOV_MAX);
+		TRACE_END("send");
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		metrics_add(metrics, METRIC_SEND_CALLS, 1);
+		metrics_add(metrics, METRIC_BYTES_SENT, (unsigned long long)written);
+		total += (int)written;
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return total;
+}
+
+
+/**
+ * Function: command_queue_init
+ * ----------------------------
+ *   initializes an empty command queue for the given socket.
+ *
+ *   @param queue:  the queue to initialize;
+ *   @param socket: socket file descriptor.
+ *
+ *   @return  the function returns 0.
+ */
+
+int command_queue_init(struct command_queue* queue, int socket) {
+	queue->socket = socket;
+	atomic_init(&queue->stub.next, NULL);
+	queue->stub.batch_next = NULL;
+	queue->stub.command_class = COMMAND_CLASS_NONE;
+	queue->stub.length = 0;
+	queue->stub.text = NULL;
+	atomic_init(&queue->head, &queue->stub);
+	queue->tail = &queue->stub;
+	atomic_init(&queue->pending, 0);
+	atomic_flag_clear(&queue->writing);
+	queue->metrics = NULL;
+	return 0;
+}
+
+
+/**
+ * Function: command_queue_destroy
+ * ----------------------------
+ *   releases the commands still pending in the queue without sending them.
+ *
+ *   @param queue: the queue to destroy.
+ */
+
+void command_queue_destroy(struct command_queue* queue) {
+	struct command_queue_node* node;
+
+	while ((node = pop_node(queue)) != NULL) {
+		free(node);
+	}
+}
+
+
+/**
+ * Function: command_queue_submit
+ * ----------------------------
+ *   queues a command. It may be called concurrently from any thread.
+ *   A newline is automatically appended to the given command.
+ *
+ *   @param queue:         the command queue;
+ *   @param command:       the command to queue;
+ *   @param command_class: the kind of the command, @c COMMAND_CLASS_NONE if it must never be collapsed.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_submit(struct command_queue* queue, const char* command, int command_class) {
+	size_t length = strlen(command);
+	struct command_queue_node* node = new_node(length, command_class);
+
+	if (node == NULL) {
+		return -1;
+	}
+	memcpy(node->text, command, length);
+	push_node(queue, node);
+	return 0;
+}
+
+
+/**
+ * Function: send_iovecs
+ * ----------------------------
+ *   writes the first count iovecs of the queue and updates the counters.
+ */
+
+static int send_iovecs(struct command_queue* queue, int count) {
+	unsigned long long start = queue->metrics != NULL ? metrics_now() : 0;
+	int result = write_batch(queue->socket, queue->iov, count, queue->metrics);
+
+	if (queue->metrics != NULL) {
+		metrics_add(queue->metrics, METRIC_SEND_TIME, metrics_now() - start);
+		if (result >= 0) metrics_add(queue->metrics, METRIC_COMMANDS_SENT, (unsigned long long)count);
+	}
+	return result;
+}
+
+
+/**
+ * Function: command_queue_flush
+ * ----------------------------
+ *   sends all the pending commands with as few writev calls as possible.
+ *   When several commands of the same class (other than @c COMMAND_CLASS_NONE) are
+ *   pending in a run not interrupted by a @c COMMAND_CLASS_NONE command, only the last
+ *   one is sent, in its original position. A @c COMMAND_CLASS_NONE command is never
+ *   reordered with respect to the others.
+ *   Only one thread drains the queue at a time: if another thread is already writing,
+ *   the function returns 0 and the commands are sent by that thread.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns the number of bytes sent.
+ *            Otherwise, -1 is returned and errno is set to indicate the error; the commands
+ *            of the failed batch are discarded.
+ */
+
+int command_queue_flush(struct command_queue* queue) {
+	struct command_queue_node* latest[COMMAND_CLASS_COUNT];
+	struct command_queue_node* first;
+	struct command_queue_node* last;
+	struct command_queue_node* node;
+	struct command_queue_node* end;
+	int count;
+	int sent = 0;
+	int result;
+	int written;
+	int error = 0;
+
+	while (atomic_load(&queue->pending) > 0) {
+		if (atomic_flag_test_and_set(&queue->writing)) {
+			return sent;
+		}
+
+		first = last = NULL;
+		while ((node = pop_node(queue)) != NULL) {
+			atomic_fetch_sub_explicit(&queue->pending, 1, memory_order_relaxed);
+			node->batch_next = NULL;
+			if (last == NULL) first = node; else last->batch_next = node;
+			last = node;
+		}
+
+		result = 0;
+		count = 0;
+		node = first;
+		while (node != NULL && result >= 0) {
+			/* a run of collapsible commands, up to the next command that is never collapsed */
+			memset(latest, 0, sizeof(latest));
+			for (end = node; end != NULL && end->command_class != COMMAND_CLASS_NONE; end = end->batch_next) {
+				latest[end->command_class] = end;
+			}
+			while (node != NULL && result >= 0) {
+				if (node->command_class == COMMAND_CLASS_NONE || latest[node->command_class] == node) {
+					queue->iov[count].iov_base = node->text;
+					queue->iov[count].iov_len = node->length;
+					count++;
+				}
+				if (count == IOV_MAX) {
+					written = send_iovecs(queue, count);
+					result = written < 0 ? -1 : result + written;
+					count = 0;
+				}
+				if (node == end) {
+					node = node->batch_next;
+					break;
+				}
+				node = node->batch_next;
+			}
+		}
+		if (count > 0 && result >= 0) {
+			written = send_iovecs(queue, count);
+			result = written < 0 ? -1 : result + written;
+		}
+		while (first != NULL) {
+			node = first->batch_next;
+			free(first);
+			first = node;
+		}
+
+		if (result < 0) {
+			error = errno;
+		}
+		/*
+		 * The clear and the next load of pending must not be reordered: a producer
+		 * increments pending and then tries to take the flag, so with sequentially
+		 * consistent operations on both sides either it sees the flag cleared or
+		 * this thread sees its command and loops again.
+		 */
+		atomic_flag_clear(&queue->writing);
+		if (result < 0) {
+			errno = error;
+			return -1;
+		}
+		sent += result;
+	}
+	return sent;
+}
+
+
+/**
+ * Function: command_queue_set_cycle
+ * ----------------------------
+ *   queues a trick.var_cycle() command, superseding any pending one.
+ *
+ *   @param queue:  the command queue;
+ *   @param period: the period at which the Trick Variable Server sends updates.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_set_cycle(struct command_queue* queue, double period) {
+	return submit_formatted(queue, COMMAND_CLASS_CYCLE, "trick.var_cycle(%lf)", period);
+}
+
+
+/**
+ * Function: command_queue_set_copy_mode
+ * ----------------------------
+ *   queues a trick.var_set_copy_mode() command, superseding any pending one.
+ *
+ *   @param queue: the command queue;
+ *   @param mode:  the copy mode (see set_copy_mode()).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_set_copy_mode(struct command_queue* queue, int mode) {
+	return submit_formatted(queue, COMMAND_CLASS_COPY_MODE, "trick.var_set_copy_mode(%i)", mode);
+}
+
+
+/**
+ * Function: command_queue_pause
+ * ----------------------------
+ *   queues a trick.var_pause() command. Pause and unpause are never collapsed
+ *   because they usually bracket other commands.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_pause(struct command_queue* queue) {
+	return command_queue_submit(queue, "trick.var_pause()", COMMAND_CLASS_NONE);
+}
+
+
+/**
+ * Function: command_queue_unpause
+ * ----------------------------
+ *   queues a trick.var_unpause() command.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_unpause(struct command_queue* queue) {
+	return command_queue_submit(queue, "trick.var_unpause()", COMMAND_CLASS_NONE);
+}
+
+
+/**
+ * Function: command_queue_add_variable
+ * ----------------------------
+ *   queues a trick.var_add() command.
+ *
+ *   @param queue:         the command queue;
+ *   @param variable_name: name of the variable to be observed.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_add_variable(struct command_queue* queue, const char* variable_name) {
+	return submit_formatted(queue, COMMAND_CLASS_NONE, "trick.var_add(\"%s\")", variable_name);
+}
+
+
+/**
+ * Function: command_queue_remove_variable
+ * ----------------------------
+ *   queues a trick.var_remove() command.
+ *
+ *   @param queue:         the command queue;
+ *   @param variable_name: name of the variable to stop observing.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_remove_variable(struct command_queue* queue, const char* variable_name) {
+	return submit_formatted(queue, COMMAND_CLASS_NONE, "trick.var_remove(\"%s\")", variable_name);
+}
+
+
+/**
+ * Function: command_queue_clear
+ * ----------------------------
+ *   queues a trick.var_clear() command.
+ *
+ *   @param queue: the command queue.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int command_queue_clear(struct command_queue* queue) {
+	return command_queue_submit(queue, "trick.var_clear()", COMMAND_CLASS_NONE);
+}
@@ -0,0 +1,253 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_command_writer.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Streaming writer of commands of any length for the Trick Variable Server.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+
+#include<string.h>        //memcpy,...
+#include<errno.h>         //errno,...
+#include<sys/socket.h>    //sendmsg,...
+
+#include "../include/trick_variable_server_command_writer.h"
+#include "../include/trick_variable_server_trace.h"
+
+
+/**
+ * Function: command_writer_init
+ * ----------------------------
+ *   initializes a writer.
+ *
+ *   @param writer: the writer;
+ *   @param socket: socket file descriptor.
+ */
+
+void command_writer_init(struct command_writer* writer, int socket) {
+	writer->socket = socket;
+	writer->used = 0;
+	writer->count = 0;
+	writer->pending = 0;
+	writer->commands = 0;
+	writer->bytes = 0;
+	writer->writes = 0;
+	writer->metrics = NULL;
+}
+
+
+/**
+ * Function: command_writer_flush
+ * ----------------------------
+ *   writes everything pending with as few sendmsg calls as possible, resuming after
+ *   partial writes. The buffer and the scatter-gather list are empty afterwards.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns the number of bytes written.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+long command_writer_flush(struct command_writer* writer) {
+	struct msghdr message;
+	struct iovec* iov = writer->iov;
+	int count = writer->count;
+	long total = 0;
+	ssize_t sent;
+	unsigned long long start = writer->metrics != NULL ? metrics_now() : 0;
+
+	memset(&message, 0, sizeof(message));
+	while (count > 0) {
+		message.msg_iov = iov;
+		message.msg_iovlen = count;
+		TRACE_BEGIN("send");
+		sent = sendmsg(writer->socket, &message, MSG_NOSIGNAL);
+		TRACE_END("send");
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			writer->count = 0;
+			writer->used = 0;
+			writer->pending = 0;
+			return -1;
+		}
+		writer->writes++;
+		metrics_add(writer->metrics, METRIC_SEND_CALLS, 1);
+		total += sent;
+		while (count > 0 && (size_t)sent >= iov->iov_len) {
+			sent -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + sent;
+			iov->iov_len -= sent;
+		}
+	}
+	writer->bytes += total;
+	if (writer->metrics != NULL) {
+		metrics_add(writer->metrics, METRIC_BYTES_SENT, (unsigned long long)total);
+		metrics_add(writer->metrics, METRIC_SEND_TIME, metrics_now() - start);
+	}
+	writer->count = 0;
+	writer->used = 0;
+	writer->pending = 0;
+	return total;
+}
+
+
+/**
+ * Function: command_writer_append
+ * ----------------------------
+ *   appends a piece of a command. A small piece is copied into the buffer, extending the
+ *   last entry of the scatter-gather list when it already ends there; a large piece is only
+ *   referenced. The writer flushes first when the piece does not fit.
+ *
+ *   @param writer: the writer;
+ *   @param data:   the bytes to append; if length >= COMMAND_WRITER_COPY_LIMIT they are
+ *                  not copied and must stay valid until the next flush;
+ *   @param length: the number of bytes.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_append(struct command_writer* writer, const char* data, size_t length) {
+	struct iovec* last;
+
+	if (length == 0) {
+		return 0;
+	}
+	if (length >= COMMAND_WRITER_COPY_LIMIT) {
+		if (writer->count == COMMAND_WRITER_IOVECS && command_writer_flush(writer) < 0) {
+			return -1;
+		}
+		writer->iov[writer->count].iov_base = (char*)data;
+		writer->iov[writer->count].iov_len = length;
+		writer->count++;
+		writer->pending += length;
+		return 0;
+	}
+
+	if (writer->used + length > COMMAND_WRITER_BUFFER_SIZE && command_writer_flush(writer) < 0) {
+		return -1;
+	}
+	last = writer->count > 0 ? &writer->iov[writer->count - 1] : NULL;
+	if (last == NULL || (char*)last->iov_base + last->iov_len != writer->buffer + writer->used) {
+		if (writer->count == COMMAND_WRITER_IOVECS) {
+			if (command_writer_flush(writer) < 0) {
+				return -1;
+			}
+		}
+		last = &writer->iov[writer->count++];
+		last->iov_base = writer->buffer + writer->used;
+		last->iov_len = 0;
+	}
+	memcpy(writer->buffer + writer->used, data, length);
+	writer->used += length;
+	last->iov_len += length;
+	writer->pending += length;
+	return 0;
+}
+
+
+/**
+ * Function: command_writer_append_string
+ * ----------------------------
+ *   appends a NUL-terminated piece of a command.
+ *
+ *   @param writer: the writer;
+ *   @param text:   the text to append.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_append_string(struct command_writer* writer, const char* text) {
+	return command_writer_append(writer, text, strlen(text));
+}
+
+
+/**
+ * Function: command_writer_end
+ * ----------------------------
+ *   terminates the current command with a newline.
+ *
+ *   @param writer: the writer.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_end(struct command_writer* writer) {
+	if (command_writer_append(writer, "\n", 1) < 0) {
+		return -1;
+	}
+	writer->commands++;
+	metrics_add(writer->metrics, METRIC_COMMANDS_SENT, 1);
+	return 0;
+}
+
+
+/**
+ * Function: command_writer_command
+ * ----------------------------
+ *   appends a whole command and terminates it.
+ *
+ *   @param writer:  the writer;
+ *   @param command: the command, without the newline.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_command(struct command_writer* writer, const char* command) {
+	if (command_writer_append_string(writer, command) < 0) {
+		return -1;
+	}
+	return command_writer_end(writer);
+}
+
+
+/**
+ * Function: command_writer_encoded
+ * ----------------------------
+ *   appends commands already encoded, each terminated by its newline, and counts them.
+ *
+ *   @param writer: the writer;
+ *   @param data:   the bytes of the commands, newlines included;
+ *   @param length: the number of bytes;
+ *   @param count:  the number of commands in the bytes.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error of the flush.
+ */
+
+int command_writer_encoded(struct command_writer* writer, const char* data, size_t length, unsigned long count) {
+	if (command_writer_append(writer, data, length) < 0) {
+		return -1;
+	}
+	writer->commands += count;
+	metrics_add(writer->metrics, METRIC_COMMANDS_SENT, count);
+	return 0;
+}
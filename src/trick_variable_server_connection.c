@@ -33,9 +33,14 @@
 #include<string.h>    //strlen,...
 #include<sys/socket.h>    //socket,...
 #include<arpa/inet.h> //inet_addr,...
+#include<errno.h>     //errno,...
+#include<sys/uio.h>   //iovec,...
 
 #include "../include/trick_variable_server_connection.h"
 
+/** the largest number of pieces of a command sent by send_pieces() */
+#define MAXIMUM_PIECES 8
+
 /**
  * Function: create_default_socket
  * ----------------------------
@@ -108,11 +113,58 @@ int connect_to_variable_server(int socket, char* host, int port) {
 }
 
 
+/**
+ * Function: send_pieces
+ * ----------------------------
+ *   sends a command made of the given pieces, followed by a newline, with a single
+ *   scatter-gather write (resumed after partial writes), without copying them.
+ */
+
+static int send_pieces(int socket, const char* const* pieces, int count) {
+	struct iovec iov[MAXIMUM_PIECES + 1];
+	struct msghdr message;
+	ssize_t sent;
+	int total = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = (char*)pieces[i];
+		iov[i].iov_len = strlen(pieces[i]);
+	}
+	iov[count].iov_base = "\n";
+	iov[count].iov_len = 1;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = iov;
+	message.msg_iovlen = count + 1;
+
+	while (message.msg_iovlen > 0) {
+		sent = sendmsg(socket, &message, 0);
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		total += sent;
+		while (message.msg_iovlen > 0 && (size_t)sent >= message.msg_iov->iov_len) {
+			sent -= message.msg_iov->iov_len;
+			message.msg_iov++;
+			message.msg_iovlen--;
+		}
+		if (message.msg_iovlen > 0) {
+			message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + sent;
+			message.msg_iov->iov_len -= sent;
+		}
+	}
+	return total;
+}
+
+
 /**
  * Function: send_command_to_variable_server
  * ----------------------------
  *   sends the given command and any commands to the Trick Variable Server
  *   A newline is automatically appended to the given command.
+ *   The command and the newline are sent with a single scatter-gather write, without
+ *   being copied, so there is no limit on the length of the command.
  *   
  *   @param socket:  socket file descriptor; 
  *   @param command: the comand to send. 
@@ -122,16 +174,9 @@ int connect_to_variable_server(int socket, char* host, int port) {
  */
 
 int send_command_to_variable_server(int socket, char* command) {
-        char cmd[512];
+	const char* pieces[1] = { command };
 
-	if (sizeof(cmd)<strlen(command)+2) {
-		return -1;	
-	}
-	else {
-		strncpy(cmd, command, sizeof(cmd));
-		strncat(cmd, "\n", (sizeof(cmd) - strlen(cmd)-1)); 
-		return send(socket , cmd , strlen(cmd) , 0);
-	}
+	return send_pieces(socket, pieces, 1);
 }
 
 
@@ -266,6 +311,7 @@ int unpause(int socket) {
  * Function: add_variable_to_server
  * ----------------------------
  *   adds the named variable to be observed through the Trick Variable Server.
+ *   The name is sent without being copied, so there is no limit on its length.
  *
  *   @param socket:        socket file descriptor;
  *   @param variable_name: name of the variable to be observed.  
@@ -275,25 +321,13 @@ int unpause(int socket) {
  */
 
 int add_variable_to_server(int socket, char* variable_name) {
+	const char* pieces[3] = { "trick.var_add(\"", variable_name, "\")" };
 
-
-	char  cmd[512];
-        const char* prefix="trick.var_add(\"";
-        const char* suffix="\")"; 
-
-	if (sizeof(cmd)<(strlen(prefix)+strlen(variable_name)+strlen(suffix)+1)) {
-		return -1;	
+	if (send_pieces(socket, pieces, 3)<0) {
+		return -1;
 	}
 	else {
-		strncpy(cmd, prefix, sizeof(cmd));
-		strncat(cmd, variable_name, (sizeof(cmd) - strlen(cmd)-1));
-                strncat(cmd, suffix, (sizeof(cmd) - strlen(cmd)-1));
-		if (send_command_to_variable_server(socket,cmd)<0) {
-			return -1;
-		}
-		else {
-			return 0;
-		}
+		return 0;
 	}
 }
 
@@ -313,28 +347,13 @@ int add_variable_to_server(int socket, char* variable_name) {
  */
 
 int add_variable_to_sever_with_units(int socket, char* variable_name, char* units) {
+	const char* pieces[5] = { "trick.var_add(\"", variable_name, "\", \"", units, "\")" };
 
-
-	char  cmd[512];
-        const char* prefix="trick.var_add(\"";
-	const char* infix="\", \"";
-        const char* suffix="\")"; 
-
-	if (sizeof(cmd)<(strlen(prefix)+strlen(variable_name)+strlen(infix)+strlen(units)+strlen(suffix)+1)) {
-		return -1;	
+	if (send_pieces(socket, pieces, 5)<0) {
+		return -1;
 	}
 	else {
-		strncpy(cmd, prefix, sizeof(cmd));
-		strncat(cmd, variable_name, (sizeof(cmd) - strlen(cmd)-1));
-		strncat(cmd, infix, (sizeof(cmd) - strlen(cmd)-1));
-		strncat(cmd, units, (sizeof(cmd) - strlen(cmd)-1));
-                strncat(cmd, suffix, (sizeof(cmd) - strlen(cmd)-1));
-		if (send_command_to_variable_server(socket,cmd)<0) {
-			return -1;
-		}
-		else {
-			return 0;
-		}
+		return 0;
 	}
 }
 
@@ -343,6 +362,7 @@ int add_variable_to_sever_with_units(int socket, char* variable_name, char* unit
  * Function: remove_variable_from_server
  * ----------------------------
  *   removes the named variable observed through the Trick Variable Server.
+ *   The name is sent without being copied, so there is no limit on its length.
  *
  *   @param socket:          socket file descriptor;
  *   @param variable_name:   name of the variable to stop observing.  
@@ -352,25 +372,13 @@ int add_variable_to_sever_with_units(int socket, char* variable_name, char* unit
  */
 
 int remove_variable_from_server(int socket, char* variable_name) {
+	const char* pieces[3] = { "trick.var_remove(\"", variable_name, "\")" };
 
-
-	char  cmd[512];
-        const char* prefix="trick.var_remove(\"";
-        const char* suffix="\")"; 
-
-	if (sizeof(cmd)<(strlen(prefix)+strlen(variable_name)+strlen(suffix)+1)) {
-		return -1;	
+	if (send_pieces(socket, pieces, 3)<0) {
+		return -1;
 	}
 	else {
-		strncpy(cmd, prefix, sizeof(cmd));
-		strncat(cmd, variable_name, (sizeof(cmd) - strlen(cmd)-1));
-                strncat(cmd, suffix, (sizeof(cmd) - strlen(cmd)-1));
-		if (send_command_to_variable_server(socket,cmd)<0) {
-			return -1;
-		}
-		else {
-			return 0;
-		}
+		return 0;
 	}
 }
 
@@ -554,8 +562,7 @@ int close(int socket) {
 		return -1;
 	}
 	else {
-		close(socket);		
-		return 0;
+		return close_socket(socket);
 	}
 }
 
@@ -690,24 +697,13 @@ int set_debug_level(int socket, int level) {
  */
 
 int set_client_tag(int socket, char* tag) {
+	const char* pieces[3] = { "trick.var_set_client_tag(\"", tag, "\")" };
 
-	char  cmd[512];
-        const char* prefix="trick.var_set_client_tag(\"";
-        const char* suffix="\")"; 
-
-	if (sizeof(cmd)<(strlen(prefix)+strlen(tag)+strlen(suffix)+1)) {
-		return -1;	
+	if (send_pieces(socket, pieces, 3)<0) {
+		return -1;
 	}
 	else {
-		strncpy(cmd, prefix, sizeof(cmd));
-		strncat(cmd, tag, (sizeof(cmd) - strlen(cmd)-1));
-                strncat(cmd, suffix, (sizeof(cmd) - strlen(cmd)-1));
-		if (send_command_to_variable_server(socket,cmd)<0) {
-			return -1;
-		}
-		else {
-			return 0;
-		}
+		return 0;
 	}
 }
 
@@ -0,0 +1,270 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_control.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Acknowledged run and freeze of the simulation.
+ */
+
+
+#include<stdlib.h>        //strtol,...
+#include<string.h>        //memset,...
+#include<errno.h>         //errno,...
+#include<time.h>          //clock_gettime,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_control.h"
+
+
+/**
+ * Function: monotonic_time
+ * ----------------------------
+ *   the current CLOCK_MONOTONIC time in seconds.
+ */
+
+static double monotonic_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: parse_mode
+ * ----------------------------
+ *   reads the mode from an ASCII variable message ("0\t<mode>").
+ *
+ *   @return  the mode, -1 if the message is not a variable message.
+ */
+
+static int parse_mode(const struct receiver_frame* frame) {
+	const char* value;
+
+	if (frame->message_type != 0) {
+		return -1;
+	}
+	value = memchr(frame->data, '\t', frame->length);
+	if (value == NULL) {
+		return -1;
+	}
+	return (int)strtol(value + 1, NULL, 10);
+}
+
+
+/**
+ * Function: wait_mode
+ * ----------------------------
+ *   reads the messages of the session until the mode is observed or the deadline expires.
+ *   A deadline in the past only consumes the messages already received.
+ */
+
+static int wait_mode(struct control* control, int mode, const struct timespec* deadline) {
+	struct receiver_frame frame;
+	int result, observed;
+
+	for (;;) {
+		result = receiver_wait_for_frame(&control->session.receiver, deadline, 0, &frame);
+		if (result < 0) {
+			return -1;
+		}
+		if (result == 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		observed = parse_mode(&frame);
+		if (observed >= 0) {
+			control->mode = observed;
+		}
+		if (control->mode == mode) {
+			return 0;
+		}
+	}
+}
+
+
+/**
+ * Function: deadline_after
+ * ----------------------------
+ *   the absolute CLOCK_MONOTONIC time some seconds from now; NULL if seconds is 0.
+ */
+
+static const struct timespec* deadline_after(double seconds, struct timespec* deadline) {
+	long nanoseconds;
+
+	if (seconds <= 0.0) {
+		return NULL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += (time_t)seconds;
+	nanoseconds = deadline->tv_nsec + (long)((seconds - (double)(time_t)seconds) * 1.0e9);
+	deadline->tv_sec += nanoseconds / 1000000000L;
+	deadline->tv_nsec = nanoseconds % 1000000000L;
+	return deadline;
+}
+
+
+/**
+ * Function: transition
+ * ----------------------------
+ *   sends a command and waits for the mode it leads to.
+ */
+
+static int transition(struct control* control, const char* command, int mode, double timeout) {
+	struct timespec now, deadline;
+	double start;
+
+	/* the messages already received tell the mode before the command */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (wait_mode(control, -1, &now) < 0 && errno != ETIMEDOUT) {
+		return -1;
+	}
+	start = monotonic_time();
+	if (send_command_to_variable_server(control->session.socket, (char*)command) < 0) {
+		return -1;
+	}
+	if (control->mode == mode) {
+		control->latency = 0.0;
+		return 0;
+	}
+	if (wait_mode(control, mode, deadline_after(timeout, &deadline)) < 0) {
+		return -1;
+	}
+	control->latency = monotonic_time() - start;
+	return 0;
+}
+
+
+/**
+ * Function: control_open
+ * ----------------------------
+ *   opens the session watching the execution mode and reads the current one.
+ *
+ *   @param control: the control;
+ *   @param host:    host IPv4 address of the Trick Variable Server;
+ *   @param port:    service port number;
+ *   @param cycle:   period of the mode updates in seconds, 0 for CONTROL_DEFAULT_CYCLE;
+ *   @param timeout: seconds to wait for the first mode, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int control_open(struct control* control, char* host, int port, double cycle, double timeout) {
+	static char* variables[1] = { CONTROL_MODE_VARIABLE };
+	struct session_config config;
+
+	memset(control, 0, sizeof(struct control));
+	memset(&config, 0, sizeof(config));
+	config.client_tag = "control";
+	config.format = SESSION_ASCII;
+	config.cycle = cycle > 0.0 ? cycle : CONTROL_DEFAULT_CYCLE;
+	config.copy_mode = -1;
+	config.variables = variables;
+	config.count = 1;
+	config.timeout = timeout;
+	config.receive_buffer = 4096;
+	if (session_start(&control->session, host, port, &config) < 0) {
+		return -1;
+	}
+	control->mode = parse_mode(&control->session.first_frame);
+	return 0;
+}
+
+
+/**
+ * Function: control_close
+ * ----------------------------
+ *   closes the session.
+ *
+ *   @param control: the control.
+ */
+
+void control_close(struct control* control) {
+	session_close(&control->session);
+}
+
+
+/**
+ * Function: control_run
+ * ----------------------------
+ *   sends trick.exec_run() and waits until the simulation is in run mode.
+ *   If it already is, the function returns at once with a latency of 0.
+ *
+ *   @param control: the control;
+ *   @param timeout: seconds to wait for the transition, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0 and control->latency holds
+ *            the transition latency. Otherwise, -1 is returned and errno is set to indicate
+ *            the error, @c ETIMEDOUT if the transition was not observed in time.
+ */
+
+int control_run(struct control* control, double timeout) {
+	return transition(control, "trick.exec_run()", CONTROL_MODE_RUN, timeout);
+}
+
+
+/**
+ * Function: control_freeze
+ * ----------------------------
+ *   sends trick.exec_freeze() and waits until the simulation is in freeze mode.
+ *   If it already is, the function returns at once with a latency of 0.
+ *
+ *   @param control: the control;
+ *   @param timeout: seconds to wait for the transition, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0 and control->latency holds
+ *            the transition latency. Otherwise, -1 is returned and errno is set to indicate
+ *            the error, @c ETIMEDOUT if the transition was not observed in time.
+ */
+
+int control_freeze(struct control* control, double timeout) {
+	return transition(control, "trick.exec_freeze()", CONTROL_MODE_FREEZE, timeout);
+}
+
+
+/**
+ * Function: control_wait_mode
+ * ----------------------------
+ *   waits until the simulation is in the given mode, without sending any command.
+ *
+ *   @param control: the control;
+ *   @param mode:    one of enum control_mode;
+ *   @param timeout: seconds to wait, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ETIMEDOUT if the mode was not observed in time.
+ */
+
+int control_wait_mode(struct control* control, int mode, double timeout) {
+	struct timespec now, deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (wait_mode(control, -1, &now) < 0 && errno != ETIMEDOUT) {
+		return -1;
+	}
+	if (control->mode == mode) {
+		return 0;
+	}
+	return wait_mode(control, mode, deadline_after(timeout, &deadline));
+}
@@ -0,0 +1,842 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_decoder.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Decoding of the binary messages of the Trick Variable Server.
+ *
+ * Values are decoded in the byte order of the client host, which must match the one
+ * of the simulation host.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation of the message formats.
+ */
+
+
+#include<stdlib.h>    //malloc,...
+#include<string.h>    //memcpy,...
+#include<stdint.h>    //int64_t,...
+#include<math.h>      //NAN,...
+#include<errno.h>     //errno,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_command_writer.h"
+#include "../include/trick_variable_server_decoder.h"
+#include "../include/trick_variable_server_metrics.h"
+#include "../include/trick_variable_server_trace.h"
+
+#define DECODE_KERNEL_OPS     0   /* one converter call per operation */
+#define DECODE_KERNEL_DOUBLES 1   /* only doubles at a constant stride */
+
+#define BINARY_HEADER_SIZE    12
+
+
+/*
+ * Converters: one per (representation, size), selected once when the plan is compiled.
+ */
+
+static double decode_int8(const unsigned char* v)   { int8_t x;   memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_uint8(const unsigned char* v)  { uint8_t x;  memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_int16(const unsigned char* v)  { int16_t x;  memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_uint16(const unsigned char* v) { uint16_t x; memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_int32(const unsigned char* v)  { int32_t x;  memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_uint32(const unsigned char* v) { uint32_t x; memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_int64(const unsigned char* v)  { int64_t x;  memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_uint64(const unsigned char* v) { uint64_t x; memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_float(const unsigned char* v)  { float x;    memcpy(&x, v, sizeof(x)); return (double)x; }
+static double decode_double(const unsigned char* v) { double x;   memcpy(&x, v, sizeof(x)); return x; }
+static double decode_none(const unsigned char* v)   { (void)v; return NAN; }
+
+
+/**
+ * Function: select_decoder
+ * ----------------------------
+ *   returns the converter of a value of the given Trick type and size.
+ */
+
+static decode_function select_decoder(int type, unsigned int size) {
+	switch (type) {
+	case TRICK_TYPE_CHARACTER:
+	case TRICK_TYPE_SHORT:
+	case TRICK_TYPE_INTEGER:
+	case TRICK_TYPE_LONG:
+	case TRICK_TYPE_LONG_LONG:
+	case TRICK_TYPE_BITFIELD:
+	case TRICK_TYPE_ENUMERATED:
+		if (size == 1) return decode_int8;
+		if (size == 2) return decode_int16;
+		if (size == 4) return decode_int32;
+		if (size == 8) return decode_int64;
+		return decode_none;
+	case TRICK_TYPE_UNSIGNED_CHARACTER:
+	case TRICK_TYPE_UNSIGNED_SHORT:
+	case TRICK_TYPE_UNSIGNED_INTEGER:
+	case TRICK_TYPE_UNSIGNED_LONG:
+	case TRICK_TYPE_UNSIGNED_LONG_LONG:
+	case TRICK_TYPE_UNSIGNED_BITFIELD:
+	case TRICK_TYPE_BOOLEAN:
+	case TRICK_TYPE_WCHAR:
+		if (size == 1) return decode_uint8;
+		if (size == 2) return decode_uint16;
+		if (size == 4) return decode_uint32;
+		if (size == 8) return decode_uint64;
+		return decode_none;
+	case TRICK_TYPE_FLOAT:
+	case TRICK_TYPE_DOUBLE:
+		if (size == 4) return decode_float;
+		if (size == 8) return decode_double;
+		return decode_none;
+	default:
+		return decode_none;
+	}
+}
+
+
+/**
+ * Function: read_u32
+ * ----------------------------
+ *   reads a 4-byte field of the message.
+ */
+
+static unsigned int read_u32(const unsigned char* data) {
+	unsigned int value;
+
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+
+/**
+ * Function: decode_frame_generic
+ * ----------------------------
+ *   decodes a binary variable message walking it field by field and switching on
+ *   each type code. This is what a decode plan avoids; it is kept for messages whose
+ *   layout is not fixed and as a reference.
+ *
+ *   @param frame:  the whole message;
+ *   @param length: the length of the message;
+ *   @param names:  1 if the message carries the variable names;
+ *   @param values: filled with the values (NaN for the non-numeric ones);
+ *   @param count:  the number of entries in values.
+ *
+ *   @return  the number of variables decoded. If the message is not valid,
+ *            -1 is returned and errno is set to @c EPROTO.
+ */
+
+int decode_frame_generic(const unsigned char* frame, unsigned int length, int names, double* values, int count) {
+	unsigned int offset = BINARY_HEADER_SIZE;
+	unsigned int variables, size, i;
+	const unsigned char* v;
+	int type;
+
+	if (length < BINARY_HEADER_SIZE) {
+		errno = EPROTO;
+		return -1;
+	}
+	variables = read_u32(frame + 8);
+	for (i = 0; i < variables; i++) {
+		if (names) {
+			if (length - offset < 4 || length - offset - 4 < read_u32(frame + offset)) {
+				errno = EPROTO;
+				return -1;
+			}
+			offset += 4 + read_u32(frame + offset);
+		}
+		if (length - offset < 8) {
+			errno = EPROTO;
+			return -1;
+		}
+		type = (int)read_u32(frame + offset);
+		size = read_u32(frame + offset + 4);
+		offset += 8;
+		if (length - offset < size) {
+			errno = EPROTO;
+			return -1;
+		}
+		v = frame + offset;
+		offset += size;
+		if ((int)i >= count) {
+			continue;
+		}
+		switch (type) {
+		case TRICK_TYPE_DOUBLE:
+			values[i] = size == 8 ? decode_double(v) : size == 4 ? decode_float(v) : NAN;
+			break;
+		case TRICK_TYPE_FLOAT:
+			values[i] = size == 4 ? decode_float(v) : size == 8 ? decode_double(v) : NAN;
+			break;
+		case TRICK_TYPE_CHARACTER:
+		case TRICK_TYPE_SHORT:
+		case TRICK_TYPE_INTEGER:
+		case TRICK_TYPE_LONG:
+		case TRICK_TYPE_LONG_LONG:
+		case TRICK_TYPE_BITFIELD:
+		case TRICK_TYPE_ENUMERATED:
+			switch (size) {
+			case 1: values[i] = decode_int8(v); break;
+			case 2: values[i] = decode_int16(v); break;
+			case 4: values[i] = decode_int32(v); break;
+			case 8: values[i] = decode_int64(v); break;
+			default: values[i] = NAN;
+			}
+			break;
+		case TRICK_TYPE_UNSIGNED_CHARACTER:
+		case TRICK_TYPE_UNSIGNED_SHORT:
+		case TRICK_TYPE_UNSIGNED_INTEGER:
+		case TRICK_TYPE_UNSIGNED_LONG:
+		case TRICK_TYPE_UNSIGNED_LONG_LONG:
+		case TRICK_TYPE_UNSIGNED_BITFIELD:
+		case TRICK_TYPE_BOOLEAN:
+		case TRICK_TYPE_WCHAR:
+			switch (size) {
+			case 1: values[i] = decode_uint8(v); break;
+			case 2: values[i] = decode_uint16(v); break;
+			case 4: values[i] = decode_uint32(v); break;
+			case 8: values[i] = decode_uint64(v); break;
+			default: values[i] = NAN;
+			}
+			break;
+		default:
+			values[i] = NAN;
+		}
+	}
+	return (int)variables;
+}
+
+
+/**
+ * Function: decode_plan_compile
+ * ----------------------------
+ *   compiles the decode plan of the given message layout: the offset, converter and
+ *   slot of every variable. Plans made only of doubles at a constant distance (the usual
+ *   set_binary_no_names() telemetry) get a specialized loop with no indirect calls.
+ *   Layouts containing strings are not fixed and cannot be compiled.
+ *
+ *   @param plan:   the plan (initialized to zero the first time);
+ *   @param frame:  a message with the layout to compile;
+ *   @param length: the length of the message;
+ *   @param names:  1 if the message carries the variable names.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error
+ *            (@c EPROTO if the message is not valid, @c ENOTSUP if its layout is not fixed).
+ */
+
+int decode_plan_compile(struct decode_plan* plan, const unsigned char* frame, unsigned int length, int names) {
+	unsigned int offset = BINARY_HEADER_SIZE;
+	unsigned int variables, size, i;
+	struct decode_op* ops;
+	int type;
+
+	plan->valid = 0;
+	if (length < BINARY_HEADER_SIZE) {
+		errno = EPROTO;
+		return -1;
+	}
+	variables = read_u32(frame + 8);
+	if (variables > (length - BINARY_HEADER_SIZE) / 8) {
+		errno = EPROTO;
+		return -1;
+	}
+	if ((int)variables > plan->capacity) {
+		ops = realloc(plan->ops, sizeof(struct decode_op) * (variables > 0 ? variables : 1));
+		if (ops == NULL) {
+			return -1;
+		}
+		plan->ops = ops;
+		plan->capacity = (int)variables;
+	}
+
+	plan->kernel = DECODE_KERNEL_DOUBLES;
+	plan->stride = 0;
+	for (i = 0; i < variables; i++) {
+		if (names) {
+			if (length - offset < 4 || length - offset - 4 < read_u32(frame + offset)) {
+				errno = EPROTO;
+				return -1;
+			}
+			offset += 4 + read_u32(frame + offset);
+		}
+		if (length - offset < 8) {
+			errno = EPROTO;
+			return -1;
+		}
+		type = (int)read_u32(frame + offset);
+		size = read_u32(frame + offset + 4);
+		offset += 8;
+		if (length - offset < size) {
+			errno = EPROTO;
+			return -1;
+		}
+		if (type == TRICK_TYPE_STRING || type == TRICK_TYPE_WSTRING) {
+			errno = ENOTSUP;
+			return -1;
+		}
+		plan->ops[i].offset = offset;
+		plan->ops[i].size = size;
+		plan->ops[i].type = type;
+		plan->ops[i].slot = (int)i;
+		plan->ops[i].decode = select_decoder(type, size);
+		if (plan->ops[i].decode != decode_double) {
+			plan->kernel = DECODE_KERNEL_OPS;
+		}
+		if (i == 1) {
+			plan->stride = offset - plan->ops[0].offset;
+		}
+		else if (i > 1 && offset - plan->ops[i - 1].offset != plan->stride) {
+			plan->kernel = DECODE_KERNEL_OPS;
+		}
+		offset += size;
+	}
+	if (offset != length) {
+		errno = EPROTO;
+		return -1;
+	}
+	if (plan->kernel == DECODE_KERNEL_OPS) {
+		plan->stride = 0;
+	}
+
+	plan->names = names;
+	plan->count = (int)variables;
+	plan->frame_length = length;
+	plan->generation++;
+	plan->valid = 1;
+	return 0;
+}
+
+
+/**
+ * Function: decode_plan_matches
+ * ----------------------------
+ *   tells whether a message has the layout a plan was compiled for: same length, same
+ *   number of variables and, variable by variable, same type code and size. Two sets of
+ *   the same length may differ only in the types (e.g. a double replaced by a long).
+ *
+ *   @param plan:   the plan;
+ *   @param frame:  the message;
+ *   @param length: the length of the message.
+ *
+ *   @return  1 if the plan can decode the message, 0 otherwise.
+ */
+
+int decode_plan_matches(const struct decode_plan* plan, const unsigned char* frame, unsigned int length) {
+	const struct decode_op* op;
+	int i;
+
+	if (!plan->valid || length != plan->frame_length || read_u32(frame + 8) != (unsigned int)plan->count) {
+		return 0;
+	}
+	for (i = 0, op = plan->ops; i < plan->count; i++, op++) {
+		if (read_u32(frame + op->offset - 8) != (unsigned int)op->type || read_u32(frame + op->offset - 4) != op->size) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Function: decode_plan_decode
+ * ----------------------------
+ *   decodes a message with a compiled plan. Only the length and the number of
+ *   variables of the message are checked; the type codes are not looked at.
+ *
+ *   @param plan:   the compiled plan;
+ *   @param frame:  the message;
+ *   @param length: the length of the message;
+ *   @param values: filled with the values, one slot per variable.
+ *
+ *   @return  the number of variables decoded. If the message does not match the layout of the plan,
+ *            -1 is returned and errno is set to @c EPROTO.
+ */
+
+int decode_plan_decode(const struct decode_plan* plan, const unsigned char* frame, unsigned int length, double* values) {
+	const struct decode_op* op;
+	const struct decode_op* last;
+	const unsigned char* value;
+	int i;
+
+	if (!plan->valid || length != plan->frame_length || read_u32(frame + 8) != (unsigned int)plan->count) {
+		errno = EPROTO;
+		return -1;
+	}
+	if (plan->kernel == DECODE_KERNEL_DOUBLES && plan->count > 0) {
+		value = frame + plan->ops[0].offset;
+		for (i = 0; i < plan->count; i++, value += plan->stride) {
+			memcpy(&values[i], value, sizeof(double));
+		}
+	}
+	else {
+		last = plan->ops + plan->count;
+		for (op = plan->ops; op < last; op++) {
+			values[op->slot] = op->decode(frame + op->offset);
+		}
+	}
+	return plan->count;
+}
+
+
+/**
+ * Function: decode_plan_destroy
+ * ----------------------------
+ *   releases the operations of a plan.
+ *
+ *   @param plan: the plan.
+ */
+
+void decode_plan_destroy(struct decode_plan* plan) {
+	free(plan->ops);
+	plan->ops = NULL;
+	plan->capacity = 0;
+	plan->count = 0;
+	plan->valid = 0;
+}
+
+
+/**
+ * Function: subscription_init
+ * ----------------------------
+ *   initializes an empty subscription.
+ *
+ *   @param subscription: the subscription;
+ *   @param socket:       socket file descriptor;
+ *   @param names:        1 if the server sends the names (set_binary()), 0 otherwise (set_binary_no_names()).
+ */
+
+void subscription_init(struct subscription* subscription, int socket, int names) {
+	memset(subscription, 0, sizeof(struct subscription));
+	subscription->socket = socket;
+	subscription->names = names;
+}
+
+
+/**
+ * Function: subscription_destroy
+ * ----------------------------
+ *   releases the subscription (the variables stay subscribed on the server).
+ *
+ *   @param subscription: the subscription.
+ */
+
+void subscription_destroy(struct subscription* subscription) {
+	int i;
+
+	for (i = 0; i < subscription->count; i++) {
+		free(subscription->variables[i]);
+	}
+	free(subscription->variables);
+	subscription->variables = NULL;
+	subscription->count = 0;
+	subscription->capacity = 0;
+	decode_plan_destroy(&subscription->plan);
+}
+
+
+/**
+ * Function: record_variable
+ * ----------------------------
+ *   appends a variable name to the subscription and invalidates the plan.
+ */
+
+static int record_variable(struct subscription* subscription, const char* variable_name) {
+	char** variables;
+	char* copy;
+	int capacity;
+
+	if (subscription->count == subscription->capacity) {
+		capacity = subscription->capacity > 0 ? subscription->capacity * 2 : 16;
+		variables = realloc(subscription->variables, sizeof(char*) * capacity);
+		if (variables == NULL) {
+			return -1;
+		}
+		subscription->variables = variables;
+		subscription->capacity = capacity;
+	}
+	copy = strdup(variable_name);
+	if (copy == NULL) {
+		return -1;
+	}
+	subscription->variables[subscription->count] = copy;
+	subscription->plan.valid = 0;
+	subscription->unsupported = 0;
+	subscription->checked = 0;
+	return subscription->count++;
+}
+
+
+/**
+ * Function: subscription_record
+ * ----------------------------
+ *   records a variable already subscribed on the server (e.g. by session_start()),
+ *   without sending anything.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_record(struct subscription* subscription, const char* variable_name) {
+	return record_variable(subscription, variable_name);
+}
+
+
+/**
+ * Function: subscription_add
+ * ----------------------------
+ *   adds a variable with add_variable_to_server() and records it.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to be observed.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_add(struct subscription* subscription, const char* variable_name) {
+	if (add_variable_to_server(subscription->socket, (char*)variable_name) < 0) {
+		return -1;
+	}
+	return record_variable(subscription, variable_name);
+}
+
+
+/**
+ * Function: subscription_add_with_units
+ * ----------------------------
+ *   adds a variable with add_variable_to_sever_with_units() and records it.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to be observed;
+ *   @param units:         units of measure of the variable to be observed.
+ *
+ *   @return  the slot of the variable in the decoded values. Otherwise, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int subscription_add_with_units(struct subscription* subscription, const char* variable_name, const char* units) {
+	if (add_variable_to_sever_with_units(subscription->socket, (char*)variable_name, (char*)units) < 0) {
+		return -1;
+	}
+	return record_variable(subscription, variable_name);
+}
+
+
+/**
+ * Function: subscription_remove
+ * ----------------------------
+ *   removes a variable with remove_variable_from_server(). The slots of the following
+ *   variables shift down by one.
+ *
+ *   @param subscription:  the subscription;
+ *   @param variable_name: name of the variable to stop observing.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_remove(struct subscription* subscription, const char* variable_name) {
+	int i;
+
+	for (i = 0; i < subscription->count; i++) {
+		if (strcmp(subscription->variables[i], variable_name) == 0) {
+			break;
+		}
+	}
+	if (i == subscription->count) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (remove_variable_from_server(subscription->socket, (char*)variable_name) < 0) {
+		return -1;
+	}
+	free(subscription->variables[i]);
+	memmove(subscription->variables + i, subscription->variables + i + 1, sizeof(char*) * (subscription->count - i - 1));
+	subscription->count--;
+	subscription->plan.valid = 0;
+	subscription->unsupported = 0;
+	subscription->checked = 0;
+	return 0;
+}
+
+
+/**
+ * Function: subscription_clear
+ * ----------------------------
+ *   removes all the variables with clear().
+ *
+ *   @param subscription: the subscription.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_clear(struct subscription* subscription) {
+	int i;
+
+	if (clear(subscription->socket) < 0) {
+		return -1;
+	}
+	for (i = 0; i < subscription->count; i++) {
+		free(subscription->variables[i]);
+	}
+	subscription->count = 0;
+	subscription->plan.valid = 0;
+	subscription->unsupported = 0;
+	subscription->checked = 0;
+	return 0;
+}
+
+
+/**
+ * Function: write_quoted
+ * ----------------------------
+ *   appends ("<text>" to a command, with the given prefix.
+ */
+
+static int write_quoted(struct command_writer* writer, const char* prefix, const char* text) {
+	if (command_writer_append_string(writer, prefix) < 0 || command_writer_append(writer, "\"", 1) < 0) {
+		return -1;
+	}
+	if (command_writer_append_string(writer, text) < 0) {
+		return -1;
+	}
+	return command_writer_append(writer, "\"", 1);
+}
+
+
+/**
+ * Function: subscription_resubscribe
+ * ----------------------------
+ *   replaces the whole set of variables in one write (var_pause(), var_clear(), var_add()
+ *   for each variable, var_send_once() of SUBSCRIPTION_BARRIER_VARIABLE, var_unpause()) and
+ *   starts a new generation: the messages received before the reply to the barrier are
+ *   discarded. The names are copied before anything is written, so that the set can be
+ *   replaced without failing once the commands are sent.
+ *
+ *   @param subscription: the subscription;
+ *   @param variables:    the names of the variables, in the order of their slots;
+ *   @param units:        the units of each variable (NULL entries for the default ones), or NULL;
+ *   @param count:        the number of variables.
+ *
+ *   @return  the new generation. Otherwise, -1 is returned and errno is set to indicate the
+ *            error; the set is unchanged if nothing was written.
+ */
+
+long subscription_resubscribe(struct subscription* subscription, const char* const* variables, const char* const* units, int count) {
+	struct command_writer writer;
+	char** copies;
+	int i, capacity;
+
+	capacity = count > 16 ? count : 16;
+	copies = calloc(capacity, sizeof(char*));
+	if (copies == NULL) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		copies[i] = strdup(variables[i]);
+		if (copies[i] == NULL) {
+			while (i > 0) free(copies[--i]);
+			free(copies);
+			return -1;
+		}
+	}
+
+	command_writer_init(&writer, subscription->socket);
+	writer.metrics = subscription->metrics;
+	if (command_writer_command(&writer, "trick.var_pause()") < 0 || command_writer_command(&writer, "trick.var_clear()") < 0) {
+		goto failed;
+	}
+	for (i = 0; i < count; i++) {
+		if (write_quoted(&writer, "trick.var_add(", variables[i]) < 0) {
+			goto failed;
+		}
+		if (units != NULL && units[i] != NULL && write_quoted(&writer, ", ", units[i]) < 0) {
+			goto failed;
+		}
+		if (command_writer_append(&writer, ")", 1) < 0 || command_writer_end(&writer) < 0) {
+			goto failed;
+		}
+	}
+	if (write_quoted(&writer, "trick.var_send_once(", SUBSCRIPTION_BARRIER_VARIABLE) < 0
+			|| command_writer_append(&writer, ")", 1) < 0 || command_writer_end(&writer) < 0
+			|| command_writer_command(&writer, "trick.var_unpause()") < 0) {
+		goto failed;
+	}
+	subscription->switch_started = metrics_now();
+	if (command_writer_flush(&writer) < 0) {
+		goto failed;
+	}
+
+	for (i = 0; i < subscription->count; i++) {
+		free(subscription->variables[i]);
+	}
+	free(subscription->variables);
+	subscription->variables = copies;
+	subscription->count = count;
+	subscription->capacity = capacity;
+	subscription->plan.valid = 0;
+	subscription->unsupported = 0;
+	subscription->checked = 0;
+	subscription->barriers++;
+	subscription->switch_time = 0;
+	return (long)++subscription->generation;
+
+failed:
+	for (i = 0; i < count; i++) {
+		free(copies[i]);
+	}
+	free(copies);
+	return -1;
+}
+
+
+/**
+ * Function: subscription_prepare
+ * ----------------------------
+ *   makes sure that the decode plan of the subscription matches a message (length, number
+ *   of variables and type codes), compiling it again otherwise. The type codes are checked
+ *   only on the first message after the set changes: until the next change, only the length
+ *   and the number of variables are compared. A layout that cannot be
+ *   compiled is remembered until the set changes, so that it is not compiled again for
+ *   every message. While the barrier of a resubscription is pending, the
+ *   variable messages have the prior layout and are discarded. Otherwise, messages with a
+ *   number of variables different from the subscription (still in flight from before a
+ *   change made variable by variable) are skipped.
+ *
+ *   @param subscription: the subscription;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message.
+ *
+ *   @return  1 if the plan matches the message, 0 if the message must be skipped because it
+ *            is not a variable message (or is the barrier of a resubscription) or it still has
+ *            the layout prior to the last change. Otherwise, -1 is returned and errno is set to
+ *            indicate the error (@c EPROTO if the message is not valid, @c ENOTSUP if its layout
+ *            cannot be compiled).
+ */
+
+int subscription_prepare(struct subscription* subscription, const unsigned char* frame, unsigned int length) {
+	unsigned int indicator;
+
+	if (length < BINARY_HEADER_SIZE) {
+		errno = EPROTO;
+		return -1;
+	}
+	indicator = read_u32(frame);
+	if (indicator == SUBSCRIPTION_SEND_ONCE_INDICATOR && subscription->barriers > 0) {
+		subscription->barriers--;
+		return 0;
+	}
+	if (indicator != 0) {
+		return 0;
+	}
+	if (subscription->barriers > 0) {
+		subscription->stale++;
+		return 0;
+	}
+	if (read_u32(frame + 8) != (unsigned int)subscription->count) {
+		return 0;
+	}
+	if (subscription->switch_time == 0 && subscription->switch_started != 0) {
+		subscription->switch_time = metrics_now() - subscription->switch_started;
+	}
+	if (subscription->checked) {
+		if (subscription->plan.valid && length == subscription->plan.frame_length) {
+			return 1;
+		}
+	} else if (decode_plan_matches(&subscription->plan, frame, length)) {
+		subscription->checked = 1;
+		return 1;
+	}
+	if (subscription->unsupported) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	if (decode_plan_compile(&subscription->plan, frame, length, subscription->names) == 0) {
+		subscription->checked = 1;
+		return 1;
+	}
+	if (errno == ENOTSUP) {
+		subscription->unsupported = 1;
+	}
+	return -1;
+}
+
+
+/**
+ * Function: decode_subscribed
+ * ----------------------------
+ *   the work of subscription_decode(), without the counters.
+ */
+
+static int decode_subscribed(struct subscription* subscription, const unsigned char* frame, unsigned int length, double* values) {
+	int result = subscription_prepare(subscription, frame, length);
+
+	if (result > 0) {
+		return decode_plan_decode(&subscription->plan, frame, length, values) < 0 ? -1 : 1;
+	}
+	if (result == 0 || errno != ENOTSUP) {
+		return result;
+	}
+	return decode_frame_generic(frame, length, subscription->names, values, subscription->count) < 0 ? -1 : 1;
+}
+
+
+/**
+ * Function: subscription_decode
+ * ----------------------------
+ *   decodes a binary variable message, compiling the plan first if the set has changed.
+ *   Messages with a number of variables different from the subscription (still in flight
+ *   from before the last change) are skipped. Layouts that cannot be compiled (strings)
+ *   are decoded with decode_frame_generic().
+ *   If counters are attached, the decoding time and the errors are counted.
+ *
+ *   @param subscription: the subscription;
+ *   @param frame:        the message;
+ *   @param length:       the length of the message;
+ *   @param values:       filled with the values, one slot per subscribed variable.
+ *
+ *   @return  1 if the message was decoded, 0 if it was skipped because it is not a variable
+ *            message or it still has the layout prior to the last change. If the message is
+ *            not valid, -1 is returned and errno is set to indicate the error.
+ */
+
+int subscription_decode(struct subscription* subscription, const unsigned char* frame, unsigned int length, double* values) {
+	unsigned long long start;
+	int result;
+
+	if (subscription->metrics == NULL) {
+		TRACE_BEGIN("decode");
+		result = decode_subscribed(subscription, frame, length, values);
+		TRACE_END("decode");
+		return result;
+	}
+	start = metrics_now();
+	TRACE_BEGIN("decode");
+	result = decode_subscribed(subscription, frame, length, values);
+	TRACE_END("decode");
+	metrics_add(subscription->metrics, METRIC_DECODE_TIME, metrics_now() - start);
+	if (result < 0) {
+		metrics_add(subscription->metrics, METRIC_PARSE_ERRORS, 1);
+	}
+	return result;
+}
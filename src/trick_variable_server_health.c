@@ -0,0 +1,498 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_health.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Health monitor of the links with the Trick Variable Server.
+ *
+ * A link sits in the bucket of the wheel of its next check (due tick modulo the size of the
+ * wheel); a bucket is visited once per turn and only the links actually due are checked, so
+ * windows longer than a turn simply wait for later turns. Time is counted in ticks, from the
+ * expirations read from the timerfd, which is waited for with ppoll() and released with
+ * close_socket(): the library defines its own poll() and close().
+ */
+
+#define _GNU_SOURCE           //ppoll
+
+#include<stdlib.h>          //calloc,...
+#include<string.h>          //memset,...
+#include<errno.h>           //errno,...
+#include<stdint.h>          //uint64_t,...
+#include<unistd.h>          //read,...
+#include<poll.h>            //ppoll,...
+#include<sys/timerfd.h>     //timerfd_create,...
+
+#include "../include/trick_variable_server_health.h"
+
+int close_socket(int socket);
+
+
+/**
+ * Function: window_ticks
+ * ----------------------------
+ *   the number of ticks between two checks of a link.
+ */
+
+static unsigned long long window_ticks(const struct health_monitor* monitor, const struct health_link* link) {
+	unsigned long long ticks = (unsigned long long)(link->period * HEALTH_WINDOW_PERIODS / monitor->tick + 0.5);
+
+	return ticks > 0 ? ticks : 1;
+}
+
+
+/**
+ * Function: schedule
+ * ----------------------------
+ *   puts a link in the bucket of its next check.
+ */
+
+static void schedule(struct health_monitor* monitor, int link) {
+	struct health_link* l = &monitor->links[link];
+	int bucket;
+
+	l->due = monitor->now + window_ticks(monitor, l);
+	bucket = (int)(l->due % HEALTH_WHEEL_SIZE);
+	l->next = monitor->wheel[bucket];
+	monitor->wheel[bucket] = link;
+}
+
+
+/**
+ * Function: unschedule
+ * ----------------------------
+ *   takes a link out of its bucket.
+ */
+
+static void unschedule(struct health_monitor* monitor, int link) {
+	int* position = &monitor->wheel[monitor->links[link].due % HEALTH_WHEEL_SIZE];
+
+	while (*position >= 0 && *position != link) {
+		position = &monitor->links[*position].next;
+	}
+	if (*position == link) {
+		*position = monitor->links[link].next;
+	}
+}
+
+
+/**
+ * Function: frames_of
+ * ----------------------------
+ *   the messages counted on a link so far.
+ */
+
+static unsigned long frames_of(const struct health_link* link) {
+	if (link->metrics != NULL) {
+		return (unsigned long)atomic_load_explicit(&link->metrics->counter[METRIC_FRAMES].value, memory_order_relaxed);
+	}
+	return atomic_load_explicit(&link->frames, memory_order_relaxed);
+}
+
+
+/**
+ * Function: check
+ * ----------------------------
+ *   classifies a link from the messages of its window; returns 1 and fills the event if its state changed.
+ */
+
+static int check(struct health_monitor* monitor, int link, struct health_event* event) {
+	struct health_link* l = &monitor->links[link];
+	unsigned long frames = frames_of(l);
+	unsigned long received = frames - l->seen;
+	double window = (double)(monitor->now - l->window_start) * monitor->tick;
+	double silence;
+	int state;
+
+	if (received > 0) {
+		l->last_progress = monitor->now;
+	}
+	silence = (double)(monitor->now - l->last_progress) * monitor->tick;
+	if (silence >= HEALTH_STALL_PERIODS * l->period) {
+		state = HEALTH_STALLED;
+	}
+	else if ((double)received * l->period < HEALTH_SLOW_RATIO * window) {
+		state = HEALTH_SLOW;
+	}
+	else {
+		state = HEALTH_OK;
+	}
+	l->seen = frames;
+	l->window_start = monitor->now;
+	monitor->checks++;
+
+	/* a stalled link leaves the state only when messages arrive again */
+	if (state == l->state || (l->state == HEALTH_STALLED && received == 0)) {
+		return 0;
+	}
+	l->state = state;
+	event->link = link;
+	event->name = l->name;
+	event->type = state == HEALTH_STALLED ? HEALTH_EVENT_STALL : state == HEALTH_SLOW ? HEALTH_EVENT_SLOW : HEALTH_EVENT_RECOVERED;
+	event->time = (double)monitor->now * monitor->tick;
+	event->period = l->period;
+	event->observed_period = received > 0 ? window / (double)received : 0.0;
+	event->silence = silence;
+	return 1;
+}
+
+
+/**
+ * Function: visit
+ * ----------------------------
+ *   checks the links due in the bucket of the current tick and schedules them again.
+ */
+
+static int visit(struct health_monitor* monitor, int events) {
+	int* position = &monitor->wheel[monitor->now % HEALTH_WHEEL_SIZE];
+	int due = -1, link;
+
+	/* the links due are moved out first: scheduling them again may put them back in this bucket */
+	while (*position >= 0) {
+		link = *position;
+		if (monitor->links[link].due <= monitor->now) {
+			*position = monitor->links[link].next;
+			monitor->links[link].next = due;
+			due = link;
+		}
+		else {
+			position = &monitor->links[link].next;
+		}
+	}
+	while (due >= 0) {
+		link = due;
+		due = monitor->links[link].next;
+		events += check(monitor, link, &monitor->events[events]);
+		schedule(monitor, link);
+	}
+	return events;
+}
+
+
+/**
+ * Function: health_init
+ * ----------------------------
+ *   creates the timer and the links of a monitor.
+ *
+ *   @param monitor:  the monitor;
+ *   @param capacity: the largest number of links;
+ *   @param tick:     the resolution of the monitor in seconds (e.g. 0.005);
+ *   @param handler:  the callback receiving the events;
+ *   @param context:  passed to the handler.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_init(struct health_monitor* monitor, int capacity, double tick, health_handler handler, void* context) {
+	struct itimerspec interval;
+	long nanoseconds = (long)(tick * 1.0e9 + 0.5);
+	int i;
+
+	memset(monitor, 0, sizeof(struct health_monitor));
+	monitor->timer = -1;
+	if (capacity <= 0 || nanoseconds <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	monitor->links = aligned_alloc(METRICS_CACHE_LINE, sizeof(struct health_link) * capacity);
+	monitor->events = malloc(sizeof(struct health_event) * capacity);
+	if (monitor->links == NULL || monitor->events == NULL) {
+		free(monitor->links);
+		free(monitor->events);
+		return -1;
+	}
+	memset(monitor->links, 0, sizeof(struct health_link) * capacity);
+	for (i = 0; i < capacity; i++) {
+		atomic_init(&monitor->links[i].frames, 0);
+	}
+	for (i = 0; i < HEALTH_WHEEL_SIZE; i++) {
+		monitor->wheel[i] = -1;
+	}
+
+	monitor->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (monitor->timer < 0) {
+		free(monitor->links);
+		free(monitor->events);
+		return -1;
+	}
+	interval.it_interval.tv_sec = nanoseconds / 1000000000L;
+	interval.it_interval.tv_nsec = nanoseconds % 1000000000L;
+	interval.it_value = interval.it_interval;
+	if (timerfd_settime(monitor->timer, 0, &interval, NULL) < 0) {
+		close_socket(monitor->timer);
+		free(monitor->links);
+		free(monitor->events);
+		return -1;
+	}
+
+	monitor->tick = (double)nanoseconds * 1.0e-9;
+	monitor->capacity = capacity;
+	monitor->handler = handler;
+	monitor->context = context;
+	pthread_mutex_init(&monitor->lock, NULL);
+	atomic_init(&monitor->running, 0);
+	return 0;
+}
+
+
+/**
+ * Function: health_destroy
+ * ----------------------------
+ *   stops the thread of the monitor, if any, and releases the monitor.
+ *
+ *   @param monitor: the monitor.
+ */
+
+void health_destroy(struct health_monitor* monitor) {
+	health_stop(monitor);
+	if (monitor->timer >= 0) {
+		close_socket(monitor->timer);
+	}
+	pthread_mutex_destroy(&monitor->lock);
+	free(monitor->links);
+	free(monitor->events);
+	monitor->links = NULL;
+	monitor->events = NULL;
+	monitor->timer = -1;
+}
+
+
+/**
+ * Function: health_add
+ * ----------------------------
+ *   starts monitoring a link; its first check is one window from now.
+ *
+ *   @param monitor: the monitor;
+ *   @param name:    the name of the link, reported in the events; it is not copied;
+ *   @param period:  the period requested with set_cycle(), in seconds;
+ *   @param metrics: the metrics attached to the receiver of the link, whose frames are counted,
+ *                   or NULL to count them with health_frame().
+ *
+ *   @return  the index of the link. Otherwise, -1 is returned and errno is set to indicate the
+ *            error, @c ENOSPC if the monitor is full.
+ */
+
+int health_add(struct health_monitor* monitor, const char* name, double period, struct connection_metrics* metrics) {
+	struct health_link* l;
+	int link;
+
+	if (period <= 0.0) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&monitor->lock);
+	for (link = 0; link < monitor->capacity && monitor->links[link].active; link++);
+	if (link == monitor->capacity) {
+		pthread_mutex_unlock(&monitor->lock);
+		errno = ENOSPC;
+		return -1;
+	}
+	l = &monitor->links[link];
+	l->metrics = metrics;
+	l->name = name;
+	l->period = period;
+	l->active = 1;
+	l->state = HEALTH_OK;
+	l->seen = frames_of(l);
+	l->window_start = monitor->now;
+	l->last_progress = monitor->now;
+	schedule(monitor, link);
+	pthread_mutex_unlock(&monitor->lock);
+	return link;
+}
+
+
+/**
+ * Function: health_remove
+ * ----------------------------
+ *   stops monitoring a link.
+ *
+ *   @param monitor: the monitor;
+ *   @param link:    the index of the link.
+ */
+
+void health_remove(struct health_monitor* monitor, int link) {
+	pthread_mutex_lock(&monitor->lock);
+	if (link >= 0 && link < monitor->capacity && monitor->links[link].active) {
+		unschedule(monitor, link);
+		monitor->links[link].active = 0;
+	}
+	pthread_mutex_unlock(&monitor->lock);
+}
+
+
+/**
+ * Function: health_set_period
+ * ----------------------------
+ *   changes the expected period of a link, after a new set_cycle(); its window and its
+ *   silence start again, and its next check is one window of the new period from now.
+ *
+ *   @param monitor: the monitor;
+ *   @param link:    the index of the link;
+ *   @param period:  the new period in seconds.
+ */
+
+void health_set_period(struct health_monitor* monitor, int link, double period) {
+	struct health_link* l;
+
+	pthread_mutex_lock(&monitor->lock);
+	if (period > 0.0 && link >= 0 && link < monitor->capacity && monitor->links[link].active) {
+		l = &monitor->links[link];
+		unschedule(monitor, link);
+		l->period = period;
+		l->seen = frames_of(l);
+		l->window_start = monitor->now;
+		l->last_progress = monitor->now;
+		schedule(monitor, link);
+	}
+	pthread_mutex_unlock(&monitor->lock);
+}
+
+
+/**
+ * Function: health_fd
+ * ----------------------------
+ *   the file descriptor of the timer, readable when ticks are due.
+ *
+ *   @param monitor: the monitor.
+ *
+ *   @return  the timerfd.
+ */
+
+int health_fd(const struct health_monitor* monitor) {
+	return monitor->timer;
+}
+
+
+/**
+ * Function: health_process
+ * ----------------------------
+ *   processes the ticks elapsed and raises the events of the links checked. After a long
+ *   delay (more ticks than a turn of the wheel), only the last turn is visited: every link
+ *   overdue is checked once. The handler is called without the lock held.
+ *
+ *   @param monitor: the monitor;
+ *   @param wait:    1 to wait for the next tick if none is due, 0 to return at once.
+ *
+ *   @return  the number of events raised. Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_process(struct health_monitor* monitor, int wait) {
+	struct pollfd timer;
+	uint64_t expirations;
+	unsigned long long i;
+	int events = 0, count, e;
+
+	while (read(monitor->timer, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) {
+		if (errno == EINTR) continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) || !wait) {
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		timer.fd = monitor->timer;
+		timer.events = POLLIN;
+		if (ppoll(&timer, 1, NULL, NULL) < 0 && errno != EINTR) {
+			return -1;
+		}
+	}
+
+	/* one tick at a time, so that a link is checked at most once between two dispatches */
+	if (expirations > HEALTH_WHEEL_SIZE) {
+		pthread_mutex_lock(&monitor->lock);
+		monitor->now += expirations - HEALTH_WHEEL_SIZE;
+		pthread_mutex_unlock(&monitor->lock);
+		expirations = HEALTH_WHEEL_SIZE;
+	}
+	for (i = 0; i < expirations; i++) {
+		pthread_mutex_lock(&monitor->lock);
+		monitor->now++;
+		monitor->ticks++;
+		count = visit(monitor, 0);
+		pthread_mutex_unlock(&monitor->lock);
+		for (e = 0; e < count && monitor->handler != NULL; e++) {
+			monitor->handler(monitor->context, &monitor->events[e]);
+		}
+		events += count;
+	}
+	return events;
+}
+
+
+/**
+ * Function: run_monitor
+ * ----------------------------
+ *   the loop of the thread of the monitor.
+ */
+
+static void* run_monitor(void* argument) {
+	struct health_monitor* monitor = argument;
+
+	while (atomic_load(&monitor->running)) {
+		if (health_process(monitor, 1) < 0) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Function: health_start
+ * ----------------------------
+ *   starts the single thread processing the ticks of all the links.
+ *
+ *   @param monitor: the monitor.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int health_start(struct health_monitor* monitor) {
+	int result;
+
+	if (atomic_exchange(&monitor->running, 1)) {
+		errno = EALREADY;
+		return -1;
+	}
+	result = pthread_create(&monitor->thread, NULL, run_monitor, monitor);
+	if (result != 0) {
+		atomic_store(&monitor->running, 0);
+		errno = result;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: health_stop
+ * ----------------------------
+ *   stops the thread of the monitor, within one tick.
+ *
+ *   @param monitor: the monitor.
+ */
+
+void health_stop(struct health_monitor* monitor) {
+	if (atomic_exchange(&monitor->running, 0)) {
+		pthread_join(monitor->thread, NULL);
+	}
+}
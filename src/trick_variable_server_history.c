@@ -0,0 +1,302 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_history.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief In-memory history of the decoded values, with windowed queries.
+ */
+
+
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //memset,...
+#include<math.h>          //NAN,...
+#include<errno.h>         //errno,...
+
+#include "../include/trick_variable_server_history.h"
+
+
+/**
+ * Function: power_of_two
+ * ----------------------------
+ *   the smallest power of two not less than the given number.
+ */
+
+static unsigned int power_of_two(unsigned int n) {
+	unsigned int power = 1;
+
+	while (power < n && power < 0x80000000u) {
+		power <<= 1;
+	}
+	return power;
+}
+
+
+/**
+ * Function: first_block_ending_after
+ * ----------------------------
+ *   the first block of [low, high] whose last sample is not earlier than time, high + 1 if none.
+ */
+
+static unsigned long long first_block_ending_after(const struct history* history, unsigned long long low, unsigned long long high, double time) {
+	unsigned long long middle;
+
+	high++;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (history->block_last[middle & (history->blocks - 1)] < time) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+
+/**
+ * Function: last_block_starting_before
+ * ----------------------------
+ *   the last block of [low, high] whose first sample is not later than time, low - 1 if none.
+ */
+
+static long long last_block_starting_before(const struct history* history, unsigned long long low, unsigned long long high, double time) {
+	unsigned long long middle;
+
+	high++;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (history->block_first[middle & (history->blocks - 1)] <= time) low = middle + 1;
+		else high = middle;
+	}
+	return (long long)low - 1;
+}
+
+
+/**
+ * Function: history_init
+ * ----------------------------
+ *   allocates a history. The sizes are rounded up to powers of two.
+ *
+ *   @param history:  the history;
+ *   @param slots:    the number of slots;
+ *   @param capacity: the number of samples to keep for each slot;
+ *   @param block:    the number of samples summarized together (at most capacity / 2).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int history_init(struct history* history, int slots, unsigned int capacity, unsigned int block) {
+	memset(history, 0, sizeof(struct history));
+	if (slots <= 0 || capacity < 2 || block == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	history->slots = slots;
+	history->capacity = power_of_two(capacity);
+	history->block = power_of_two(block);
+	if (history->block > history->capacity / 2) {
+		history->block = history->capacity / 2;
+	}
+	while ((1u << history->shift) < history->block) {
+		history->shift++;
+	}
+	history->blocks = history->capacity >> history->shift;
+
+	history->times = malloc(sizeof(double) * history->capacity);
+	history->values = malloc(sizeof(double) * history->capacity * (size_t)slots);
+	history->block_first = malloc(sizeof(double) * history->blocks);
+	history->block_last = malloc(sizeof(double) * history->blocks);
+	history->block_count = calloc(history->blocks, sizeof(unsigned int));
+	history->summaries = malloc(sizeof(struct history_summary) * history->blocks * (size_t)slots);
+	if (history->times == NULL || history->values == NULL || history->block_first == NULL
+		|| history->block_last == NULL || history->block_count == NULL || history->summaries == NULL) {
+		history_destroy(history);
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: history_destroy
+ * ----------------------------
+ *   releases a history.
+ *
+ *   @param history: the history.
+ */
+
+void history_destroy(struct history* history) {
+	free(history->times);
+	free(history->values);
+	free(history->block_first);
+	free(history->block_last);
+	free(history->block_count);
+	free(history->summaries);
+	memset(history, 0, sizeof(struct history));
+}
+
+
+/**
+ * Function: history_append
+ * ----------------------------
+ *   appends one row: the values of all the slots at the given time. The oldest
+ *   block is dropped when the ring is full.
+ *
+ *   @param history: the history;
+ *   @param time:    the time of the values, not earlier than the one of the previous row;
+ *   @param values:  the value of each slot (e.g. as decoded by subscription_decode()).
+ */
+
+void history_append(struct history* history, double time, const double* values) {
+	unsigned int index = (unsigned int)(history->head & (history->capacity - 1));
+	unsigned int block = index >> history->shift;
+	struct history_summary* summary = history->summaries + block;
+	double* value = history->values + index;
+	int slot;
+
+	history->times[index] = time;
+	if ((index & (history->block - 1)) == 0) {
+		history->block_first[block] = time;
+		history->block_count[block] = 0;
+		for (slot = 0; slot < history->slots; slot++, value += history->capacity, summary += history->blocks) {
+			*value = values[slot];
+			summary->min = summary->max = summary->sum = summary->last = values[slot];
+		}
+	}
+	else {
+		for (slot = 0; slot < history->slots; slot++, value += history->capacity, summary += history->blocks) {
+			*value = values[slot];
+			if (values[slot] < summary->min) summary->min = values[slot];
+			if (values[slot] > summary->max) summary->max = values[slot];
+			summary->sum += values[slot];
+			summary->last = values[slot];
+		}
+	}
+	history->block_last[block] = time;
+	history->block_count[block]++;
+	history->head++;
+}
+
+
+/**
+ * Function: add_to_stats
+ * ----------------------------
+ *   adds a group of samples (a whole block or a single sample) to a result, in time order.
+ */
+
+static void add_to_stats(struct history_stats* stats, double* sum, double min, double max, double total, double last, double from, double to, unsigned long count) {
+	if (stats->count == 0) {
+		stats->min = min;
+		stats->max = max;
+		stats->from = from;
+	}
+	else {
+		if (min < stats->min) stats->min = min;
+		if (max > stats->max) stats->max = max;
+	}
+	*sum += total;
+	stats->last = last;
+	stats->to = to;
+	stats->count += count;
+}
+
+
+/**
+ * Function: history_query
+ * ----------------------------
+ *   computes the minimum, maximum, mean and last value of a slot over a time range.
+ *   The blocks overlapping the range are found by binary search on their times. The
+ *   blocks entirely inside the range are read through their summaries; the samples of
+ *   the blocks straddling its ends are read one by one.
+ *
+ *   @param history: the history;
+ *   @param slot:    the index of the slot;
+ *   @param from:    the start of the range;
+ *   @param to:      the end of the range;
+ *   @param stats:   filled with the result, which covers the samples in the range.
+ *
+ *   @return  the number of samples covered, 0 if no sample falls in the range.
+ */
+
+unsigned long history_query(const struct history* history, int slot, double from, double to, struct history_stats* stats) {
+	const struct history_summary* summaries = history->summaries + (size_t)slot * history->blocks;
+	const struct history_summary* summary;
+	const double* values = history->values + (size_t)slot * history->capacity;
+	unsigned long long newest, oldest, first, block;
+	unsigned int position, index, end;
+	long long last;
+	double sum = 0.0;
+
+	memset(stats, 0, sizeof(struct history_stats));
+	stats->min = stats->max = stats->mean = stats->last = stats->from = stats->to = NAN;
+	if (history->head == 0 || slot < 0 || slot >= history->slots || from > to) {
+		return 0;
+	}
+	newest = (history->head - 1) >> history->shift;
+	oldest = newest >= history->blocks ? newest - history->blocks + 1 : 0;
+	first = first_block_ending_after(history, oldest, newest, from);
+	last = last_block_starting_before(history, oldest, newest, to);
+	if (last < 0 || first > (unsigned long long)last) {
+		return 0;
+	}
+
+	for (block = first; block <= (unsigned long long)last; block++) {
+		position = (unsigned int)(block & (history->blocks - 1));
+		if (history->block_first[position] >= from && history->block_last[position] <= to) {
+			summary = summaries + position;
+			add_to_stats(stats, &sum, summary->min, summary->max, summary->sum, summary->last,
+				history->block_first[position], history->block_last[position], history->block_count[position]);
+			continue;
+		}
+		/* the block straddles an end of the range */
+		index = position << history->shift;
+		end = index + history->block_count[position];
+		for (; index < end; index++) {
+			if (history->times[index] >= from && history->times[index] <= to) {
+				add_to_stats(stats, &sum, values[index], values[index], values[index], values[index],
+					history->times[index], history->times[index], 1);
+			}
+		}
+	}
+	if (stats->count > 0) {
+		stats->mean = sum / (double)stats->count;
+	}
+	return stats->count;
+}
+
+
+/**
+ * Function: history_last_time
+ * ----------------------------
+ *   the time of the newest sample.
+ *
+ *   @param history: the history.
+ *
+ *   @return  the time of the last row appended, NaN if the history is empty.
+ */
+
+double history_last_time(const struct history* history) {
+	if (history->head == 0) {
+		return NAN;
+	}
+	return history->times[(history->head - 1) & (history->capacity - 1)];
+}
@@ -0,0 +1,530 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_injector.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Batched injection of values into simulation variables.
+ *
+ * The double formatting is Grisu2 by Florian Loitsch ("Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers", PLDI 2010), as adapted by Milo Yip in RapidJSON.
+ */
+
+
+#include<stdio.h>         //sprintf,...
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //memcpy,...
+#include<stdint.h>        //uint64_t,...
+#include<errno.h>         //errno,...
+#include<sys/socket.h>    //send,...
+
+#include "../include/trick_variable_server_injector.h"
+#include "../include/trick_variable_server_trace.h"
+
+
+/**
+ *   @brief a floating-point number f * 2^e with a 64-bit significand.
+ */
+
+struct diy_fp {
+	uint64_t f;
+	int e;
+};
+
+
+/* normalized 10^k for k = -348, -340, ..., 340 */
+static const struct diy_fp cached_powers[87] = {
+	{ 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+	{ 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+	{ 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+	{ 0x8dd01fad907ffc3cULL,  -980 }, { 0xd3515c2831559a83ULL,  -954 }, { 0x9d71ac8fada6c9b5ULL,  -927 },
+	{ 0xea9c227723ee8bcbULL,  -901 }, { 0xaecc49914078536dULL,  -874 }, { 0x823c12795db6ce57ULL,  -847 },
+	{ 0xc21094364dfb5637ULL,  -821 }, { 0x9096ea6f3848984fULL,  -794 }, { 0xd77485cb25823ac7ULL,  -768 },
+	{ 0xa086cfcd97bf97f4ULL,  -741 }, { 0xef340a98172aace5ULL,  -715 }, { 0xb23867fb2a35b28eULL,  -688 },
+	{ 0x84c8d4dfd2c63f3bULL,  -661 }, { 0xc5dd44271ad3cdbaULL,  -635 }, { 0x936b9fcebb25c996ULL,  -608 },
+	{ 0xdbac6c247d62a584ULL,  -582 }, { 0xa3ab66580d5fdaf6ULL,  -555 }, { 0xf3e2f893dec3f126ULL,  -529 },
+	{ 0xb5b5ada8aaff80b8ULL,  -502 }, { 0x87625f056c7c4a8bULL,  -475 }, { 0xc9bcff6034c13053ULL,  -449 },
+	{ 0x964e858c91ba2655ULL,  -422 }, { 0xdff9772470297ebdULL,  -396 }, { 0xa6dfbd9fb8e5b88fULL,  -369 },
+	{ 0xf8a95fcf88747d94ULL,  -343 }, { 0xb94470938fa89bcfULL,  -316 }, { 0x8a08f0f8bf0f156bULL,  -289 },
+	{ 0xcdb02555653131b6ULL,  -263 }, { 0x993fe2c6d07b7facULL,  -236 }, { 0xe45c10c42a2b3b06ULL,  -210 },
+	{ 0xaa242499697392d3ULL,  -183 }, { 0xfd87b5f28300ca0eULL,  -157 }, { 0xbce5086492111aebULL,  -130 },
+	{ 0x8cbccc096f5088ccULL,  -103 }, { 0xd1b71758e219652cULL,   -77 }, { 0x9c40000000000000ULL,   -50 },
+	{ 0xe8d4a51000000000ULL,   -24 }, { 0xad78ebc5ac620000ULL,     3 }, { 0x813f3978f8940984ULL,    30 },
+	{ 0xc097ce7bc90715b3ULL,    56 }, { 0x8f7e32ce7bea5c70ULL,    83 }, { 0xd5d238a4abe98068ULL,   109 },
+	{ 0x9f4f2726179a2245ULL,   136 }, { 0xed63a231d4c4fb27ULL,   162 }, { 0xb0de65388cc8ada8ULL,   189 },
+	{ 0x83c7088e1aab65dbULL,   216 }, { 0xc45d1df942711d9aULL,   242 }, { 0x924d692ca61be758ULL,   269 },
+	{ 0xda01ee641a708deaULL,   295 }, { 0xa26da3999aef774aULL,   322 }, { 0xf209787bb47d6b85ULL,   348 },
+	{ 0xb454e4a179dd1877ULL,   375 }, { 0x865b86925b9bc5c2ULL,   402 }, { 0xc83553c5c8965d3dULL,   428 },
+	{ 0x952ab45cfa97a0b3ULL,   455 }, { 0xde469fbd99a05fe3ULL,   481 }, { 0xa59bc234db398c25ULL,   508 },
+	{ 0xf6c69a72a3989f5cULL,   534 }, { 0xb7dcbf5354e9beceULL,   561 }, { 0x88fcf317f22241e2ULL,   588 },
+	{ 0xcc20ce9bd35c78a5ULL,   614 }, { 0x98165af37b2153dfULL,   641 }, { 0xe2a0b5dc971f303aULL,   667 },
+	{ 0xa8d9d1535ce3b396ULL,   694 }, { 0xfb9b7cd9a4a7443cULL,   720 }, { 0xbb764c4ca7a44410ULL,   747 },
+	{ 0x8bab8eefb6409c1aULL,   774 }, { 0xd01fef10a657842cULL,   800 }, { 0x9b10a4e5e9913129ULL,   827 },
+	{ 0xe7109bfba19c0c9dULL,   853 }, { 0xac2820d9623bf429ULL,   880 }, { 0x80444b5e7aa7cf85ULL,   907 },
+	{ 0xbf21e44003acdd2dULL,   933 }, { 0x8e679c2f5e44ff8fULL,   960 }, { 0xd433179d9c8cb841ULL,   986 },
+	{ 0x9e19db92b4e31ba9ULL,  1013 }, { 0xeb96bf6ebadf77d9ULL,  1039 }, { 0xaf87023b9bf0ee6bULL,  1066 }
+};
+
+static const uint64_t powers_of_ten[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+/**
+ * Function: multiply
+ * ----------------------------
+ *   the product of two numbers, rounded to 64 bits.
+ */
+
+static struct diy_fp multiply(struct diy_fp a, struct diy_fp b) {
+	unsigned __int128 product = (unsigned __int128)a.f * b.f;
+	struct diy_fp result;
+
+	result.f = (uint64_t)(product >> 64);
+	if ((uint64_t)product & (1ULL << 63)) result.f++;
+	result.e = a.e + b.e + 64;
+	return result;
+}
+
+
+/**
+ * Function: normalize
+ * ----------------------------
+ *   shifts the significand so that its highest bit is set.
+ */
+
+static struct diy_fp normalize(struct diy_fp x) {
+	int shift = __builtin_clzll(x.f);
+
+	x.f <<= shift;
+	x.e -= shift;
+	return x;
+}
+
+
+/**
+ * Function: round_digits
+ * ----------------------------
+ *   moves the last digit towards the value while the result stays within the boundaries.
+ */
+
+static void round_digits(char* buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t distance) {
+	while (rest < distance && delta - rest >= ten_kappa
+		&& (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+		buffer[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+
+/**
+ * Function: generate_digits
+ * ----------------------------
+ *   generates the shortest digits of w that lie within (upper - delta, upper).
+ */
+
+static int generate_digits(struct diy_fp w, struct diy_fp upper, uint64_t delta, char* buffer, int* k) {
+	struct diy_fp one = { 1ULL << -upper.e, upper.e };
+	uint64_t distance = upper.f - w.f, rest;
+	uint32_t p1 = (uint32_t)(upper.f >> -one.e), digit;
+	uint64_t p2 = upper.f & (one.f - 1);
+	int kappa = 1, length = 0;
+
+	while (kappa < 10 && p1 >= powers_of_ten[kappa]) {
+		kappa++;
+	}
+	while (kappa > 0) {
+		digit = (uint32_t)(p1 / powers_of_ten[kappa - 1]);
+		p1 %= (uint32_t)powers_of_ten[kappa - 1];
+		if (digit || length) buffer[length++] = (char)('0' + digit);
+		kappa--;
+		rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			round_digits(buffer, length, delta, rest, powers_of_ten[kappa] << -one.e, distance);
+			return length;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		digit = (uint32_t)(p2 >> -one.e);
+		if (digit || length) buffer[length++] = (char)('0' + digit);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			round_digits(buffer, length, delta, p2, one.f, -kappa < 20 ? distance * powers_of_ten[-kappa] : 0);
+			return length;
+		}
+	}
+}
+
+
+/**
+ * Function: grisu2
+ * ----------------------------
+ *   the shortest digits of a positive finite double: value = digits * 10^k.
+ */
+
+static int grisu2(double value, char* buffer, int* k) {
+	struct diy_fp v, plus, minus, power, w;
+	uint64_t bits;
+	int biased, index, length;
+	double dk;
+
+	memcpy(&bits, &value, 8);
+	biased = (int)((bits >> 52) & 0x7FF);
+	v.f = bits & 0xFFFFFFFFFFFFFULL;
+	if (biased != 0) {
+		v.f += 1ULL << 52;
+		v.e = biased - 1075;
+	}
+	else {
+		v.e = -1074;
+	}
+
+	/* the boundaries halfway to the neighbouring doubles, with the exponent of the upper one */
+	plus.f = (v.f << 1) + 1;
+	plus.e = v.e - 1;
+	plus = normalize(plus);
+	if (v.f == (1ULL << 52)) {
+		minus.f = (v.f << 2) - 1;
+		minus.e = v.e - 2;
+	}
+	else {
+		minus.f = (v.f << 1) - 1;
+		minus.e = v.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	/* a cached power of ten bringing the exponent into [-60, -32] */
+	dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	index = (int)dk;
+	if (dk - index > 0.0) index++;
+	index = (index >> 3) + 1;
+	*k = -(-348 + index * 8);
+	power = cached_powers[index];
+
+	w = multiply(normalize(v), power);
+	plus = multiply(plus, power);
+	minus = multiply(minus, power);
+	minus.f++;
+	plus.f--;
+	length = generate_digits(w, plus, plus.f - minus.f, buffer, k);
+	return length;
+}
+
+
+/**
+ * Function: injector_format_double
+ * ----------------------------
+ *   writes a double as the shortest Python literal that reads back to it
+ *   (e.g. 0.1, 1e+300, -0.0, float('nan')).
+ *
+ *   @param value:  the value;
+ *   @param buffer: at least INJECTOR_NUMBER_SIZE characters; the text is not null-terminated.
+ *
+ *   @return  the number of characters written.
+ */
+
+int injector_format_double(double value, char* buffer) {
+	char digits[24];
+	char* p = buffer;
+	uint64_t bits;
+	int length, k, point, exponent, i;
+
+	memcpy(&bits, &value, 8);
+	if (bits >> 63) {
+		*p++ = '-';
+		value = -value;
+	}
+	if (((bits >> 52) & 0x7FF) == 0x7FF) {
+		if (bits & 0xFFFFFFFFFFFFFULL) {
+			memcpy(buffer, "float('nan')", 12);
+			return 12;
+		}
+		memcpy(p, "float('inf')", 12);
+		return (int)(p - buffer) + 12;
+	}
+	if (value == 0.0) {
+		memcpy(p, "0.0", 3);
+		return (int)(p - buffer) + 3;
+	}
+
+	length = grisu2(value, digits, &k);
+	point = length + k;              /* value = 0.digits * 10^point */
+	if (length <= point && point <= 21) {
+		memcpy(p, digits, length);
+		p += length;
+		for (i = length; i < point; i++) *p++ = '0';
+		*p++ = '.';
+		*p++ = '0';
+	}
+	else if (0 < point && point <= 21) {
+		memcpy(p, digits, point);
+		p += point;
+		*p++ = '.';
+		memcpy(p, digits + point, length - point);
+		p += length - point;
+	}
+	else if (-6 < point && point <= 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = point; i < 0; i++) *p++ = '0';
+		memcpy(p, digits, length);
+		p += length;
+	}
+	else {
+		*p++ = digits[0];
+		if (length > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, length - 1);
+			p += length - 1;
+		}
+		exponent = point - 1;
+		*p++ = 'e';
+		*p++ = exponent < 0 ? '-' : '+';
+		if (exponent < 0) exponent = -exponent;
+		if (exponent >= 100) *p++ = (char)('0' + exponent / 100);
+		if (exponent >= 10) *p++ = (char)('0' + exponent / 10 % 10);
+		*p++ = (char)('0' + exponent % 10);
+	}
+	return (int)(p - buffer);
+}
+
+
+/**
+ * Function: format_integer
+ * ----------------------------
+ *   writes an integer in decimal.
+ */
+
+static int format_integer(long long value, char* buffer) {
+	char digits[20];
+	unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+	int length = 0, count = 0;
+
+	do {
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude > 0);
+	if (value < 0) buffer[length++] = '-';
+	while (count > 0) buffer[length++] = digits[--count];
+	return length;
+}
+
+
+/**
+ * Function: injector_bind
+ * ----------------------------
+ *   binds an injector to a set of variables: the fixed parts of the command of each one
+ *   are written once, and the buffer of a send is sized for all of them.
+ *
+ *   @param injector:  the injector;
+ *   @param socket:    socket file descriptor;
+ *   @param variables: the names of the variables;
+ *   @param units:     the units of the values of each variable, NULL (or a NULL entry) for none;
+ *   @param count:     the number of variables.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int injector_bind(struct injector* injector, int socket, char** variables, char** units, int count) {
+	const char* prefix = "trick.var_set(\"";
+	size_t size = 0, used = 0;
+	struct injector_slot* slot;
+	int i;
+
+	memset(injector, 0, sizeof(struct injector));
+	if (count <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		size += strlen(prefix) + strlen(variables[i]) + 3 + 5 + (units != NULL && units[i] != NULL ? strlen(units[i]) : 0) + 2;
+	}
+	injector->socket = socket;
+	injector->count = count;
+	injector->slots = calloc(count, sizeof(struct injector_slot));
+	injector->texts = malloc(size);
+	injector->buffer = malloc(size + (size_t)count * INJECTOR_NUMBER_SIZE);
+	injector->updated = malloc(sizeof(int) * count);
+	if (injector->slots == NULL || injector->texts == NULL || injector->buffer == NULL || injector->updated == NULL) {
+		injector_destroy(injector);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		slot = &injector->slots[i];
+		slot->prefix = used;
+		used += sprintf(injector->texts + used, "%s%s\", ", prefix, variables[i]);
+		slot->prefix_length = used - slot->prefix;
+		slot->suffix = used;
+		if (units != NULL && units[i] != NULL) used += sprintf(injector->texts + used, ", \"%s\")\n", units[i]);
+		else used += sprintf(injector->texts + used, ")\n");
+		slot->suffix_length = used - slot->suffix;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: injector_destroy
+ * ----------------------------
+ *   releases an injector.
+ *
+ *   @param injector: the injector.
+ */
+
+void injector_destroy(struct injector* injector) {
+	free(injector->slots);
+	free(injector->texts);
+	free(injector->buffer);
+	free(injector->updated);
+	injector->slots = NULL;
+	injector->texts = NULL;
+	injector->buffer = NULL;
+	injector->updated = NULL;
+	injector->count = 0;
+	injector->updated_count = 0;
+}
+
+
+/**
+ * Function: mark
+ * ----------------------------
+ *   records that a variable has been set since the last send.
+ */
+
+static struct injector_slot* mark(struct injector* injector, int index) {
+	struct injector_slot* slot = &injector->slots[index];
+
+	if (!slot->updated) {
+		slot->updated = 1;
+		injector->updated[injector->updated_count++] = index;
+	}
+	return slot;
+}
+
+
+/**
+ * Function: injector_set_double
+ * ----------------------------
+ *   sets the value of a variable of floating-point type for the next send.
+ *
+ *   @param injector: the injector;
+ *   @param index:    the index of the variable;
+ *   @param value:    the value.
+ */
+
+void injector_set_double(struct injector* injector, int index, double value) {
+	struct injector_slot* slot = mark(injector, index);
+
+	slot->type = INJECTOR_DOUBLE;
+	slot->value = value;
+}
+
+
+/**
+ * Function: injector_set_integer
+ * ----------------------------
+ *   sets the value of a variable of integer type for the next send.
+ *
+ *   @param injector: the injector;
+ *   @param index:    the index of the variable;
+ *   @param value:    the value.
+ */
+
+void injector_set_integer(struct injector* injector, int index, long long value) {
+	struct injector_slot* slot = mark(injector, index);
+
+	slot->type = INJECTOR_INTEGER;
+	slot->integer = value;
+}
+
+
+/**
+ * Function: injector_send
+ * ----------------------------
+ *   writes the values set since the last send, one trick.var_set() per line, in one write
+ *   (more only if the socket accepts a part of it).
+ *
+ *   @param injector: the injector.
+ *
+ *   @return  the number of values written (0 if none was set). Otherwise, -1 is
+ *            returned and errno is set to indicate the error.
+ */
+
+int injector_send(struct injector* injector) {
+	char* p = injector->buffer;
+	struct injector_slot* slot;
+	unsigned long long start;
+	size_t left;
+	ssize_t sent;
+	int i, count = injector->updated_count;
+
+	if (count == 0) {
+		return 0;
+	}
+	start = injector->metrics != NULL ? metrics_now() : 0;
+	for (i = 0; i < count; i++) {
+		slot = &injector->slots[injector->updated[i]];
+		memcpy(p, injector->texts + slot->prefix, slot->prefix_length);
+		p += slot->prefix_length;
+		if (slot->type == INJECTOR_DOUBLE) p += injector_format_double(slot->value, p);
+		else p += format_integer(slot->integer, p);
+		memcpy(p, injector->texts + slot->suffix, slot->suffix_length);
+		p += slot->suffix_length;
+		slot->updated = 0;
+	}
+	injector->updated_count = 0;
+
+	left = p - injector->buffer;
+	p = injector->buffer;
+	while (left > 0) {
+		TRACE_BEGIN("send");
+		sent = send(injector->socket, p, left, MSG_NOSIGNAL);
+		TRACE_END("send");
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		metrics_add(injector->metrics, METRIC_SEND_CALLS, 1);
+		metrics_add(injector->metrics, METRIC_BYTES_SENT, (unsigned long long)sent);
+		p += sent;
+		left -= sent;
+	}
+	injector->sends++;
+	injector->values += count;
+	if (injector->metrics != NULL) {
+		metrics_add(injector->metrics, METRIC_COMMANDS_SENT, (unsigned long long)count);
+		metrics_add(injector->metrics, METRIC_SEND_TIME, metrics_now() - start);
+	}
+	return count;
+}
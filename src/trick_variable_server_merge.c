@@ -0,0 +1,348 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_merge.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Time-ordered merge of the frames received from several simulations.
+ */
+
+
+#include<stdlib.h>    //calloc,...
+#include<string.h>    //memcpy,...
+#include<errno.h>     //errno,...
+
+#include "../include/trick_variable_server_merge.h"
+
+
+/**
+ * Function: head_time
+ * ----------------------------
+ *   sim time of the oldest frame buffered for a source.
+ */
+
+static double head_time(const struct stream_merge* merge, int source) {
+	const struct merge_source* s = &merge->source[source];
+
+	return s->items[s->head].sim_time;
+}
+
+
+/**
+ * Function: before
+ * ----------------------------
+ *   heap order: earlier sim time first, lower source index on ties.
+ */
+
+static int before(const struct stream_merge* merge, int a, int b) {
+	double ta = head_time(merge, a);
+	double tb = head_time(merge, b);
+
+	return ta < tb || (ta == tb && a < b);
+}
+
+
+/**
+ * Function: sift_up
+ * ----------------------------
+ *   restores the heap order after an insertion at position i.
+ */
+
+static void sift_up(struct stream_merge* merge, int i) {
+	int parent, source = merge->heap[i];
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!before(merge, source, merge->heap[parent])) break;
+		merge->heap[i] = merge->heap[parent];
+		i = parent;
+	}
+	merge->heap[i] = source;
+}
+
+
+/**
+ * Function: sift_down
+ * ----------------------------
+ *   restores the heap order after the key at position i has grown.
+ */
+
+static void sift_down(struct stream_merge* merge, int i) {
+	int child, source = merge->heap[i];
+
+	while ((child = 2 * i + 1) < merge->heap_size) {
+		if (child + 1 < merge->heap_size && before(merge, merge->heap[child + 1], merge->heap[child])) child++;
+		if (!before(merge, merge->heap[child], source)) break;
+		merge->heap[i] = merge->heap[child];
+		i = child;
+	}
+	merge->heap[i] = source;
+}
+
+
+/**
+ * Function: update_skew
+ * ----------------------------
+ *   updates the spread of the latest sim times among the sources that have sent something.
+ */
+
+static void update_skew(struct stream_merge* merge) {
+	double lowest = 0.0, highest = 0.0;
+	int i, seen = 0;
+
+	for (i = 0; i < merge->sources; i++) {
+		if (merge->source[i].pushed == 0 || merge->source[i].finished) continue;
+		if (!seen || merge->source[i].last_sim_time < lowest) lowest = merge->source[i].last_sim_time;
+		if (!seen || merge->source[i].last_sim_time > highest) highest = merge->source[i].last_sim_time;
+		seen++;
+	}
+	if (seen < 2) return;
+	merge->skew = highest - lowest;
+	if (merge->skew > merge->max_skew) merge->max_skew = merge->skew;
+	merge->skew_sum += merge->skew;
+	merge->skew_samples++;
+}
+
+
+/**
+ * Function: merge_init
+ * ----------------------------
+ *   initializes the merge stage and preallocates all its buffers.
+ *
+ *   @param merge:     the merge stage;
+ *   @param sources:   the number of connections;
+ *   @param depth:     the number of frames buffered per connection;
+ *   @param max_frame: the largest frame accepted, in bytes;
+ *   @param lateness:  seconds to wait for a silent connection before emitting without it.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int merge_init(struct stream_merge* merge, int sources, int depth, unsigned int max_frame, double lateness) {
+	int i;
+
+	memset(merge, 0, sizeof(struct stream_merge));
+	if (sources <= 0 || depth <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	merge->sources = sources;
+	merge->depth = depth;
+	merge->max_frame = max_frame;
+	merge->lateness = lateness;
+	merge->source = calloc(sources, sizeof(struct merge_source));
+	merge->heap = calloc(sources, sizeof(int));
+	if (merge->source == NULL || merge->heap == NULL) {
+		merge_destroy(merge);
+		return -1;
+	}
+	for (i = 0; i < sources; i++) {
+		merge->source[i].items = calloc(depth, sizeof(struct merge_item));
+		merge->source[i].storage = malloc((size_t)depth * max_frame);
+		if (merge->source[i].items == NULL || merge->source[i].storage == NULL) {
+			merge_destroy(merge);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: merge_destroy
+ * ----------------------------
+ *   releases the buffers of the merge stage.
+ *
+ *   @param merge: the merge stage.
+ */
+
+void merge_destroy(struct stream_merge* merge) {
+	int i;
+
+	if (merge->source != NULL) {
+		for (i = 0; i < merge->sources; i++) {
+			free(merge->source[i].items);
+			free(merge->source[i].storage);
+		}
+	}
+	free(merge->source);
+	free(merge->heap);
+	merge->source = NULL;
+	merge->heap = NULL;
+	merge->heap_size = 0;
+}
+
+
+/**
+ * Function: merge_push
+ * ----------------------------
+ *   buffers a copy of a frame received from a source.
+ *
+ *   @param merge:        the merge stage;
+ *   @param source:       index of the source;
+ *   @param sim_time:     the sim time of the frame;
+ *   @param data:         the frame;
+ *   @param length:       the length of the frame;
+ *   @param arrival_time: the host CLOCK_MONOTONIC time of arrival, in seconds.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to @c EAGAIN if the queue of the source is full (call merge_pop() first),
+ *            @c EMSGSIZE if the frame is too large, @c EINVAL if the source is not valid.
+ */
+
+int merge_push(struct stream_merge* merge, int source, double sim_time, const void* data, unsigned int length, double arrival_time) {
+	struct merge_source* s;
+	struct merge_item* item;
+	int slot;
+
+	if (source < 0 || source >= merge->sources) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (length > merge->max_frame) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	s = &merge->source[source];
+	if (s->count == merge->depth) {
+		s->rejected++;
+		errno = EAGAIN;
+		return -1;
+	}
+
+	slot = (s->head + s->count) % merge->depth;
+	item = &s->items[slot];
+	item->sim_time = sim_time;
+	item->arrival_time = arrival_time;
+	item->source = source;
+	item->late = merge->emitted > 0 && sim_time < merge->last_emitted;
+	item->length = length;
+	item->data = s->storage + (size_t)slot * merge->max_frame;
+	memcpy(item->data, data, length);
+	if (item->late) merge->late_frames++;
+
+	s->count++;
+	s->pushed++;
+	s->finished = 0;
+	s->last_sim_time = sim_time;
+	s->last_arrival = arrival_time;
+	if (s->count == 1) {
+		merge->heap[merge->heap_size++] = source;
+		sift_up(merge, merge->heap_size - 1);
+	}
+	update_skew(merge);
+	return 0;
+}
+
+
+/**
+ * Function: merge_pop
+ * ----------------------------
+ *   emits the next frame in sim time order, if it is safe to do so: every source without
+ *   buffered frames must be finished, have already sent a frame at or past that sim time,
+ *   or have been silent for more than the lateness tolerance. A full queue forces the
+ *   emission so that buffering stays bounded.
+ *
+ *   @param merge: the merge stage;
+ *   @param now:   the current host CLOCK_MONOTONIC time, in seconds;
+ *   @param item:  filled with the frame; its data stays valid until the next merge_push() on the same source.
+ *
+ *   @return  1 if a frame was emitted, 0 if the merge must wait for more frames.
+ */
+
+int merge_pop(struct stream_merge* merge, double now, struct merge_item* item) {
+	struct merge_source* s;
+	double candidate;
+	int i, source, forced = 0, timeout = 0;
+
+	if (merge->heap_size == 0) {
+		return 0;
+	}
+	source = merge->heap[0];
+	candidate = head_time(merge, source);
+
+	for (i = 0; i < merge->sources; i++) {
+		if (merge->source[i].count == merge->depth) forced = 1;
+	}
+	if (!forced && merge->heap_size < merge->sources) {
+		for (i = 0; i < merge->sources; i++) {
+			s = &merge->source[i];
+			if (s->count > 0 || s->finished) continue;
+			if (s->pushed > 0 && s->last_sim_time >= candidate) continue;
+			if (now - (s->pushed > 0 ? s->last_arrival : merge->source[source].items[merge->source[source].head].arrival_time) > merge->lateness) {
+				timeout = 1;
+				continue;
+			}
+			return 0;
+		}
+	}
+
+	s = &merge->source[source];
+	*item = s->items[s->head];
+	s->head = (s->head + 1) % merge->depth;
+	s->count--;
+	if (s->count > 0) {
+		sift_down(merge, 0);
+	}
+	else {
+		merge->heap[0] = merge->heap[--merge->heap_size];
+		if (merge->heap_size > 0) sift_down(merge, 0);
+	}
+
+	if (forced) merge->forced++;
+	else if (timeout) merge->timeouts++;
+	merge->emitted++;
+	if (candidate > merge->last_emitted || merge->emitted == 1) merge->last_emitted = candidate;
+	return 1;
+}
+
+
+/**
+ * Function: merge_finish
+ * ----------------------------
+ *   marks a source as ended: the merge no longer waits for it. Pushing to the source
+ *   again makes it active again.
+ *
+ *   @param merge:  the merge stage;
+ *   @param source: index of the source.
+ */
+
+void merge_finish(struct stream_merge* merge, int source) {
+	if (source >= 0 && source < merge->sources) {
+		merge->source[source].finished = 1;
+	}
+}
+
+
+/**
+ * Function: merge_mean_skew
+ * ----------------------------
+ *   the average spread of the latest sim times of the sources.
+ *
+ *   @param merge: the merge stage.
+ *
+ *   @return  the mean skew in sim seconds.
+ */
+
+double merge_mean_skew(const struct stream_merge* merge) {
+	return merge->skew_samples > 0 ? merge->skew_sum / merge->skew_samples : 0.0;
+}
@@ -0,0 +1,257 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_metrics.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Per-connection counters of the traffic with the Trick Variable Server.
+ */
+
+
+#include<stdio.h>     //snprintf,...
+#include<stdarg.h>    //va_list,...
+#include<string.h>    //strlen,...
+#include<errno.h>     //errno,...
+
+#include "../include/trick_variable_server_metrics.h"
+
+
+/**
+ *   @brief name, help text and unit of each counter, in the order of enum metrics_counter_id.
+ */
+
+static const struct {
+	const char* name;
+	const char* help;
+	int seconds;
+} counters[METRIC_COUNT] = {
+	{ "commands_sent",      "Commands written to the Trick Variable Server.", 0 },
+	{ "send_calls",         "Write system calls.", 0 },
+	{ "bytes_sent",         "Bytes written to the Trick Variable Server.", 0 },
+	{ "recv_calls",         "Receive system calls.", 0 },
+	{ "bytes_received",     "Bytes received from the Trick Variable Server.", 0 },
+	{ "frames",             "Complete messages received.", 0 },
+	{ "parse_errors",       "Corrupted or undecodable messages.", 0 },
+	{ "partial_carryovers", "Reads that started with an incomplete message.", 0 },
+	{ "cycle_changes",      "Update periods changed by the rate controller.", 0 },
+	{ "send",               "Time spent writing commands.", 1 },
+	{ "receive",            "Time spent in receive system calls, waiting included.", 1 },
+	{ "parse",              "Time spent extracting messages.", 1 },
+	{ "decode",             "Time spent decoding values.", 1 },
+	{ "dispatch",           "Time spent in the message handlers.", 1 }
+};
+
+
+/**
+ *   @brief the output buffer of a rendering.
+ */
+
+struct output {
+	char* buffer;
+	size_t size;
+	size_t used;
+	int overflow;
+};
+
+
+/**
+ * Function: print
+ * ----------------------------
+ *   appends formatted text to the output; sets the overflow flag if it does not fit.
+ */
+
+static void print(struct output* out, const char* format, ...) {
+	va_list args;
+	int length;
+
+	if (out->overflow) {
+		return;
+	}
+	va_start(args, format);
+	length = vsnprintf(out->buffer + out->used, out->size - out->used, format, args);
+	va_end(args);
+	if (length < 0 || (size_t)length >= out->size - out->used) {
+		out->overflow = 1;
+		return;
+	}
+	out->used += (size_t)length;
+}
+
+
+/**
+ * Function: print_label
+ * ----------------------------
+ *   appends a connection name as a quoted string, escaping backslashes, quotes and newlines.
+ */
+
+static void print_label(struct output* out, const char* name) {
+	const char* p;
+
+	print(out, "\"");
+	for (p = name != NULL ? name : ""; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') print(out, "\\%c", *p);
+		else if (*p == '\n') print(out, "\\n");
+		else print(out, "%c", *p);
+	}
+	print(out, "\"");
+}
+
+
+/**
+ * Function: print_value
+ * ----------------------------
+ *   appends a counter value, converting nanoseconds to seconds without floating point.
+ */
+
+static void print_value(struct output* out, int id, unsigned long long value) {
+	if (counters[id].seconds) {
+		print(out, "%llu.%09llu", value / 1000000000ull, value % 1000000000ull);
+	}
+	else {
+		print(out, "%llu", value);
+	}
+}
+
+
+/**
+ * Function: metrics_init
+ * ----------------------------
+ *   initializes the counters of a connection to zero.
+ *
+ *   @param metrics: the counters;
+ *   @param name:    the name of the connection, used as label; it is not copied.
+ */
+
+void metrics_init(struct connection_metrics* metrics, const char* name) {
+	int i;
+
+	metrics->name = name;
+	for (i = 0; i < METRIC_COUNT; i++) {
+		atomic_init(&metrics->counter[i].value, 0);
+	}
+}
+
+
+/**
+ * Function: metrics_reset
+ * ----------------------------
+ *   sets all the counters of a connection back to zero.
+ *
+ *   @param metrics: the counters.
+ */
+
+void metrics_reset(struct connection_metrics* metrics) {
+	int i;
+
+	for (i = 0; i < METRIC_COUNT; i++) {
+		atomic_store_explicit(&metrics->counter[i].value, 0, memory_order_relaxed);
+	}
+}
+
+
+/**
+ * Function: metrics_snapshot
+ * ----------------------------
+ *   reads all the counters of a connection. Each counter is read atomically; the set
+ *   is not a consistent cut, as the connection may be updating them meanwhile.
+ *
+ *   @param metrics: the counters;
+ *   @param values:  filled with METRIC_COUNT values, indexed by enum metrics_counter_id.
+ */
+
+void metrics_snapshot(const struct connection_metrics* metrics, unsigned long long* values) {
+	int i;
+
+	for (i = 0; i < METRIC_COUNT; i++) {
+		values[i] = atomic_load_explicit((_Atomic unsigned long long*)&metrics->counter[i].value, memory_order_relaxed);
+	}
+}
+
+
+/**
+ * Function: metrics_render
+ * ----------------------------
+ *   renders the counters of several connections into a buffer, without allocating memory.
+ *   In the Prometheus format every counter is a family named trick_variable_server_<name>_total
+ *   (the times as trick_variable_server_<stage>_seconds_total) with one sample per connection,
+ *   labelled connection="<name>". In JSON the output is an array with one object per connection.
+ *
+ *   @param metrics: the connections;
+ *   @param count:   the number of connections;
+ *   @param format:  @c METRICS_PROMETHEUS or @c METRICS_JSON;
+ *   @param buffer:  the output, NUL-terminated;
+ *   @param size:    the size of the buffer.
+ *
+ *   @return  Upon successful completion, the function returns the length of the text.
+ *            Otherwise, -1 is returned and errno is set to @c ENOSPC if the buffer is too
+ *            small, or to @c EINVAL if the format is not valid.
+ */
+
+int metrics_render(struct connection_metrics* const* metrics, int count, int format, char* buffer, size_t size) {
+	struct output out = { buffer, size, 0, 0 };
+	const char* suffix;
+	int c, i;
+
+	if (format != METRICS_PROMETHEUS && format != METRICS_JSON) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (size == 0) {
+		errno = ENOSPC;
+		return -1;
+	}
+	buffer[0] = '\0';
+
+	if (format == METRICS_PROMETHEUS) {
+		for (i = 0; i < METRIC_COUNT; i++) {
+			suffix = counters[i].seconds ? "_seconds_total" : "_total";
+			print(&out, "# HELP trick_variable_server_%s%s %s\n", counters[i].name, suffix, counters[i].help);
+			print(&out, "# TYPE trick_variable_server_%s%s counter\n", counters[i].name, suffix);
+			for (c = 0; c < count; c++) {
+				print(&out, "trick_variable_server_%s%s{connection=", counters[i].name, suffix);
+				print_label(&out, metrics[c]->name);
+				print(&out, "} ");
+				print_value(&out, i, atomic_load_explicit(&metrics[c]->counter[i].value, memory_order_relaxed));
+				print(&out, "\n");
+			}
+		}
+	}
+	else {
+		print(&out, "[");
+		for (c = 0; c < count; c++) {
+			print(&out, c > 0 ? ",\n {\"connection\": " : "\n {\"connection\": ");
+			print_label(&out, metrics[c]->name);
+			for (i = 0; i < METRIC_COUNT; i++) {
+				print(&out, counters[i].seconds ? ", \"%s_seconds\": " : ", \"%s\": ", counters[i].name);
+				print_value(&out, i, atomic_load_explicit(&metrics[c]->counter[i].value, memory_order_relaxed));
+			}
+			print(&out, "}");
+		}
+		print(&out, "\n]\n");
+	}
+
+	if (out.overflow) {
+		buffer[out.used] = '\0';
+		errno = ENOSPC;
+		return -1;
+	}
+	return (int)out.used;
+}
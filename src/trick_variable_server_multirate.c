@@ -0,0 +1,506 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_multirate.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Variables at several rates, with one connection per rate group.
+ */
+
+
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //memmove,...
+#include<errno.h>         //errno,...
+#include<math.h>          //NAN,...
+#include<time.h>          //clock_gettime,...
+#include<sys/epoll.h>     //epoll_wait,...
+#include<sys/socket.h>    //MSG_DONTWAIT,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_multirate.h"
+
+
+/**
+ * Function: monotonic_time
+ * ----------------------------
+ *   the CLOCK_MONOTONIC time in seconds.
+ */
+
+static double monotonic_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: reserve_slot
+ * ----------------------------
+ *   makes room for one more slot in the session.
+ */
+
+static int reserve_slot(struct multirate_session* session) {
+	int capacity = session->capacity > 0 ? session->capacity * 2 : 16;
+	double* latest;
+	double* updated;
+	int* group_of;
+
+	if (session->count < session->capacity) {
+		return 0;
+	}
+	latest = realloc(session->latest, sizeof(double) * capacity);
+	if (latest == NULL) {
+		return -1;
+	}
+	session->latest = latest;
+	updated = realloc(session->updated, sizeof(double) * capacity);
+	if (updated == NULL) {
+		return -1;
+	}
+	session->updated = updated;
+	group_of = realloc(session->group_of, sizeof(int) * capacity);
+	if (group_of == NULL) {
+		return -1;
+	}
+	session->group_of = group_of;
+	session->capacity = capacity;
+	return 0;
+}
+
+
+/**
+ * Function: reserve_group_slot
+ * ----------------------------
+ *   makes room for one more variable in a group.
+ */
+
+static int reserve_group_slot(struct multirate_group* group) {
+	int capacity = group->capacity > 0 ? group->capacity * 2 : 16;
+	double* values;
+	int* slots;
+
+	if (group->subscription.count < group->capacity) {
+		return 0;
+	}
+	slots = realloc(group->slots, sizeof(int) * capacity);
+	if (slots == NULL) {
+		return -1;
+	}
+	group->slots = slots;
+	values = realloc(group->values, sizeof(double) * capacity);
+	if (values == NULL) {
+		return -1;
+	}
+	group->values = values;
+	group->capacity = capacity;
+	return 0;
+}
+
+
+/**
+ * Function: new_slot
+ * ----------------------------
+ *   assigns the next slot of the session to the last variable recorded in a group.
+ */
+
+static int new_slot(struct multirate_session* session, int group) {
+	struct multirate_group* g = &session->groups[group];
+	int slot = session->count++;
+
+	session->latest[slot] = NAN;
+	session->updated[slot] = 0.0;
+	session->group_of[slot] = group;
+	g->slots[g->subscription.count - 1] = slot;
+	return slot;
+}
+
+
+/**
+ * Function: decode_frame
+ * ----------------------------
+ *   decodes a message of a group and stores its values in the slots of its variables.
+ */
+
+static int decode_frame(struct multirate_session* session, struct multirate_group* group, const struct receiver_frame* frame, double now) {
+	int result, i;
+
+	result = subscription_decode(&group->subscription, frame->data, frame->length, group->values);
+	if (result <= 0) {
+		return result;
+	}
+	for (i = 0; i < group->subscription.count; i++) {
+		session->latest[group->slots[i]] = group->values[i];
+		session->updated[group->slots[i]] = now;
+	}
+	group->messages++;
+	group->last_arrival = now;
+	return 1;
+}
+
+
+/**
+ * Function: drain
+ * ----------------------------
+ *   decodes the messages already in the receive buffer of a group.
+ */
+
+static int drain(struct multirate_session* session, struct multirate_group* group, double now) {
+	struct receiver_frame frame;
+	int result, decoded = 0;
+
+	while ((result = receiver_next_frame(&group->session.receiver, &frame)) > 0) {
+		result = decode_frame(session, group, &frame, now);
+		if (result < 0) {
+			return -1;
+		}
+		decoded += result;
+	}
+	return result < 0 ? -1 : decoded;
+}
+
+
+/**
+ * Function: start_group
+ * ----------------------------
+ *   starts the connection of a group with its variables and records them.
+ */
+
+static int start_group(struct multirate_session* session, int group, char* host, int port, const struct multirate_group_config* setup,
+	const struct multirate_variable* variables, int count, double timeout) {
+	struct multirate_group* g = &session->groups[group];
+	struct session_config config;
+	struct epoll_event event;
+	char** names;
+	char** units;
+	int i, n, result = -1;
+
+	names = malloc(sizeof(char*) * (count > 0 ? count : 1));
+	units = malloc(sizeof(char*) * (count > 0 ? count : 1));
+	if (names == NULL || units == NULL) {
+		free(names);
+		free(units);
+		return -1;
+	}
+	for (i = 0, n = 0; i < count; i++) {
+		if (variables[i].group == group) {
+			names[n] = (char*)variables[i].name;
+			units[n++] = (char*)variables[i].units;
+		}
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.client_tag = setup->client_tag;
+	config.format = SESSION_BINARY_NO_NAMES;
+	config.cycle = setup->cycle;
+	config.copy_mode = setup->copy_mode;
+	config.variables = names;
+	config.units = units;
+	config.count = n;
+	config.timeout = timeout;
+	if (session_start(&g->session, host, port, &config) < 0) {
+		goto done;
+	}
+	subscription_init(&g->subscription, g->session.socket, 0);
+
+	/* the slots follow the order of the variables, whatever their group */
+	for (i = 0; i < count; i++) {
+		if (variables[i].group != group) continue;
+		if (reserve_group_slot(g) < 0 || subscription_record(&g->subscription, variables[i].name) < 0) {
+			goto done;
+		}
+		g->slots[g->subscription.count - 1] = i;
+		session->group_of[i] = group;
+	}
+
+	event.events = EPOLLIN;
+	event.data.u32 = (unsigned int)group;
+	if (epoll_ctl(session->epoll, EPOLL_CTL_ADD, g->session.socket, &event) < 0) {
+		goto done;
+	}
+	if (decode_frame(session, g, &g->session.first_frame, monotonic_time()) < 0) {
+		goto done;
+	}
+	result = 0;
+
+done:
+	free(names);
+	free(units);
+	return result;
+}
+
+
+/**
+ * Function: multirate_open
+ * ----------------------------
+ *   starts one connection per group, each with the pipelined setup of session_start(),
+ *   and stores the values of their first messages.
+ *
+ *   @param session:     the session;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param groups:      the setup of each group;
+ *   @param group_count: the number of groups;
+ *   @param variables:   the variables, each with its group: their slots follow this order;
+ *   @param count:       the number of variables;
+ *   @param timeout:     seconds to wait for the first message of each group, 0 to wait forever.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to indicate the error, @c EINVAL if a group has no variables.
+ */
+
+int multirate_open(struct multirate_session* session, char* host, int port, const struct multirate_group_config* groups, int group_count,
+	const struct multirate_variable* variables, int count, double timeout) {
+	int g, i, error;
+
+	memset(session, 0, sizeof(struct multirate_session));
+	session->epoll = -1;
+	if (group_count <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (variables[i].group < 0 || variables[i].group >= group_count) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	/* every group needs a variable: checked before any connection is made */
+	for (g = 0; g < group_count; g++) {
+		for (i = 0; i < count && variables[i].group != g; i++);
+		if (i == count) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	session->groups = calloc(group_count, sizeof(struct multirate_group));
+	if (session->groups == NULL) {
+		return -1;
+	}
+	session->group_count = group_count;
+	for (g = 0; g < group_count; g++) {
+		session->groups[g].session.socket = -1;
+	}
+	while (session->capacity < count) {
+		if (reserve_slot(session) < 0) {
+			goto failed;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		session->latest[i] = NAN;
+		session->updated[i] = 0.0;
+	}
+	session->count = count;
+	session->epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (session->epoll < 0) {
+		goto failed;
+	}
+	for (g = 0; g < group_count; g++) {
+		if (start_group(session, g, host, port, &groups[g], variables, count, timeout) < 0) {
+			goto failed;
+		}
+	}
+	return 0;
+
+failed:
+	error = errno;
+	multirate_close(session);
+	errno = error;
+	return -1;
+}
+
+
+/**
+ * Function: multirate_close
+ * ----------------------------
+ *   closes the connections of all the groups and releases the session.
+ *
+ *   @param session: the session.
+ */
+
+void multirate_close(struct multirate_session* session) {
+	struct multirate_group* g;
+	int i;
+
+	for (i = 0; i < session->group_count; i++) {
+		g = &session->groups[i];
+		if (g->session.socket >= 0) {
+			subscription_destroy(&g->subscription);
+			session_close(&g->session);
+		}
+		free(g->slots);
+		free(g->values);
+	}
+	if (session->epoll >= 0) {
+		close_socket(session->epoll);
+	}
+	free(session->groups);
+	free(session->latest);
+	free(session->updated);
+	free(session->group_of);
+	memset(session, 0, sizeof(struct multirate_session));
+	session->epoll = -1;
+}
+
+
+/**
+ * Function: multirate_add
+ * ----------------------------
+ *   adds a variable to a group. The messages still in flight without it are skipped
+ *   by the subscription of the group.
+ *
+ *   @param session:       the session;
+ *   @param variable_name: name of the variable to be observed;
+ *   @param units:         units of measure of the variable, NULL for the default ones;
+ *   @param group:         index of the rate group.
+ *
+ *   @return  the slot of the variable. Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int multirate_add(struct multirate_session* session, const char* variable_name, const char* units, int group) {
+	struct multirate_group* g;
+	int result;
+
+	if (group < 0 || group >= session->group_count) {
+		errno = EINVAL;
+		return -1;
+	}
+	g = &session->groups[group];
+	if (reserve_slot(session) < 0 || reserve_group_slot(g) < 0) {
+		return -1;
+	}
+	if (units != NULL) {
+		result = subscription_add_with_units(&g->subscription, variable_name, units);
+	}
+	else {
+		result = subscription_add(&g->subscription, variable_name);
+	}
+	return result < 0 ? -1 : new_slot(session, group);
+}
+
+
+/**
+ * Function: multirate_remove
+ * ----------------------------
+ *   removes a variable from its group. The slots of the other variables do not change.
+ *
+ *   @param session: the session;
+ *   @param slot:    the slot of the variable.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int multirate_remove(struct multirate_session* session, int slot) {
+	struct multirate_group* g;
+	int i;
+
+	if (slot < 0 || slot >= session->count || session->group_of[slot] < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	g = &session->groups[session->group_of[slot]];
+	for (i = 0; i < g->subscription.count && g->slots[i] != slot; i++);
+	if (subscription_remove(&g->subscription, g->subscription.variables[i]) < 0) {
+		return -1;
+	}
+	memmove(g->slots + i, g->slots + i + 1, sizeof(int) * (g->subscription.count - i));
+	session->group_of[slot] = -1;
+	session->latest[slot] = NAN;
+	session->updated[slot] = 0.0;
+	return 0;
+}
+
+
+/**
+ * Function: multirate_poll
+ * ----------------------------
+ *   decodes the messages received on all the connections: those already buffered, then
+ *   those of the connections that are ready, waiting for one if nothing was buffered.
+ *
+ *   @param session: the session;
+ *   @param timeout: seconds to wait when nothing has been received, 0 not to wait, -1 to wait forever.
+ *
+ *   @return  the number of messages decoded (0 on timeout). Otherwise, -1 is returned and errno
+ *            is set to indicate the error, @c ECONNRESET if a connection was closed.
+ */
+
+int multirate_poll(struct multirate_session* session, double timeout) {
+	struct epoll_event events[MULTIRATE_MAX_EVENTS];
+	struct multirate_group* g;
+	double now = monotonic_time();
+	int decoded = 0, ready, result, i;
+
+	for (i = 0; i < session->group_count; i++) {
+		result = drain(session, &session->groups[i], now);
+		if (result < 0) {
+			return -1;
+		}
+		decoded += result;
+	}
+
+	ready = epoll_wait(session->epoll, events, MULTIRATE_MAX_EVENTS, decoded > 0 || timeout == 0.0 ? 0 : timeout < 0.0 ? -1 : (int)(timeout * 1000.0 + 0.5));
+	if (ready < 0) {
+		return errno == EINTR ? decoded : -1;
+	}
+	now = monotonic_time();
+	for (i = 0; i < ready; i++) {
+		g = &session->groups[events[i].data.u32];
+		result = receiver_read(&g->session.receiver, MSG_DONTWAIT);
+		if (result == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (result < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+			return -1;
+		}
+		result = drain(session, g, now);
+		if (result < 0) {
+			return -1;
+		}
+		decoded += result;
+	}
+	return decoded;
+}
+
+
+/**
+ * Function: multirate_latest
+ * ----------------------------
+ *   the latest value of a variable, whatever its group.
+ *
+ *   @param session: the session;
+ *   @param slot:    the slot of the variable;
+ *   @param updated: if not NULL, filled with the CLOCK_MONOTONIC arrival time of the value (0 if none yet).
+ *
+ *   @return  the value, NaN if none has been received yet or the slot is not valid.
+ */
+
+double multirate_latest(const struct multirate_session* session, int slot, double* updated) {
+	if (slot < 0 || slot >= session->count) {
+		if (updated != NULL) *updated = 0.0;
+		return NAN;
+	}
+	if (updated != NULL) *updated = session->updated[slot];
+	return session->latest[slot];
+}
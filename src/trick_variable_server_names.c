@@ -0,0 +1,354 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_names.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Interned variable names with their commands encoded once.
+ *
+ * A name is hashed a word at a time; a lookup compares the bytes only against the names
+ * with the same hash and length.
+ */
+
+
+#include<stdlib.h>    //malloc,...
+#include<string.h>    //memcpy,...
+#include<errno.h>     //errno,...
+
+#include "../include/trick_variable_server_names.h"
+
+#define ADD_PREFIX "trick.var_add(\""
+#define REMOVE_PREFIX "trick.var_remove(\""
+#define SUFFIX "\")\n"
+
+
+/**
+ * Function: hash_name
+ * ----------------------------
+ *   hashes a name eight bytes at a time and returns its length.
+ */
+
+static unsigned int hash_name(const char* name, unsigned int* length) {
+	size_t n = strlen(name), i;
+	unsigned long long hash = n, word;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		memcpy(&word, name + i, 8);
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	if (i < n) {
+		word = 0;
+		memcpy(&word, name + i, n - i);
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	*length = (unsigned int)n;
+	return (unsigned int)(hash ^ (hash >> 32));
+}
+
+
+/**
+ * Function: lookup
+ * ----------------------------
+ *   the bucket holding a name, or the empty bucket where it would go.
+ */
+
+static unsigned int lookup(const struct name_table* table, const char* name, unsigned int length, unsigned int hash) {
+	unsigned int bucket = hash & table->mask;
+	const struct name_entry* entry;
+
+	while (table->buckets[bucket] != 0) {
+		entry = &table->entries[table->buckets[bucket] - 1];
+		if (entry->hash == hash && entry->name_length == length && memcmp(entry->name, name, length) == 0) {
+			break;
+		}
+		bucket = (bucket + 1) & table->mask;
+	}
+	return bucket;
+}
+
+
+/**
+ * Function: grow_buckets
+ * ----------------------------
+ *   doubles the buckets and puts the names back in them.
+ */
+
+static int grow_buckets(struct name_table* table) {
+	unsigned int size = (table->mask + 1) * 2, bucket;
+	int* buckets = calloc(size, sizeof(int));
+	int id;
+
+	if (buckets == NULL) {
+		return -1;
+	}
+	free(table->buckets);
+	table->buckets = buckets;
+	table->mask = size - 1;
+	for (id = 0; id < table->count; id++) {
+		bucket = table->entries[id].hash & table->mask;
+		while (table->buckets[bucket] != 0) {
+			bucket = (bucket + 1) & table->mask;
+		}
+		table->buckets[bucket] = id + 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: allocate
+ * ----------------------------
+ *   room for the bytes of a name, from the current block or a new one.
+ */
+
+static char* allocate(struct name_table* table, size_t size) {
+	struct name_block* block = table->blocks;
+	size_t block_size;
+
+	if (block == NULL || block->used + size > block->size) {
+		block_size = size > NAMES_BLOCK_SIZE ? size : NAMES_BLOCK_SIZE;
+		block = malloc(sizeof(struct name_block) + block_size);
+		if (block == NULL) {
+			return NULL;
+		}
+		block->next = table->blocks;
+		block->used = 0;
+		block->size = block_size;
+		table->blocks = block;
+	}
+	block->used += size;
+	return block->data + block->used - size;
+}
+
+
+/**
+ * Function: names_init
+ * ----------------------------
+ *   initializes an empty table.
+ *
+ *   @param table:    the table;
+ *   @param capacity: the number of names expected (the table grows beyond it).
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_init(struct name_table* table, int capacity) {
+	unsigned int buckets = 16;
+
+	memset(table, 0, sizeof(struct name_table));
+	if (capacity < 16) {
+		capacity = 16;
+	}
+	/* at most half of the buckets are used */
+	while (buckets < (unsigned int)capacity * 2) {
+		buckets *= 2;
+	}
+	table->entries = malloc(sizeof(struct name_entry) * capacity);
+	table->buckets = calloc(buckets, sizeof(int));
+	if (table->entries == NULL || table->buckets == NULL) {
+		free(table->entries);
+		free(table->buckets);
+		return -1;
+	}
+	table->capacity = capacity;
+	table->mask = buckets - 1;
+	return 0;
+}
+
+
+/**
+ * Function: names_destroy
+ * ----------------------------
+ *   releases the table and all its names.
+ *
+ *   @param table: the table.
+ */
+
+void names_destroy(struct name_table* table) {
+	struct name_block* block;
+
+	while (table->blocks != NULL) {
+		block = table->blocks;
+		table->blocks = block->next;
+		free(block);
+	}
+	free(table->entries);
+	free(table->buckets);
+	memset(table, 0, sizeof(struct name_table));
+}
+
+
+/**
+ * Function: names_intern
+ * ----------------------------
+ *   the identifier of a name, interning it and encoding its commands the first time.
+ *
+ *   @param table: the table;
+ *   @param name:  the name of the variable.
+ *
+ *   @return  the identifier, from 0 in order of interning. Otherwise, -1 is returned and
+ *            errno is set to indicate the error.
+ */
+
+int names_intern(struct name_table* table, const char* name) {
+	struct name_entry* entries;
+	struct name_entry* entry;
+	unsigned int length, hash, bucket;
+	size_t add_length, remove_length;
+	char* bytes;
+	int capacity;
+
+	hash = hash_name(name, &length);
+	bucket = lookup(table, name, length, hash);
+	if (table->buckets[bucket] != 0) {
+		return table->buckets[bucket] - 1;
+	}
+
+	if (table->count == table->capacity) {
+		capacity = table->capacity * 2;
+		entries = realloc(table->entries, sizeof(struct name_entry) * capacity);
+		if (entries == NULL) {
+			return -1;
+		}
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+	if ((unsigned int)(table->count + 1) * 2 > table->mask + 1) {
+		if (grow_buckets(table) < 0) {
+			return -1;
+		}
+		bucket = lookup(table, name, length, hash);
+	}
+
+	add_length = sizeof(ADD_PREFIX) - 1 + length + sizeof(SUFFIX) - 1;
+	remove_length = sizeof(REMOVE_PREFIX) - 1 + length + sizeof(SUFFIX) - 1;
+	bytes = allocate(table, add_length + remove_length + length + 1);
+	if (bytes == NULL) {
+		return -1;
+	}
+	entry = &table->entries[table->count];
+	entry->add = bytes;
+	memcpy(bytes, ADD_PREFIX, sizeof(ADD_PREFIX) - 1);
+	memcpy(bytes + sizeof(ADD_PREFIX) - 1, name, length);
+	memcpy(bytes + sizeof(ADD_PREFIX) - 1 + length, SUFFIX, sizeof(SUFFIX) - 1);
+	bytes += add_length;
+	entry->remove = bytes;
+	memcpy(bytes, REMOVE_PREFIX, sizeof(REMOVE_PREFIX) - 1);
+	memcpy(bytes + sizeof(REMOVE_PREFIX) - 1, name, length);
+	memcpy(bytes + sizeof(REMOVE_PREFIX) - 1 + length, SUFFIX, sizeof(SUFFIX) - 1);
+	bytes += remove_length;
+	entry->name = bytes;
+	memcpy(bytes, name, length + 1);
+	entry->add_length = (unsigned int)add_length;
+	entry->remove_length = (unsigned int)remove_length;
+	entry->name_length = length;
+	entry->hash = hash;
+
+	table->buckets[bucket] = table->count + 1;
+	return table->count++;
+}
+
+
+/**
+ * Function: names_find
+ * ----------------------------
+ *   the identifier of a name already interned.
+ *
+ *   @param table: the table;
+ *   @param name:  the name of the variable.
+ *
+ *   @return  the identifier. Otherwise, -1 is returned and errno is set to @c ENOENT.
+ */
+
+int names_find(const struct name_table* table, const char* name) {
+	unsigned int length, hash = hash_name(name, &length);
+	unsigned int bucket = lookup(table, name, length, hash);
+
+	if (table->buckets[bucket] == 0) {
+		errno = ENOENT;
+		return -1;
+	}
+	return table->buckets[bucket] - 1;
+}
+
+
+/**
+ * Function: names_name
+ * ----------------------------
+ *   the name of an identifier.
+ *
+ *   @param table: the table;
+ *   @param id:    the identifier.
+ *
+ *   @return  the name, NULL if the identifier is not valid.
+ */
+
+const char* names_name(const struct name_table* table, int id) {
+	return id >= 0 && id < table->count ? table->entries[id].name : NULL;
+}
+
+
+/**
+ * Function: names_write_add
+ * ----------------------------
+ *   appends the cached trick.var_add() command of a name to a writer.
+ *
+ *   @param table:  the table;
+ *   @param writer: the command writer;
+ *   @param id:     the identifier.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_write_add(const struct name_table* table, struct command_writer* writer, int id) {
+	if (id < 0 || id >= table->count) {
+		errno = EINVAL;
+		return -1;
+	}
+	return command_writer_encoded(writer, table->entries[id].add, table->entries[id].add_length, 1);
+}
+
+
+/**
+ * Function: names_write_remove
+ * ----------------------------
+ *   appends the cached trick.var_remove() command of a name to a writer.
+ *
+ *   @param table:  the table;
+ *   @param writer: the command writer;
+ *   @param id:     the identifier.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int names_write_remove(const struct name_table* table, struct command_writer* writer, int id) {
+	if (id < 0 || id >= table->count) {
+		errno = EINVAL;
+		return -1;
+	}
+	return command_writer_encoded(writer, table->entries[id].remove, table->entries[id].remove_length, 1);
+}
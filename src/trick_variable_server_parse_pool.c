@@ -0,0 +1,601 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file trick_variable_server_parse_pool.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Work-stealing pool of threads decoding the binary messages of many connections.
+ *
+ * The task queues are bounded arrays of cells, each with a sequence number telling in which
+ * lap of the array the cell can be written or read: producers and consumers only contend on
+ * the two positions, with one compare-and-swap per operation. A queue has room for all the
+ * slots of the pool, so queuing the task of a free slot never fails.
+ */
+
+
+#include<stdlib.h>    //calloc,...
+#include<string.h>    //memcpy,...
+#include<errno.h>     //errno,...
+#include<sched.h>     //sched_yield,...
+
+#include "../include/trick_variable_server_parse_pool.h"
+
+#define PARSE_POOL_SPINS 64
+
+
+/**
+ * Function: enqueue
+ * ----------------------------
+ *   appends a task to the queue of a worker.
+ */
+
+static int enqueue(struct parse_worker* worker, unsigned int task) {
+	struct parse_cell* cell;
+	size_t position = atomic_load_explicit(&worker->enqueue_position, memory_order_relaxed);
+	size_t sequence;
+	long difference;
+
+	for (;;) {
+		cell = &worker->cells[position & worker->mask];
+		sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		difference = (long)sequence - (long)position;
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&worker->enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&worker->enqueue_position, memory_order_relaxed);
+		}
+	}
+	cell->task = task;
+	atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+	return 1;
+}
+
+
+/**
+ * Function: dequeue
+ * ----------------------------
+ *   takes the oldest task of the queue of a worker, by the worker itself or by a thief.
+ */
+
+static int dequeue(struct parse_worker* worker, unsigned int* task) {
+	struct parse_cell* cell;
+	size_t position = atomic_load_explicit(&worker->dequeue_position, memory_order_relaxed);
+	size_t sequence;
+	long difference;
+
+	for (;;) {
+		cell = &worker->cells[position & worker->mask];
+		sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		difference = (long)sequence - (long)(position + 1);
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&worker->dequeue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&worker->dequeue_position, memory_order_relaxed);
+		}
+	}
+	*task = cell->task;
+	atomic_store_explicit(&cell->sequence, position + worker->mask + 1, memory_order_release);
+	atomic_fetch_sub_explicit(&worker->queued, 1, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&worker->pool->queued, 1, memory_order_relaxed);
+	return 1;
+}
+
+
+/**
+ * Function: wake
+ * ----------------------------
+ *   wakes a worker if it is sleeping.
+ */
+
+static int wake(struct parse_worker* worker) {
+	if (!atomic_load(&worker->sleeping)) {
+		return 0;
+	}
+	pthread_mutex_lock(&worker->lock);
+	pthread_cond_signal(&worker->wake);
+	pthread_mutex_unlock(&worker->lock);
+	return 1;
+}
+
+
+/**
+ * Function: steal
+ * ----------------------------
+ *   takes a task from the queue of another worker, starting from the next one.
+ */
+
+static int steal(struct parse_worker* worker, unsigned int* task) {
+	struct parse_pool* pool = worker->pool;
+	int i;
+
+	for (i = 1; i < pool->workers; i++) {
+		if (dequeue(&pool->worker[(worker->index + i) % pool->workers], task)) {
+			worker->stolen++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: reclaim
+ * ----------------------------
+ *   frees the replaced plans that no worker can be using any more: those retired before
+ *   the epoch in which every busy worker started its frame. Called with the lock held.
+ */
+
+static void reclaim(struct parse_pool* pool) {
+	struct parse_plan** link = &pool->retired;
+	struct parse_plan* plan;
+	unsigned long oldest = ~0ul, epoch;
+	int w;
+
+	for (w = 0; w < pool->workers; w++) {
+		epoch = atomic_load(&pool->worker[w].epoch);
+		if (epoch != 0 && epoch < oldest) oldest = epoch;
+	}
+	while (*link != NULL) {
+		plan = *link;
+		if (plan->retired < oldest) {
+			*link = plan->next;
+			decode_plan_destroy(&plan->plan);
+			free(plan);
+		}
+		else {
+			link = &plan->next;
+		}
+	}
+}
+
+
+/**
+ * Function: shared_plan
+ * ----------------------------
+ *   the decode plan of a connection for the given frame, compiling and publishing a new one
+ *   if the layout (length, number of variables and type codes) has changed. A plan that loses
+ *   the race to be published is returned with *own set, and must be freed by the caller after
+ *   use. The caller must have published the epoch of its frame.
+ */
+
+static struct parse_plan* shared_plan(struct parse_pool* pool, struct parse_connection* connection, const unsigned char* frame, unsigned int length, int* own) {
+	struct parse_plan* plan = atomic_load(&connection->plan);
+	struct parse_plan* fresh;
+
+	*own = 0;
+	if (plan != NULL && decode_plan_matches(&plan->plan, frame, length)) {
+		return plan;
+	}
+	fresh = calloc(1, sizeof(struct parse_plan));
+	if (fresh == NULL) {
+		return NULL;
+	}
+	if (decode_plan_compile(&fresh->plan, frame, length, pool->names) < 0) {
+		decode_plan_destroy(&fresh->plan);
+		free(fresh);
+		return NULL;
+	}
+	if (!atomic_compare_exchange_strong(&connection->plan, &plan, fresh)) {
+		*own = 1;
+		return fresh;
+	}
+	if (plan != NULL) {
+		/* the workers that started a frame up to this epoch may still be decoding with it */
+		pthread_mutex_lock(&pool->retired_lock);
+		plan->retired = atomic_fetch_add(&pool->epoch, 1);
+		plan->next = pool->retired;
+		pool->retired = plan;
+		reclaim(pool);
+		pthread_mutex_unlock(&pool->retired_lock);
+	}
+	return fresh;
+}
+
+
+/**
+ * Function: parse
+ * ----------------------------
+ *   decodes the frame of a slot and hands the slot to the collecting thread.
+ */
+
+static void parse(struct parse_worker* worker, unsigned int task) {
+	struct parse_pool* pool = worker->pool;
+	struct parse_connection* connection = &pool->connection[task / pool->depth];
+	struct parse_slot* slot = &connection->slots[task % pool->depth];
+	struct parse_plan* plan;
+	unsigned int indicator, count;
+	int own;
+
+	slot->status = -1;
+	slot->count = 0;
+	if (slot->length >= 12) {
+		memcpy(&indicator, slot->data, 4);
+		memcpy(&count, slot->data + 8, 4);
+		if (indicator != 0) {
+			slot->status = 0;
+		}
+		else if (count <= (unsigned int)pool->max_variables) {
+			/* published before loading the plan, which cannot be freed until it is cleared */
+			atomic_store(&worker->epoch, atomic_load(&pool->epoch));
+			plan = shared_plan(pool, connection, slot->data, slot->length, &own);
+			if (plan != NULL) {
+				slot->count = decode_plan_decode(&plan->plan, slot->data, slot->length, slot->values);
+				if (own) {
+					decode_plan_destroy(&plan->plan);
+					free(plan);
+				}
+			}
+			else if (errno == ENOTSUP) {
+				slot->count = decode_frame_generic(slot->data, slot->length, pool->names, slot->values, pool->max_variables);
+			}
+			atomic_store(&worker->epoch, 0);
+			slot->status = slot->count < 0 ? -1 : 1;
+		}
+	}
+	slot->worker = worker->index;
+	worker->parsed++;
+	atomic_store_explicit(&slot->state, PARSE_SLOT_DONE, memory_order_release);
+}
+
+
+/**
+ * Function: run_worker
+ * ----------------------------
+ *   the loop of a worker: its own queue first, then the others, then sleep.
+ */
+
+static void* run_worker(void* argument) {
+	struct parse_worker* worker = argument;
+	struct parse_pool* pool = worker->pool;
+	unsigned int task;
+	int spins = 0;
+
+	while (!atomic_load_explicit(&pool->stopping, memory_order_relaxed)) {
+		if (dequeue(worker, &task) || (pool->steal && steal(worker, &task))) {
+			parse(worker, task);
+			spins = 0;
+			continue;
+		}
+		if (++spins < PARSE_POOL_SPINS) {
+			sched_yield();
+			continue;
+		}
+		pthread_mutex_lock(&worker->lock);
+		atomic_store(&worker->sleeping, 1);
+		/* checked after announcing the sleep: a submission either sees it or is seen here */
+		while (!atomic_load(&pool->stopping) && atomic_load(pool->steal ? &pool->queued : &worker->queued) == 0) {
+			pthread_cond_wait(&worker->wake, &worker->lock);
+		}
+		atomic_store(&worker->sleeping, 0);
+		pthread_mutex_unlock(&worker->lock);
+		spins = 0;
+	}
+	return NULL;
+}
+
+
+/**
+ * Function: release_queues
+ * ----------------------------
+ *   releases the queues of the first workers, whose threads are not running.
+ */
+
+static void release_queues(struct parse_pool* pool, int count) {
+	int w;
+
+	for (w = 0; w < count; w++) {
+		pthread_mutex_destroy(&pool->worker[w].lock);
+		pthread_cond_destroy(&pool->worker[w].wake);
+		free(pool->worker[w].cells);
+	}
+}
+
+
+/**
+ * Function: parse_pool_init
+ * ----------------------------
+ *   allocates the slots and the queues and starts the workers.
+ *
+ *   @param pool:          the pool;
+ *   @param workers:       the number of worker threads;
+ *   @param connections:   the number of connections;
+ *   @param depth:         the number of frames in flight per connection;
+ *   @param max_frame:     the largest frame accepted, in bytes;
+ *   @param max_variables: the largest number of variables of a frame;
+ *   @param names:         1 if the messages carry the variable names (set_binary()), 0 otherwise;
+ *   @param steal:         1 to let the idle workers steal, 0 to decode every connection on its home worker.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int parse_pool_init(struct parse_pool* pool, int workers, int connections, int depth, unsigned int max_frame, int max_variables, int names, int steal) {
+	struct parse_worker* worker;
+	struct parse_slot* slot;
+	size_t cells = 1, slot_size, i;
+	int c, s, w, result;
+
+	memset(pool, 0, sizeof(struct parse_pool));
+	if (workers <= 0 || connections <= 0 || depth <= 0 || max_variables <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	pool->workers = workers;
+	pool->connections = connections;
+	pool->depth = depth;
+	pool->max_frame = max_frame;
+	pool->max_variables = max_variables;
+	pool->names = names;
+	pool->steal = steal;
+	atomic_init(&pool->queued, 0);
+	atomic_init(&pool->stopping, 0);
+	atomic_init(&pool->epoch, 1);
+	pthread_mutex_init(&pool->retired_lock, NULL);
+
+	/* frames and values of every slot in one block, values first to keep them aligned */
+	slot_size = sizeof(double) * max_variables + ((max_frame + 7) & ~7u);
+	pool->storage = malloc(slot_size * connections * depth);
+	pool->connection = aligned_alloc(PARSE_POOL_CACHE_LINE, sizeof(struct parse_connection) * connections);
+	pool->worker = aligned_alloc(PARSE_POOL_CACHE_LINE, sizeof(struct parse_worker) * workers);
+	if (pool->storage == NULL || pool->connection == NULL || pool->worker == NULL) {
+		free(pool->storage);
+		free(pool->connection);
+		free(pool->worker);
+		pthread_mutex_destroy(&pool->retired_lock);
+		return -1;
+	}
+	memset(pool->connection, 0, sizeof(struct parse_connection) * connections);
+	memset(pool->worker, 0, sizeof(struct parse_worker) * workers);
+
+	for (c = 0; c < connections; c++) {
+		atomic_init(&pool->connection[c].plan, NULL);
+		pool->connection[c].slots = calloc(depth, sizeof(struct parse_slot));
+		if (pool->connection[c].slots == NULL) {
+			pool->workers = 0;
+			parse_pool_destroy(pool);
+			errno = ENOMEM;
+			return -1;
+		}
+		for (s = 0; s < depth; s++) {
+			slot = &pool->connection[c].slots[s];
+			atomic_init(&slot->state, PARSE_SLOT_FREE);
+			slot->values = (double*)(pool->storage + slot_size * ((size_t)c * depth + s));
+			slot->data = (unsigned char*)(slot->values + max_variables);
+		}
+	}
+
+	while (cells < (size_t)connections * depth) cells *= 2;
+	for (w = 0; w < workers; w++) {
+		worker = &pool->worker[w];
+		worker->pool = pool;
+		worker->index = w;
+		worker->mask = cells - 1;
+		worker->cells = calloc(cells, sizeof(struct parse_cell));
+		if (worker->cells == NULL) {
+			release_queues(pool, w);
+			pool->workers = 0;
+			parse_pool_destroy(pool);
+			errno = ENOMEM;
+			return -1;
+		}
+		for (i = 0; i < cells; i++) {
+			atomic_init(&worker->cells[i].sequence, i);
+		}
+		atomic_init(&worker->enqueue_position, 0);
+		atomic_init(&worker->dequeue_position, 0);
+		atomic_init(&worker->queued, 0);
+		atomic_init(&worker->sleeping, 0);
+		atomic_init(&worker->epoch, 0);
+		pthread_mutex_init(&worker->lock, NULL);
+		pthread_cond_init(&worker->wake, NULL);
+	}
+	for (w = 0; w < workers; w++) {
+		result = pthread_create(&pool->worker[w].thread, NULL, run_worker, &pool->worker[w]);
+		if (result != 0) {
+			/* the workers already started are stopped and joined, the others only released */
+			atomic_store(&pool->stopping, 1);
+			for (c = 0; c < w; c++) {
+				pthread_mutex_lock(&pool->worker[c].lock);
+				pthread_cond_signal(&pool->worker[c].wake);
+				pthread_mutex_unlock(&pool->worker[c].lock);
+				pthread_join(pool->worker[c].thread, NULL);
+			}
+			release_queues(pool, workers);
+			pool->workers = 0;
+			parse_pool_destroy(pool);
+			errno = result;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: parse_pool_destroy
+ * ----------------------------
+ *   stops the workers, dropping the frames not yet decoded, and releases the pool.
+ *
+ *   @param pool: the pool.
+ */
+
+void parse_pool_destroy(struct parse_pool* pool) {
+	struct parse_plan* plan;
+	int c, w;
+
+	atomic_store(&pool->stopping, 1);
+	for (w = 0; w < pool->workers; w++) {
+		pthread_mutex_lock(&pool->worker[w].lock);
+		pthread_cond_signal(&pool->worker[w].wake);
+		pthread_mutex_unlock(&pool->worker[w].lock);
+	}
+	for (w = 0; w < pool->workers; w++) {
+		pthread_join(pool->worker[w].thread, NULL);
+	}
+	release_queues(pool, pool->workers);
+	for (c = 0; pool->connection != NULL && c < pool->connections; c++) {
+		plan = atomic_load(&pool->connection[c].plan);
+		if (plan != NULL) {
+			decode_plan_destroy(&plan->plan);
+			free(plan);
+		}
+		free(pool->connection[c].slots);
+	}
+	while (pool->retired != NULL) {
+		plan = pool->retired;
+		pool->retired = plan->next;
+		decode_plan_destroy(&plan->plan);
+		free(plan);
+	}
+	pthread_mutex_destroy(&pool->retired_lock);
+	free(pool->connection);
+	free(pool->worker);
+	free(pool->storage);
+	pool->connection = NULL;
+	pool->worker = NULL;
+	pool->storage = NULL;
+	pool->workers = 0;
+}
+
+
+/**
+ * Function: parse_pool_submit
+ * ----------------------------
+ *   copies a frame into the next slot of a connection and queues it on the home worker
+ *   of the connection, waking it or, if it is busy, another sleeping worker that can steal.
+ *   Only one thread at a time may submit on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection;
+ *   @param frame:      the frame, e.g. from receiver_next_frame();
+ *   @param length:     the length of the frame.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned and
+ *            errno is set to @c EAGAIN if all the slots of the connection are in use (collect
+ *            first), @c EMSGSIZE if the frame is too large, @c EINVAL if the connection is not valid.
+ */
+
+int parse_pool_submit(struct parse_pool* pool, int connection, const void* frame, unsigned int length) {
+	struct parse_connection* c;
+	struct parse_slot* slot;
+	struct parse_worker* home;
+	unsigned int index;
+	int w;
+
+	if (connection < 0 || connection >= pool->connections) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (length > pool->max_frame) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	c = &pool->connection[connection];
+	index = (unsigned int)(c->tail % pool->depth);
+	slot = &c->slots[index];
+	if (atomic_load_explicit(&slot->state, memory_order_acquire) != PARSE_SLOT_FREE) {
+		errno = EAGAIN;
+		return -1;
+	}
+	memcpy(slot->data, frame, length);
+	slot->length = length;
+	slot->sequence = c->tail;
+	atomic_store_explicit(&slot->state, PARSE_SLOT_QUEUED, memory_order_relaxed);
+
+	/* counted first, so that the counters never go below zero; a queue holds every slot of the pool */
+	home = &pool->worker[connection % pool->workers];
+	atomic_fetch_add(&home->queued, 1);
+	atomic_fetch_add(&pool->queued, 1);
+	enqueue(home, (unsigned int)connection * pool->depth + index);
+	c->tail++;
+	c->submitted++;
+
+	if (!wake(home) && pool->steal) {
+		for (w = 1; w < pool->workers; w++) {
+			if (wake(&pool->worker[(connection + w) % pool->workers])) break;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Function: parse_pool_collect
+ * ----------------------------
+ *   the next result of a connection, in submission order. Only one thread at a time
+ *   may collect on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection;
+ *   @param result:     filled with the result.
+ *
+ *   @return  1 if the next result is ready, 0 if its frame has not been decoded yet.
+ */
+
+int parse_pool_collect(struct parse_pool* pool, int connection, struct parse_result* result) {
+	struct parse_connection* c = &pool->connection[connection];
+	struct parse_slot* slot = &c->slots[c->head % pool->depth];
+
+	if (atomic_load_explicit(&slot->state, memory_order_acquire) != PARSE_SLOT_DONE) {
+		return 0;
+	}
+	result->connection = connection;
+	result->sequence = slot->sequence;
+	result->status = slot->status;
+	result->count = slot->count;
+	result->values = slot->values;
+	result->data = slot->data;
+	result->length = slot->length;
+	result->worker = slot->worker;
+	return 1;
+}
+
+
+/**
+ * Function: parse_pool_release
+ * ----------------------------
+ *   frees the slot of the result returned by the last parse_pool_collect() on a connection.
+ *
+ *   @param pool:       the pool;
+ *   @param connection: index of the connection.
+ */
+
+void parse_pool_release(struct parse_pool* pool, int connection) {
+	struct parse_connection* c = &pool->connection[connection];
+	struct parse_slot* slot = &c->slots[c->head % pool->depth];
+
+	atomic_store_explicit(&slot->state, PARSE_SLOT_FREE, memory_order_release);
+	c->head++;
+	c->collected++;
+}
@@ -0,0 +1,231 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_rate_control.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Adaptive control of the Trick Variable Server update period.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+
+#include<time.h>          //clock_gettime,...
+#include<sys/ioctl.h>     //ioctl,...
+#include<linux/sockios.h> //SIOCINQ,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_rate_control.h"
+#include "../include/trick_variable_server_metrics.h"
+
+
+/**
+ * Function: monotonic_time
+ * ----------------------------
+ *   reads CLOCK_MONOTONIC in seconds.
+ */
+
+static double monotonic_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: rate_controller_init
+ * ----------------------------
+ *   initializes the controller and sets the initial period. The default tuning backs off by
+ *   a factor 1.5 after 3 pressured observations and speeds up by a factor 0.8 after 50 relieved
+ *   ones, at most once per second. Pressure is a socket buffer above 64 KiB, more than 4 frames
+ *   of backlog or processing above 80% of the period; relief is a socket buffer below 4 KiB,
+ *   no backlog and processing below 40% of the period. Every field may be changed after init.
+ *
+ *   @param controller: the controller;
+ *   @param socket:     socket file descriptor;
+ *   @param period:     the initial period;
+ *   @param min_period: the fastest period the controller may set;
+ *   @param max_period: the slowest period the controller may set.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int rate_controller_init(struct rate_controller* controller, int socket, double period, double min_period, double max_period) {
+	controller->socket = socket;
+	controller->min_period = min_period;
+	controller->max_period = max_period;
+	if (period < min_period) period = min_period;
+	if (period > max_period) period = max_period;
+	controller->period = period;
+
+	controller->backoff_factor = 1.5;
+	controller->recovery_factor = 0.8;
+	controller->high_water_bytes = 64 * 1024;
+	controller->low_water_bytes = 4 * 1024;
+	controller->high_backlog = 4;
+	controller->low_backlog = 0;
+	controller->high_busy_fraction = 0.8;
+	controller->low_busy_fraction = 0.4;
+	controller->raise_after = 3;
+	controller->lower_after = 50;
+	controller->hold_time = 1.0;
+	controller->metrics = NULL;
+
+	controller->pressure_count = 0;
+	controller->relief_count = 0;
+	controller->last_adjustment_time = monotonic_time();
+	controller->last_sample_time = 0.0;
+	controller->socket_queued = 0;
+	controller->observations = 0;
+	controller->increases = 0;
+	controller->decreases = 0;
+	controller->failures = 0;
+	controller->adjustments = 0;
+
+	return set_cycle(socket, period);
+}
+
+
+/**
+ * Function: rate_controller_observe
+ * ----------------------------
+ *   feeds an observation to the controller and adjusts the period if needed.
+ *   The socket buffer is sampled once per hold time, so that a decision taken when the
+ *   hold time expires sees a fresh sample. A full buffer counts as pressure only in the
+ *   observation that samples it: in the observations in between, it only keeps the counts
+ *   from moving. If SIOCINQ is not supported by the socket, the socket buffer is ignored.
+ *
+ *   @param controller:      the controller;
+ *   @param backlog:         frames received but not yet processed by the client;
+ *   @param processing_time: seconds spent processing the last frame.
+ *
+ *   @return  1 if the period was changed, 0 if not. If set_cycle() fails, -1 is returned
+ *            and errno is set to indicate the error.
+ */
+
+int rate_controller_observe(struct rate_controller* controller, unsigned int backlog, double processing_time) {
+	struct rate_controller_adjustment* entry;
+	unsigned int queued;
+	int bytes = 0;
+	int pressure = 0;
+	int relief;
+	int fresh = 0;
+	double busy, now, period;
+
+	controller->observations++;
+	now = monotonic_time();
+	if (now - controller->last_sample_time >= controller->hold_time) {
+		if (ioctl(controller->socket, SIOCINQ, &bytes) < 0) {
+			controller->failures++;
+			bytes = 0;
+		}
+		controller->socket_queued = (unsigned int)bytes;
+		controller->last_sample_time = now;
+		fresh = 1;
+	}
+	queued = controller->socket_queued;
+	busy = processing_time / controller->period;
+
+	if (fresh && queued > controller->high_water_bytes) pressure |= RATE_CONTROLLER_SOCKET_BUFFER;
+	if (backlog > controller->high_backlog) pressure |= RATE_CONTROLLER_BACKLOG;
+	if (busy > controller->high_busy_fraction) pressure |= RATE_CONTROLLER_PROCESSING;
+	relief = !pressure && queued < controller->low_water_bytes
+		&& backlog <= controller->low_backlog && busy < controller->low_busy_fraction;
+
+	if (pressure) {
+		controller->pressure_count++;
+		controller->relief_count = 0;
+	}
+	else if (queued > controller->high_water_bytes) {
+		/* the buffer was full at the last sample: hold the counts until the next one */
+		controller->relief_count = 0;
+	}
+	else if (relief) {
+		controller->relief_count++;
+		controller->pressure_count = 0;
+	}
+	else {
+		controller->pressure_count = 0;
+		controller->relief_count = 0;
+	}
+
+	period = controller->period;
+	if (controller->pressure_count >= controller->raise_after) {
+		period *= controller->backoff_factor;
+		if (period > controller->max_period) period = controller->max_period;
+	}
+	else if (controller->relief_count >= controller->lower_after) {
+		period *= controller->recovery_factor;
+		if (period < controller->min_period) period = controller->min_period;
+		pressure = RATE_CONTROLLER_RECOVERY;
+	}
+	if (period == controller->period) {
+		return 0;
+	}
+
+	if (now - controller->last_adjustment_time < controller->hold_time) {
+		return 0;
+	}
+	if (set_cycle(controller->socket, period) < 0) {
+		controller->failures++;
+		return -1;
+	}
+
+	entry = &controller->log[controller->adjustments % RATE_CONTROLLER_LOG_SIZE];
+	entry->host_time = now;
+	entry->old_period = controller->period;
+	entry->new_period = period;
+	entry->reasons = pressure;
+	entry->socket_queued = queued;
+	entry->backlog = backlog;
+	entry->processing_time = processing_time;
+	controller->adjustments++;
+	if (period > controller->period) controller->increases++; else controller->decreases++;
+
+	metrics_add(controller->metrics, METRIC_CYCLE_CHANGES, 1);
+
+	controller->period = period;
+	controller->last_adjustment_time = now;
+	controller->pressure_count = 0;
+	controller->relief_count = 0;
+	return 1;
+}
+
+
+/**
+ * Function: rate_controller_adjustment
+ * ----------------------------
+ *   gives access to a logged adjustment.
+ *
+ *   @param controller: the controller;
+ *   @param age:        0 for the most recent adjustment, 1 for the previous one, ...
+ *
+ *   @return  the adjustment, or NULL if it is not (or no longer) in the log.
+ */
+
+const struct rate_controller_adjustment* rate_controller_adjustment(const struct rate_controller* controller, unsigned int age) {
+	if (age >= controller->adjustments || age >= RATE_CONTROLLER_LOG_SIZE) {
+		return NULL;
+	}
+	return &controller->log[(controller->adjustments - 1 - age) % RATE_CONTROLLER_LOG_SIZE];
+}
@@ -0,0 +1,253 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_realtime.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Real-time profile for the receiving thread.
+ */
+
+#define _GNU_SOURCE           //pthread_setaffinity_np
+
+#include<stdlib.h>            //realloc,...
+#include<string.h>            //memset,...
+#include<errno.h>             //errno,...
+#include<pthread.h>           //pthread_setschedparam,...
+#include<sched.h>             //cpu_set_t,...
+#include<stdatomic.h>         //atomic_fetch_add,...
+#include<unistd.h>            //sysconf,...
+#include<sys/mman.h>          //mlockall,...
+#include<sys/prctl.h>         //PR_SET_TIMERSLACK,...
+
+#include "../include/trick_variable_server_realtime.h"
+
+static _Thread_local int allocations_forbidden = 0;
+static atomic_ulong allocation_violations = 0;
+
+
+/**
+ * Function: prefault_stack
+ * ----------------------------
+ *   touches the given amount of stack so that its pages are mapped (and locked).
+ */
+
+static void prefault_stack(size_t size) {
+	volatile unsigned char* stack = __builtin_alloca(size);
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < size; i += page) {
+		stack[i] = 0;
+	}
+}
+
+
+/**
+ * Function: realtime_apply
+ * ----------------------------
+ *   applies a real-time profile to the calling thread. Every step is attempted
+ *   even if a previous one failed (e.g. for lack of privileges).
+ *
+ *   @param profile: the profile.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error of the first step that failed.
+ */
+
+int realtime_apply(const struct realtime_profile* profile) {
+	struct sched_param parameters;
+	cpu_set_t cpus;
+	int error = 0, result;
+
+	if (profile->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0 && error == 0) {
+		error = errno;
+	}
+	if (profile->stack_size > 0) {
+		prefault_stack(profile->stack_size);
+	}
+	if (profile->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(profile->cpu, &cpus);
+		result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (result != 0 && error == 0) error = result;
+	}
+	if (profile->priority > 0) {
+		memset(&parameters, 0, sizeof(parameters));
+		parameters.sched_priority = profile->priority;
+		result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+		if (result != 0 && error == 0) error = result;
+	}
+	if (profile->timer_slack > 0 && prctl(PR_SET_TIMERSLACK, profile->timer_slack, 0, 0, 0) < 0 && error == 0) {
+		error = errno;
+	}
+
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: realtime_prepare_receiver
+ * ----------------------------
+ *   grows the receive buffer to the given capacity and touches all its pages, so that
+ *   receiving does not fault nor allocate as long as the backlog fits in it.
+ *
+ *   @param receiver: the receiver;
+ *   @param capacity: the size of the buffer, at least the largest backlog expected.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int realtime_prepare_receiver(struct frame_receiver* receiver, size_t capacity) {
+	unsigned char* buffer;
+
+	if (capacity > receiver->capacity) {
+		buffer = realloc(receiver->buffer, capacity);
+		if (buffer == NULL) {
+			return -1;
+		}
+		receiver->buffer = buffer;
+		receiver->capacity = capacity;
+	}
+	memset(receiver->buffer + receiver->end, 0, receiver->capacity - receiver->end);
+	return 0;
+}
+
+
+/**
+ * Function: realtime_guard_allocations
+ * ----------------------------
+ *   makes every allocation of the calling thread fail while enabled. Effective only
+ *   when the library is built with -DTRICK_VS_MALLOC_GUARD.
+ *
+ *   @param enabled: 1 to forbid the allocations, 0 to allow them again.
+ */
+
+void realtime_guard_allocations(int enabled) {
+	allocations_forbidden = enabled;
+}
+
+
+/**
+ * Function: realtime_allocation_violations
+ * ----------------------------
+ *   the number of allocations attempted by guarded threads.
+ *
+ *   @return  the number of violations since the start of the process.
+ */
+
+unsigned long realtime_allocation_violations() {
+	return atomic_load(&allocation_violations);
+}
+
+
+#ifdef TRICK_VS_MALLOC_GUARD
+
+#include<malloc.h>            //memalign,...
+
+/* the allocator of the C library, which the wrappers below forward to */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void* __libc_valloc(size_t size);
+extern void* __libc_pvalloc(size_t size);
+
+
+/**
+ * Function: refuse
+ * ----------------------------
+ *   tells whether the calling thread is guarded, and counts the violation.
+ */
+
+static int refuse() {
+	if (!allocations_forbidden) {
+		return 0;
+	}
+	atomic_fetch_add(&allocation_violations, 1);
+	errno = ENOMEM;
+	return 1;
+}
+
+
+void* malloc(size_t size) {
+	return refuse() ? NULL : __libc_malloc(size);
+}
+
+
+void* calloc(size_t count, size_t size) {
+	return refuse() ? NULL : __libc_calloc(count, size);
+}
+
+
+void* realloc(void* pointer, size_t size) {
+	return refuse() ? NULL : __libc_realloc(pointer, size);
+}
+
+
+/* the aligned allocations (e.g. aligned_alloc() in parse_pool_init()) are guarded too */
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	return refuse() ? NULL : __libc_memalign(alignment, size);
+}
+
+
+void* memalign(size_t alignment, size_t size) {
+	return refuse() ? NULL : __libc_memalign(alignment, size);
+}
+
+
+void* valloc(size_t size) {
+	return refuse() ? NULL : __libc_valloc(size);
+}
+
+
+void* pvalloc(size_t size) {
+	return refuse() ? NULL : __libc_pvalloc(size);
+}
+
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+	int error = errno;
+	void* memory;
+
+	/* the error is returned, errno is left unchanged */
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void*) != 0) {
+		return EINVAL;
+	}
+	if (refuse()) {
+		errno = error;
+		return ENOMEM;
+	}
+	memory = __libc_memalign(alignment, size);
+	if (memory == NULL) {
+		errno = error;
+		return ENOMEM;
+	}
+	*pointer = memory;
+	return 0;
+}
+
+#endif
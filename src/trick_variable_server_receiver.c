@@ -0,0 +1,623 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_receiver.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Reception of whole frames from the Trick Variable Server.
+ *
+ * A binary message starts with the message indicator (4 bytes) and the message size
+ * (4 bytes, the number of bytes following the indicator), both in the byte order of the
+ * simulation host. An ASCII message is a line starting with the message indicator.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation of the message formats.
+ */
+
+#define _GNU_SOURCE           //ppoll
+
+#include<stdlib.h>            //malloc,...
+#include<string.h>            //memmove,...
+#include<errno.h>             //errno,...
+#include<poll.h>              //ppoll,...
+#include<sys/socket.h>        //recvmsg,...
+#include<linux/net_tstamp.h>  //SOF_TIMESTAMPING_*,...
+#include<linux/errqueue.h>    //scm_timestamping,...
+
+#include "../include/trick_variable_server_receiver.h"
+#include "../include/trick_variable_server_trace.h"
+
+/** larger messages are considered corrupted */
+#define RECEIVER_MAXIMUM_FRAME (256u * 1024u * 1024u)
+
+
+/**
+ * Function: binary_frame_length
+ * ----------------------------
+ *   returns the total length of the binary message starting at data, 0 if the header is
+ *   not complete yet, (size_t)-1 if the header is not valid.
+ */
+
+static size_t binary_frame_length(const unsigned char* data, size_t available) {
+	unsigned int size;
+
+	if (available < 8) {
+		return 0;
+	}
+	memcpy(&size, data + 4, sizeof(size));
+	if (size < 4 || size > RECEIVER_MAXIMUM_FRAME) {
+		return (size_t)-1;
+	}
+	return (size_t)size + 4;
+}
+
+
+/**
+ * Function: compact
+ * ----------------------------
+ *   moves the bytes of the incomplete frame to the beginning of the buffer and
+ *   forgets the read marks whose bytes have all been consumed.
+ */
+
+static void compact(struct frame_receiver* receiver) {
+	int i, kept = 0;
+
+	if (receiver->start == 0) {
+		return;
+	}
+	memmove(receiver->buffer, receiver->buffer + receiver->start, receiver->end - receiver->start);
+	for (i = 0; i < receiver->mark_count; i++) {
+		if (receiver->marks[i].end > receiver->start) {
+			receiver->marks[kept] = receiver->marks[i];
+			receiver->marks[kept].end -= receiver->start;
+			kept++;
+		}
+	}
+	receiver->mark_count = kept;
+	receiver->end -= receiver->start;
+	receiver->scanned = receiver->scanned > receiver->start ? receiver->scanned - receiver->start : 0;
+	receiver->start = 0;
+}
+
+
+/**
+ * Function: reserve
+ * ----------------------------
+ *   grows the buffer so that at least one more byte, and the whole pending binary
+ *   message if its size is known, fits in it.
+ */
+
+static int reserve(struct frame_receiver* receiver) {
+	size_t needed = receiver->end + 1;
+	size_t length;
+	unsigned char* buffer;
+
+	if (receiver->format == RECEIVER_BINARY) {
+		length = binary_frame_length(receiver->buffer, receiver->end);
+		if (length != (size_t)-1 && length > needed) {
+			needed = length;
+		}
+	}
+	if (needed <= receiver->capacity) {
+		return 0;
+	}
+	if (needed < receiver->capacity * 2) {
+		needed = receiver->capacity * 2;
+	}
+	buffer = realloc(receiver->buffer, needed);
+	if (buffer == NULL) {
+		return -1;
+	}
+	receiver->buffer = buffer;
+	receiver->capacity = needed;
+	return 0;
+}
+
+
+/**
+ * Function: read_timestamp
+ * ----------------------------
+ *   extracts the kernel receive timestamp from the control messages of a recvmsg().
+ *   With SO_TIMESTAMPING the raw hardware timestamp is preferred when present.
+ */
+
+static void read_timestamp(struct msghdr* message, struct timespec* kernel_time) {
+	struct cmsghdr* control;
+	struct scm_timestamping stamps;
+
+	kernel_time->tv_sec = 0;
+	kernel_time->tv_nsec = 0;
+	for (control = CMSG_FIRSTHDR(message); control != NULL; control = CMSG_NXTHDR(message, control)) {
+		if (control->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+		if (control->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(kernel_time, CMSG_DATA(control), sizeof(struct timespec));
+		}
+		else if (control->cmsg_type == SCM_TIMESTAMPING) {
+			memcpy(&stamps, CMSG_DATA(control), sizeof(stamps));
+			*kernel_time = (stamps.ts[2].tv_sec != 0 || stamps.ts[2].tv_nsec != 0) ? stamps.ts[2] : stamps.ts[0];
+		}
+	}
+}
+
+
+/**
+ * Function: count_read
+ * ----------------------------
+ *   updates the counters after a receive call that started at the given time.
+ */
+
+static void count_read(struct frame_receiver* receiver, ssize_t received, unsigned long long start) {
+	if (receiver->metrics == NULL) {
+		return;
+	}
+	metrics_add(receiver->metrics, METRIC_RECEIVE_TIME, metrics_now() - start);
+	metrics_add(receiver->metrics, METRIC_RECV_CALLS, 1);
+	if (received > 0) {
+		metrics_add(receiver->metrics, METRIC_BYTES_RECEIVED, (unsigned long long)received);
+	}
+}
+
+
+/**
+ * Function: receiver_init
+ * ----------------------------
+ *   initializes a receiver for the given socket.
+ *
+ *   @param receiver: the receiver;
+ *   @param socket:   socket file descriptor;
+ *   @param format:   @c RECEIVER_ASCII or @c RECEIVER_BINARY, as requested to the server;
+ *   @param capacity: initial size of the receive buffer in bytes; the buffer grows if a frame does not fit.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int receiver_init(struct frame_receiver* receiver, int socket, int format, size_t capacity) {
+	if (capacity < RECEIVER_BINARY_HEADER_SIZE) {
+		capacity = RECEIVER_BINARY_HEADER_SIZE;
+	}
+	receiver->buffer = malloc(capacity);
+	if (receiver->buffer == NULL) {
+		return -1;
+	}
+	receiver->socket = socket;
+	receiver->format = format;
+	receiver->timestamping = RECEIVER_TIMESTAMP_NONE;
+	receiver->capacity = capacity;
+	receiver->start = 0;
+	receiver->end = 0;
+	receiver->scanned = 0;
+	receiver->mark_count = 0;
+	receiver->metrics = NULL;
+	receiver->superseded = 0;
+	return 0;
+}
+
+
+/**
+ * Function: receiver_destroy
+ * ----------------------------
+ *   releases the receive buffer.
+ *
+ *   @param receiver: the receiver.
+ */
+
+void receiver_destroy(struct frame_receiver* receiver) {
+	free(receiver->buffer);
+	receiver->buffer = NULL;
+	receiver->capacity = 0;
+}
+
+
+/**
+ * Function: receiver_enable_timestamps
+ * ----------------------------
+ *   enables the kernel receive timestamps on the socket. From then on the reads are
+ *   performed with recvmsg() and the timestamps are attached to the frames.
+ *
+ *   @param receiver: the receiver;
+ *   @param mode:     @c RECEIVER_TIMESTAMP_NS (SO_TIMESTAMPNS), @c RECEIVER_TIMESTAMP_KERNEL
+ *                    (SO_TIMESTAMPING, hardware timestamps when the NIC provides them)
+ *                    or @c RECEIVER_TIMESTAMP_NONE to disable them.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int receiver_enable_timestamps(struct frame_receiver* receiver, int mode) {
+	int enable = 1;
+	int disable = 0;
+	int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+		| SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+	if (mode == RECEIVER_TIMESTAMP_NS) {
+		if (setsockopt(receiver->socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+			return -1;
+		}
+	}
+	else if (mode == RECEIVER_TIMESTAMP_KERNEL) {
+		if (setsockopt(receiver->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+			return -1;
+		}
+	}
+	else if (mode == RECEIVER_TIMESTAMP_NONE) {
+		if (receiver->timestamping == RECEIVER_TIMESTAMP_NS) {
+			setsockopt(receiver->socket, SOL_SOCKET, SO_TIMESTAMPNS, &disable, sizeof(disable));
+		}
+		else if (receiver->timestamping == RECEIVER_TIMESTAMP_KERNEL) {
+			setsockopt(receiver->socket, SOL_SOCKET, SO_TIMESTAMPING, &disable, sizeof(disable));
+		}
+	}
+	else {
+		errno = EINVAL;
+		return -1;
+	}
+	receiver->timestamping = mode;
+	receiver->mark_count = 0;
+	return 0;
+}
+
+
+/**
+ * Function: receiver_read
+ * ----------------------------
+ *   performs one read from the socket into the receive buffer. With kernel timestamps
+ *   enabled the read is a recvmsg() and its timestamp is recorded together with the
+ *   offset at which its bytes end.
+ *
+ *   @param receiver: the receiver;
+ *   @param flags:    the flags of recv() (e.g. @c MSG_DONTWAIT).
+ *
+ *   @return  the number of bytes received, 0 if the peer has performed an orderly shutdown,
+ *            -1 if an error occurred (errno is set to indicate the error).
+ */
+
+int receiver_read(struct frame_receiver* receiver, int flags) {
+	union {
+		char buffer[CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr message;
+	struct iovec iov;
+	ssize_t received;
+	unsigned long long start = 0;
+
+	if (receiver->metrics != NULL) {
+		if (receiver->start < receiver->end) {
+			metrics_add(receiver->metrics, METRIC_PARTIAL_CARRYOVERS, 1);
+		}
+		start = metrics_now();
+	}
+	compact(receiver);
+	if (reserve(receiver) < 0) {
+		return -1;
+	}
+
+	if (receiver->timestamping == RECEIVER_TIMESTAMP_NONE) {
+		TRACE_BEGIN("recv");
+		received = recv(receiver->socket, receiver->buffer + receiver->end, receiver->capacity - receiver->end, flags);
+		TRACE_END("recv");
+		if (received > 0) {
+			receiver->end += received;
+		}
+		count_read(receiver, received, start);
+		return (int)received;
+	}
+
+	iov.iov_base = receiver->buffer + receiver->end;
+	iov.iov_len = receiver->capacity - receiver->end;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+	TRACE_BEGIN("recv");
+	received = recvmsg(receiver->socket, &message, flags);
+	TRACE_END("recv");
+	if (received > 0) {
+		receiver->end += received;
+		if (receiver->mark_count == RECEIVER_READ_MARKS) {
+			memmove(receiver->marks, receiver->marks + 1, sizeof(receiver->marks[0]) * (RECEIVER_READ_MARKS - 1));
+			receiver->mark_count--;
+		}
+		receiver->marks[receiver->mark_count].end = receiver->end;
+		read_timestamp(&message, &receiver->marks[receiver->mark_count].kernel_time);
+		receiver->mark_count++;
+	}
+	count_read(receiver, received, start);
+	return (int)received;
+}
+
+
+/**
+ * Function: receiver_next_frame
+ * ----------------------------
+ *   extracts the next complete frame from the receive buffer, without reading the socket.
+ *   The kernel time of the frame is the one of the read that brought its last byte.
+ *
+ *   @param receiver: the receiver;
+ *   @param frame:    filled with the frame.
+ *
+ *   @return  1 if a frame was extracted, 0 if no complete frame is buffered,
+ *            -1 if the data is not a valid message (errno is set to @c EPROTO).
+ */
+
+int receiver_next_frame(struct frame_receiver* receiver, struct receiver_frame* frame) {
+	unsigned char* data = receiver->buffer + receiver->start;
+	size_t available = receiver->end - receiver->start;
+	size_t length, consumed;
+	unsigned char* newline;
+	int i, type;
+
+	if (receiver->format == RECEIVER_BINARY) {
+		length = binary_frame_length(data, available);
+		if (length == (size_t)-1) {
+			metrics_add(receiver->metrics, METRIC_PARSE_ERRORS, 1);
+			errno = EPROTO;
+			return -1;
+		}
+		if (length == 0 || length > available) {
+			return 0;
+		}
+		memcpy(&type, data, sizeof(type));
+		consumed = length;
+	}
+	else {
+		if (receiver->scanned < receiver->start) {
+			receiver->scanned = receiver->start;
+		}
+		newline = memchr(receiver->buffer + receiver->scanned, '\n', receiver->end - receiver->scanned);
+		if (newline == NULL) {
+			receiver->scanned = receiver->end;
+			return 0;
+		}
+		*newline = '\0';
+		length = (size_t)(newline - data);
+		consumed = length + 1;
+		type = 0;
+		for (i = 0; (size_t)i < length && data[i] >= '0' && data[i] <= '9'; i++) {
+			type = type * 10 + (data[i] - '0');
+		}
+	}
+
+	frame->data = data;
+	frame->length = (unsigned int)length;
+	frame->message_type = type;
+	frame->kernel_time.tv_sec = 0;
+	frame->kernel_time.tv_nsec = 0;
+	for (i = 0; i < receiver->mark_count; i++) {
+		if (receiver->marks[i].end >= receiver->start + consumed) {
+			frame->kernel_time = receiver->marks[i].kernel_time;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_REALTIME, &frame->user_time);
+	receiver->start += consumed;
+	metrics_add(receiver->metrics, METRIC_FRAMES, 1);
+	return 1;
+}
+
+
+/**
+ * Function: receiver_dispatch
+ * ----------------------------
+ *   performs one read and hands every frame it completes to the handler.
+ *   If the stream is corrupted, the buffered bytes are dropped and -1 is returned with
+ *   errno set to @c EPROTO.
+ *
+ *   @param receiver: the receiver;
+ *   @param handler:  the callback receiving the frames;
+ *   @param context:  passed to the handler;
+ *   @param flags:    the flags of recv() (e.g. @c MSG_DONTWAIT).
+ *
+ *   @return  the number of bytes received, 0 if the peer has performed an orderly shutdown,
+ *            -1 if an error occurred (errno is set to indicate the error).
+ */
+
+int receiver_dispatch(struct frame_receiver* receiver, receiver_handler handler, void* context, int flags) {
+	struct receiver_frame frame;
+	int received = receiver_read(receiver, flags);
+	unsigned long long t0, t1, t2;
+	int result;
+
+	if (received <= 0) {
+		return received;
+	}
+	if (receiver->metrics == NULL) {
+		TRACE_BEGIN("parse");
+		while ((result = receiver_next_frame(receiver, &frame)) > 0) {
+			TRACE_END("parse");
+			TRACE_BEGIN("dispatch");
+			handler(context, &frame);
+			TRACE_END("dispatch");
+			TRACE_BEGIN("parse");
+		}
+		TRACE_END("parse");
+	}
+	else {
+		t0 = metrics_now();
+		TRACE_BEGIN("parse");
+		while ((result = receiver_next_frame(receiver, &frame)) > 0) {
+			TRACE_END("parse");
+			t1 = metrics_now();
+			TRACE_BEGIN("dispatch");
+			handler(context, &frame);
+			TRACE_END("dispatch");
+			t2 = metrics_now();
+			metrics_add(receiver->metrics, METRIC_PARSE_TIME, t1 - t0);
+			metrics_add(receiver->metrics, METRIC_DISPATCH_TIME, t2 - t1);
+			t0 = t2;
+			TRACE_BEGIN("parse");
+		}
+		TRACE_END("parse");
+		metrics_add(receiver->metrics, METRIC_PARSE_TIME, metrics_now() - t0);
+	}
+	if (result < 0) {
+		receiver->start = receiver->end;
+		return -1;
+	}
+	return received;
+}
+
+
+/**
+ * Function: drain
+ * ----------------------------
+ *   reads without blocking everything the socket holds, growing the buffer if needed.
+ *   Sets closed when the peer has shut the connection down.
+ *
+ *   @return  the number of bytes received, -1 on error.
+ */
+
+static int drain(struct frame_receiver* receiver, int* closed) {
+	int received, total = 0;
+
+	for (;;) {
+		received = receiver_read(receiver, MSG_DONTWAIT);
+		if (received > 0) {
+			total += received;
+			if (receiver->end < receiver->capacity) {
+				return total;
+			}
+		}
+		else if (received == 0) {
+			*closed = 1;
+			return total;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return total;
+		}
+		else if (errno != EINTR) {
+			return -1;
+		}
+	}
+}
+
+
+/**
+ * Function: take_latest
+ * ----------------------------
+ *   extracts every complete frame buffered and keeps the last one.
+ *
+ *   @return  1 if a frame was found, 0 if none, -1 if the data is not valid.
+ */
+
+static int take_latest(struct frame_receiver* receiver, struct receiver_frame* frame) {
+	struct receiver_frame next;
+	int result, found = 0;
+
+	while ((result = receiver_next_frame(receiver, &next)) > 0) {
+		if (found) {
+			receiver->superseded++;
+		}
+		*frame = next;
+		found = 1;
+	}
+	return result < 0 ? -1 : found;
+}
+
+
+/**
+ * Function: remaining_time
+ * ----------------------------
+ *   computes the time left until an absolute CLOCK_MONOTONIC deadline.
+ *
+ *   @return  1 if some time is left, 0 if the deadline has expired.
+ */
+
+static int remaining_time(const struct timespec* deadline, struct timespec* left) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left->tv_sec = deadline->tv_sec - now.tv_sec;
+	left->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+	if (left->tv_nsec < 0) {
+		left->tv_nsec += 1000000000L;
+		left->tv_sec--;
+	}
+	return left->tv_sec > 0 || (left->tv_sec == 0 && left->tv_nsec > 0);
+}
+
+
+/**
+ * Function: receiver_wait_for_frame
+ * ----------------------------
+ *   waits until a complete frame is available or an absolute deadline expires, and
+ *   returns the latest frame received, skipping the older ones (counted in superseded).
+ *   Everything the socket holds is read first, so the frame returned is the newest one.
+ *   The socket is polled without blocking for at most spin_budget nanoseconds, then
+ *   the thread sleeps in ppoll() with the time left until the deadline; the wake-up jitter
+ *   is then that of the kernel timers (see the timer slack of the thread, PR_SET_TIMERSLACK).
+ *
+ *   @param receiver:    the receiver;
+ *   @param deadline:    absolute CLOCK_MONOTONIC time at which to give up, NULL to wait without limit;
+ *   @param spin_budget: nanoseconds of busy polling before sleeping, 0 to sleep at once;
+ *   @param frame:       filled with the latest frame; it is valid until the next read.
+ *
+ *   @return  1 if a frame was returned, 0 if the deadline expired, -1 if an error occurred
+ *            (errno is set to indicate the error, @c ECONNRESET if the peer closed the connection).
+ */
+
+int receiver_wait_for_frame(struct frame_receiver* receiver, const struct timespec* deadline, long spin_budget, struct receiver_frame* frame) {
+	struct pollfd descriptor;
+	struct timespec now, spin_end, left, spin_left;
+	int closed = 0, result;
+
+	TRACE_BEGIN("wait");
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	spin_end.tv_sec = now.tv_sec + spin_budget / 1000000000L;
+	spin_end.tv_nsec = now.tv_nsec + spin_budget % 1000000000L;
+	if (spin_end.tv_nsec >= 1000000000L) {
+		spin_end.tv_nsec -= 1000000000L;
+		spin_end.tv_sec++;
+	}
+	descriptor.fd = receiver->socket;
+	descriptor.events = POLLIN;
+
+	for (;;) {
+		if (drain(receiver, &closed) < 0) {
+			result = -1;
+			break;
+		}
+		result = take_latest(receiver, frame);
+		if (result != 0) {
+			break;
+		}
+		if (closed) {
+			errno = ECONNRESET;
+			result = -1;
+			break;
+		}
+		if (deadline != NULL && !remaining_time(deadline, &left)) {
+			break;
+		}
+		if (spin_budget > 0 && remaining_time(&spin_end, &spin_left)) {
+			continue;
+		}
+		if (ppoll(&descriptor, 1, deadline != NULL ? &left : NULL, NULL) < 0 && errno != EINTR) {
+			result = -1;
+			break;
+		}
+	}
+	TRACE_END("wait");
+	return result;
+}
@@ -0,0 +1,289 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_session.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Pipelined start of a session with the Trick Variable Server.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+
+#include<stdio.h>         //snprintf,...
+#include<string.h>        //memcpy,...
+#include<errno.h>         //errno,...
+#include<time.h>          //clock_gettime,...
+#include<sys/socket.h>    //setsockopt,...
+#include<sys/time.h>      //timeval,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_command_writer.h"
+#include "../include/trick_variable_server_session.h"
+
+
+/**
+ * Function: monotonic_time
+ * ----------------------------
+ *   reads CLOCK_MONOTONIC in seconds.
+ */
+
+static double monotonic_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: set_receive_timeout
+ * ----------------------------
+ *   bounds the blocking receive calls on the socket; 0 removes the bound.
+ */
+
+static int set_receive_timeout(int socket, double seconds) {
+	struct timeval timeout;
+
+	timeout.tv_sec = (time_t)seconds;
+	timeout.tv_usec = (suseconds_t)((seconds - (double)timeout.tv_sec) * 1.0e6);
+	if (seconds > 0.0 && timeout.tv_sec == 0 && timeout.tv_usec == 0) {
+		timeout.tv_usec = 1;
+	}
+	return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+
+/**
+ * Function: write_setup
+ * ----------------------------
+ *   sends the whole setup of the session as a single pipelined write.
+ */
+
+static int write_setup(int socket, const struct session_config* config) {
+	static const char* formats[] = { "trick.var_ascii()", "trick.var_binary()", "trick.var_binary_nonames()" };
+	struct command_writer writer;
+	char number[64];
+	int i;
+
+	/* a failed flush empties the writer: stop at the first error, not to send a partial setup */
+	command_writer_init(&writer, socket);
+	if (command_writer_command(&writer, "trick.var_pause()") < 0) {
+		return -1;
+	}
+	if (config->client_tag != NULL) {
+		if (command_writer_append_string(&writer, "trick.var_set_client_tag(\"") < 0
+				|| command_writer_append_string(&writer, config->client_tag) < 0
+				|| command_writer_append_string(&writer, "\")") < 0 || command_writer_end(&writer) < 0) {
+			return -1;
+		}
+	}
+	if (command_writer_command(&writer, formats[config->format]) < 0) {
+		return -1;
+	}
+	if (config->copy_mode >= 0) {
+		snprintf(number, sizeof(number), "trick.var_set_copy_mode(%i)", config->copy_mode);
+		if (command_writer_command(&writer, number) < 0) {
+			return -1;
+		}
+	}
+	if (config->cycle > 0.0) {
+		snprintf(number, sizeof(number), "trick.var_cycle(%lf)", config->cycle);
+		if (command_writer_command(&writer, number) < 0) {
+			return -1;
+		}
+	}
+	for (i = 0; i < config->count; i++) {
+		if (command_writer_append_string(&writer, "trick.var_add(\"") < 0
+				|| command_writer_append_string(&writer, config->variables[i]) < 0) {
+			return -1;
+		}
+		if (config->units != NULL && config->units[i] != NULL) {
+			if (command_writer_append_string(&writer, "\", \"") < 0
+					|| command_writer_append_string(&writer, config->units[i]) < 0) {
+				return -1;
+			}
+		}
+		if (command_writer_append_string(&writer, "\")") < 0 || command_writer_end(&writer) < 0) {
+			return -1;
+		}
+	}
+	if (command_writer_command(&writer, "trick.var_unpause()") < 0) {
+		return -1;
+	}
+	return command_writer_flush(&writer) < 0 ? -1 : 0;
+}
+
+
+/**
+ * Function: carries_set
+ * ----------------------------
+ *   tells whether a message is a variable message with the requested number of variables.
+ */
+
+static int carries_set(const struct receiver_frame* frame, int format, int count) {
+	unsigned int variables, i;
+
+	if (frame->message_type != 0) {
+		return 0;
+	}
+	if (format == SESSION_ASCII) {
+		for (i = 0, variables = 0; i < frame->length; i++) {
+			if (frame->data[i] == '\t') variables++;
+		}
+	}
+	else {
+		if (frame->length < RECEIVER_BINARY_HEADER_SIZE) {
+			return 0;
+		}
+		memcpy(&variables, frame->data + 8, sizeof(variables));
+	}
+	return variables == (unsigned int)count;
+}
+
+
+/**
+ * Function: wait_first_frame
+ * ----------------------------
+ *   reads until the first message carrying the variable set, within the timeout.
+ */
+
+static int wait_first_frame(struct session* session, const struct session_config* config, double start) {
+	double remaining;
+	int result;
+
+	for (;;) {
+		while ((result = receiver_next_frame(&session->receiver, &session->first_frame)) > 0) {
+			if (carries_set(&session->first_frame, config->format, config->count)) {
+				return 0;
+			}
+		}
+		if (result < 0) {
+			return -1;
+		}
+		if (config->timeout > 0.0) {
+			remaining = start + config->timeout - monotonic_time();
+			if (remaining <= 0.0) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			set_receive_timeout(session->socket, remaining);
+		}
+		result = receiver_read(&session->receiver, 0);
+		if (result == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			return -1;
+		}
+	}
+}
+
+
+/**
+ * Function: session_start
+ * ----------------------------
+ *   connects, sends the whole setup in one write and waits for the first message
+ *   carrying the requested variable set. Messages of other types, or with a different
+ *   number of variables, are skipped. The first message stays in the receiver of the
+ *   session until the next read.
+ *
+ *   @param session: filled with the connection, its receiver and the first message;
+ *   @param host:    host IPv4 address of the Trick Variable Server;
+ *   @param port:    service port number;
+ *   @param config:  the setup of the session.
+ *
+ *   @return  Upon successful completion, the function returns 0. Otherwise, -1 is returned
+ *            and errno is set to indicate the error, @c ETIMEDOUT if no message arrived in time.
+ */
+
+int session_start(struct session* session, char* host, int port, const struct session_config* config) {
+	double start = monotonic_time(), connected = 0.0, written = 0.0;
+	size_t capacity = config->receive_buffer > 0 ? config->receive_buffer : SESSION_RECEIVE_BUFFER;
+	int error;
+
+	memset(session, 0, sizeof(struct session));
+	session->socket = -1;
+	if (config->format < SESSION_ASCII || config->format > SESSION_BINARY_NO_NAMES || config->count <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	session->socket = create_default_socket();
+	if (session->socket < 0) {
+		return -1;
+	}
+
+	error = 0;
+	if (connect_to_variable_server(session->socket, host, port) < 0) {
+		error = errno;
+	}
+	else {
+		connected = monotonic_time();
+		if (write_setup(session->socket, config) < 0) {
+			error = errno;
+		}
+		else {
+			written = monotonic_time();
+			if (receiver_init(&session->receiver, session->socket, config->format == SESSION_ASCII ? RECEIVER_ASCII : RECEIVER_BINARY, capacity) < 0) {
+				error = errno;
+			}
+			else if (wait_first_frame(session, config, start) < 0) {
+				error = errno;
+				receiver_destroy(&session->receiver);
+			}
+			else if (config->timeout > 0.0) {
+				set_receive_timeout(session->socket, 0.0);
+			}
+		}
+	}
+	if (error != 0) {
+		close_socket(session->socket);
+		session->socket = -1;
+		errno = error;
+		return -1;
+	}
+
+	session->timing.connect = connected - start;
+	session->timing.write = written - connected;
+	session->timing.total = monotonic_time() - start;
+	session->timing.first_data = session->timing.total - (written - start);
+	return 0;
+}
+
+
+/**
+ * Function: session_close
+ * ----------------------------
+ *   leaves the session with trick.var_exit() and releases it.
+ *
+ *   @param session: the session.
+ */
+
+void session_close(struct session* session) {
+	if (session->socket < 0) {
+		return;
+	}
+	send_command_to_variable_server(session->socket, "trick.var_exit()");
+	close_socket(session->socket);
+	receiver_destroy(&session->receiver);
+	session->socket = -1;
+}
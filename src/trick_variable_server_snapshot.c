@@ -0,0 +1,378 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_snapshot.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Capture of the values of a large set of variables in one shot.
+ *
+ * @see https://github.com/nasa/Trick/wiki/Variable-Server for the documentation on the commands that can be sent to the Trick Variable Server.
+ */
+
+
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //strlen,...
+#include<errno.h>         //errno,...
+#include<time.h>          //clock_gettime,...
+#include<pthread.h>       //pthread_create,...
+#include<sys/socket.h>    //send,...
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_receiver.h"
+#include "../include/trick_variable_server_snapshot.h"
+
+#define SNAPSHOT_RECEIVE_BUFFER (64 * 1024)
+
+
+/**
+ *   @brief the work of one connection.
+ */
+
+struct snapshot_worker {
+	pthread_t thread;
+	int started;
+	char* host;
+	int port;
+	char** variables;
+	int count;
+	char** values;
+	char* text;
+	const struct timespec* deadline;
+	struct snapshot_timing timing;
+	int error;
+};
+
+
+/**
+ * Function: monotonic_time
+ * ----------------------------
+ *   reads CLOCK_MONOTONIC in seconds.
+ */
+
+static double monotonic_time() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Function: send_all
+ * ----------------------------
+ *   writes the whole buffer, resuming after partial writes.
+ */
+
+static int send_all(int socket, const char* buffer, size_t length) {
+	ssize_t sent;
+
+	while (length > 0) {
+		sent = send(socket, buffer, length, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buffer += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: build_batch
+ * ----------------------------
+ *   builds the pipelined commands of a chunk: pause, ASCII format, every var_add, var_send.
+ */
+
+static char* build_batch(char** variables, int count, size_t* length) {
+	static const char* head = "trick.var_pause()\ntrick.var_ascii()\n";
+	static const char* prefix = "trick.var_add(\"";
+	static const char* suffix = "\")\n";
+	static const char* tail = "trick.var_send()\n";
+	size_t prefix_length = strlen(prefix), suffix_length = strlen(suffix), name_length;
+	size_t size = strlen(head) + strlen(tail);
+	char* batch;
+	char* p;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		size += prefix_length + strlen(variables[i]) + suffix_length;
+	}
+	batch = malloc(size);
+	if (batch == NULL) {
+		return NULL;
+	}
+	p = batch;
+	memcpy(p, head, strlen(head));
+	p += strlen(head);
+	for (i = 0; i < count; i++) {
+		name_length = strlen(variables[i]);
+		memcpy(p, prefix, prefix_length);
+		p += prefix_length;
+		memcpy(p, variables[i], name_length);
+		p += name_length;
+		memcpy(p, suffix, suffix_length);
+		p += suffix_length;
+	}
+	memcpy(p, tail, strlen(tail));
+	*length = size;
+	return batch;
+}
+
+
+/**
+ * Function: split_reply
+ * ----------------------------
+ *   points the values into a copy of the reply "0\tvalue\tvalue...".
+ */
+
+static int split_reply(struct snapshot_worker* worker, const struct receiver_frame* frame) {
+	char* p;
+	int i;
+
+	worker->text = malloc(frame->length + 1);
+	if (worker->text == NULL) {
+		return -1;
+	}
+	memcpy(worker->text, frame->data, frame->length + 1);
+	p = strchr(worker->text, '\t');
+	for (i = 0; i < worker->count && p != NULL; i++) {
+		*p++ = '\0';
+		worker->values[i] = p;
+		p = strchr(p, '\t');
+	}
+	if (i < worker->count || p != NULL) {
+		errno = EPROTO;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: run_worker
+ * ----------------------------
+ *   captures one chunk on its own connection.
+ */
+
+static void* run_worker(void* argument) {
+	struct snapshot_worker* worker = argument;
+	struct frame_receiver receiver;
+	struct receiver_frame frame;
+	double t0, t1, t2, t3;
+	size_t length;
+	char* batch;
+	int socket, result;
+
+	t0 = monotonic_time();
+	socket = create_default_socket();
+	if (socket < 0) {
+		worker->error = errno;
+		return NULL;
+	}
+	if (connect_to_variable_server(socket, worker->host, worker->port) < 0) {
+		worker->error = errno;
+		close_socket(socket);
+		return NULL;
+	}
+	t1 = monotonic_time();
+
+	batch = build_batch(worker->variables, worker->count, &length);
+	if (batch == NULL || send_all(socket, batch, length) < 0) {
+		worker->error = errno;
+		free(batch);
+		close_socket(socket);
+		return NULL;
+	}
+	free(batch);
+	t2 = monotonic_time();
+
+	if (receiver_init(&receiver, socket, RECEIVER_ASCII, SNAPSHOT_RECEIVE_BUFFER) < 0) {
+		worker->error = errno;
+		close_socket(socket);
+		return NULL;
+	}
+	while ((result = receiver_wait_for_frame(&receiver, worker->deadline, 0, &frame)) > 0 && frame.message_type != 0) {
+	}
+	if (result == 0) {
+		errno = ETIMEDOUT;
+		result = -1;
+	}
+	if (result < 0 || split_reply(worker, &frame) < 0) {
+		worker->error = errno;
+		memset(worker->values, 0, sizeof(char*) * worker->count);
+	}
+	receiver_destroy(&receiver);
+	t3 = monotonic_time();
+
+	send_all(socket, "trick.var_exit()\n", 17);
+	close_socket(socket);
+
+	worker->timing.connect = t1 - t0;
+	worker->timing.subscribe = t2 - t1;
+	worker->timing.receive = t3 - t2;
+	worker->timing.release = monotonic_time() - t3;
+	return NULL;
+}
+
+
+/**
+ * Function: snapshot_capture
+ * ----------------------------
+ *   captures the values of the given variables over several parallel connections,
+ *   waiting for the replies without limit (see snapshot_capture_timeout()).
+ *
+ *   @param snapshot:    filled with the values and the timing;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param variables:   the names of the variables;
+ *   @param count:       the number of variables;
+ *   @param connections: the number of parallel connections.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int snapshot_capture(struct snapshot* snapshot, char* host, int port, char** variables, int count, int connections) {
+	return snapshot_capture_timeout(snapshot, host, port, variables, count, connections, 0.0);
+}
+
+
+/**
+ * Function: snapshot_capture_timeout
+ * ----------------------------
+ *   captures the values of the given variables over several parallel connections.
+ *   The list is split into contiguous chunks of equal size, one per connection.
+ *   All the connections wait for their reply until the same absolute deadline; a chunk
+ *   whose reply has not arrived by then fails with @c ETIMEDOUT, the others are kept.
+ *
+ *   @param snapshot:    filled with the values, the error of each chunk and the timing;
+ *   @param host:        host IPv4 address of the Trick Variable Server;
+ *   @param port:        service port number;
+ *   @param variables:   the names of the variables;
+ *   @param count:       the number of variables;
+ *   @param connections: the number of parallel connections;
+ *   @param timeout:     seconds from the call within which the replies must arrive, 0 for no limit.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to the error of the first chunk that
+ *            failed; the values of the failed chunks are NULL and their error is in errors.
+ */
+
+int snapshot_capture_timeout(struct snapshot* snapshot, char* host, int port, char** variables, int count, int connections, double timeout) {
+	struct snapshot_worker* workers;
+	struct timespec deadline;
+	double start = monotonic_time();
+	int i, chunk, error = 0;
+
+	memset(snapshot, 0, sizeof(struct snapshot));
+	if (count <= 0 || connections <= 0 || !(timeout >= 0.0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (timeout > 0.0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += (time_t)timeout;
+		deadline.tv_nsec += (long)((timeout - (double)(time_t)timeout) * 1.0e9);
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	if (connections > count) {
+		connections = count;
+	}
+	chunk = (count + connections - 1) / connections;
+	connections = (count + chunk - 1) / chunk;
+
+	snapshot->values = calloc(count, sizeof(char*));
+	snapshot->texts = calloc(connections, sizeof(char*));
+	snapshot->errors = calloc(connections, sizeof(int));
+	workers = calloc(connections, sizeof(struct snapshot_worker));
+	if (snapshot->values == NULL || snapshot->texts == NULL || snapshot->errors == NULL || workers == NULL) {
+		free(workers);
+		snapshot_destroy(snapshot);
+		return -1;
+	}
+	snapshot->count = count;
+	snapshot->chunks = connections;
+
+	for (i = 0; i < connections; i++) {
+		workers[i].host = host;
+		workers[i].port = port;
+		workers[i].variables = variables + i * chunk;
+		workers[i].values = snapshot->values + i * chunk;
+		workers[i].count = (i + 1) * chunk <= count ? chunk : count - i * chunk;
+		workers[i].deadline = timeout > 0.0 ? &deadline : NULL;
+		workers[i].started = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) == 0;
+		if (!workers[i].started) {
+			run_worker(&workers[i]);
+		}
+	}
+	for (i = 0; i < connections; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+		snapshot->texts[i] = workers[i].text;
+		snapshot->errors[i] = workers[i].error;
+		if (workers[i].error != 0 && error == 0) error = workers[i].error;
+		if (workers[i].timing.connect > snapshot->timing.connect) snapshot->timing.connect = workers[i].timing.connect;
+		if (workers[i].timing.subscribe > snapshot->timing.subscribe) snapshot->timing.subscribe = workers[i].timing.subscribe;
+		if (workers[i].timing.receive > snapshot->timing.receive) snapshot->timing.receive = workers[i].timing.receive;
+		if (workers[i].timing.release > snapshot->timing.release) snapshot->timing.release = workers[i].timing.release;
+	}
+	free(workers);
+	snapshot->timing.total = monotonic_time() - start;
+
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Function: snapshot_destroy
+ * ----------------------------
+ *   releases the values of a snapshot.
+ *
+ *   @param snapshot: the snapshot.
+ */
+
+void snapshot_destroy(struct snapshot* snapshot) {
+	int i;
+
+	if (snapshot->texts != NULL) {
+		for (i = 0; i < snapshot->chunks; i++) {
+			free(snapshot->texts[i]);
+		}
+	}
+	free(snapshot->texts);
+	free(snapshot->values);
+	free(snapshot->errors);
+	snapshot->texts = NULL;
+	snapshot->values = NULL;
+	snapshot->errors = NULL;
+	snapshot->count = 0;
+	snapshot->chunks = 0;
+}
@@ -0,0 +1,52 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_socket.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Release of the socket file descriptors.
+ *
+ * The library defines its own close(), which sends trick.var_exit() to the server, so the
+ * descriptor is released with the system call directly. This file does not include
+ * trick_variable_server_connection.h because its pause() and poll() clash with <unistd.h>.
+ */
+
+
+#include<unistd.h>        //syscall,...
+#include<sys/syscall.h>   //SYS_close,...
+
+int close_socket(int socket);
+
+
+/**
+ * Function: close_socket
+ * ----------------------------
+ *   releases the socket file descriptor without sending any command to the server.
+ *
+ *   @param socket: socket file descriptor. 
+ *
+ *   @return  Upon successful completion, the function returns 0. 
+ *            Otherwise, -1 is returned and errno is set to indicate the error.  
+ */
+
+int close_socket(int socket) {
+	return (int)syscall(SYS_close, socket);
+}
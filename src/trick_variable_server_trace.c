@@ -0,0 +1,300 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file trick_variable_server_trace.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief Tracing of the receive, parse and dispatch stages in the Chrome trace-event format.
+ *
+ * The ring of a thread is released when the thread exits, through the destructor of a
+ * thread-specific key: its events are still written by trace_write_json() until the ring
+ * is recycled by the next thread that starts recording, so the memory is bounded by the
+ * number of threads recording at the same time.
+ */
+
+
+#include<stdio.h>         //fopen,...
+#include<stdlib.h>        //malloc,...
+#include<string.h>        //strncpy,...
+#include<errno.h>         //errno,...
+#include<time.h>          //clock_gettime,...
+#include<pthread.h>       //pthread_mutex_lock,...
+#include<stdatomic.h>     //atomic_load_explicit,...
+#include<unistd.h>        //getpid,...
+
+#include "../include/trick_variable_server_trace.h"
+
+#define TRACE_THREAD_NAME_SIZE 32
+
+
+/**
+ *   @brief a recorded event.
+ */
+
+struct trace_record {
+	unsigned long long time;     /**< CLOCK_MONOTONIC, in nanoseconds */
+	const char* name;
+	char phase;
+};
+
+
+/**
+ *   @brief the events of one thread. Only the owner thread writes it.
+ */
+
+struct trace_ring {
+	struct trace_ring* next;
+	int thread;
+	int active;                              /**< 1 while the owner thread is alive */
+	char thread_name[TRACE_THREAD_NAME_SIZE];
+	_Atomic unsigned long long written;      /**< events recorded since the start */
+	_Atomic unsigned long long cleared;      /**< value of written at the last trace_clear() */
+	struct trace_record records[TRACE_RING_SIZE];
+};
+
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring* trace_rings = NULL;
+static int trace_threads = 0;
+static _Thread_local struct trace_ring* trace_own_ring = NULL;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static int trace_key_error = 0;
+
+
+/**
+ * Function: release_ring
+ * ----------------------------
+ *   the destructor of the ring of a thread that exits: the ring is left to the next thread.
+ */
+
+static void release_ring(void* argument) {
+	struct trace_ring* ring = argument;
+
+	pthread_mutex_lock(&trace_lock);
+	ring->active = 0;
+	pthread_mutex_unlock(&trace_lock);
+	trace_own_ring = NULL;
+}
+
+
+/**
+ * Function: create_key
+ * ----------------------------
+ *   creates the thread-specific key whose destructor releases the rings.
+ */
+
+static void create_key() {
+	trace_key_error = pthread_key_create(&trace_key, release_ring);
+}
+
+
+/**
+ * Function: own_ring
+ * ----------------------------
+ *   returns the ring of the calling thread, recycling the ring of a thread that has
+ *   exited or allocating and registering a new one the first time.
+ */
+
+static struct trace_ring* own_ring() {
+	struct trace_ring* ring = trace_own_ring;
+
+	if (ring != NULL) {
+		return ring;
+	}
+	pthread_once(&trace_key_once, create_key);
+	if (trace_key_error != 0) {
+		errno = trace_key_error;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	ring = trace_rings;
+	while (ring != NULL && ring->active) {
+		ring = ring->next;
+	}
+	if (ring != NULL) {
+		/* the events of the previous owner are dropped */
+		atomic_store_explicit(&ring->cleared, atomic_load_explicit(&ring->written, memory_order_relaxed), memory_order_relaxed);
+		ring->thread_name[0] = '\0';
+	}
+	else {
+		ring = calloc(1, sizeof(struct trace_ring));
+		if (ring == NULL) {
+			pthread_mutex_unlock(&trace_lock);
+			return NULL;
+		}
+		ring->next = trace_rings;
+		trace_rings = ring;
+	}
+	ring->thread = ++trace_threads;
+	ring->active = 1;
+	pthread_mutex_unlock(&trace_lock);
+
+	pthread_setspecific(trace_key, ring);
+	trace_own_ring = ring;
+	return ring;
+}
+
+
+/**
+ * Function: trace_event
+ * ----------------------------
+ *   records an event in the ring buffer of the calling thread. The ring is allocated
+ *   (or recycled from a thread that has exited) at the first event of each thread, or
+ *   by trace_thread_name().
+ *
+ *   @param name:  the name of the stage; it must be a string literal or stay valid until the trace is written;
+ *   @param phase: 'B' at the beginning of the stage, 'E' at its end.
+ */
+
+void trace_event(const char* name, char phase) {
+	struct trace_ring* ring = trace_own_ring != NULL ? trace_own_ring : own_ring();
+	struct trace_record* record;
+	struct timespec now;
+	unsigned long long written;
+
+	if (ring == NULL) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+	record = &ring->records[written & (TRACE_RING_SIZE - 1)];
+	record->time = (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+	record->name = name;
+	record->phase = phase;
+	atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+}
+
+
+/**
+ * Function: trace_thread_name
+ * ----------------------------
+ *   names the calling thread in the trace and allocates its ring buffer.
+ *
+ *   @param name: the name of the thread.
+ *
+ *   @return  Upon successful completion, the function returns 0.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+int trace_thread_name(const char* name) {
+	struct trace_ring* ring = own_ring();
+
+	if (ring == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&trace_lock);
+	strncpy(ring->thread_name, name, TRACE_THREAD_NAME_SIZE - 1);
+	pthread_mutex_unlock(&trace_lock);
+	return 0;
+}
+
+
+/**
+ * Function: print_string
+ * ----------------------------
+ *   writes a JSON string, escaping the characters that need it.
+ */
+
+static void print_string(FILE* file, const char* text) {
+	fputc('"', file);
+	for (; *text != '\0'; text++) {
+		if (*text == '"' || *text == '\\') fprintf(file, "\\%c", *text);
+		else if ((unsigned char)*text < 0x20) fprintf(file, "\\u%04x", (unsigned char)*text);
+		else fputc(*text, file);
+	}
+	fputc('"', file);
+}
+
+
+/**
+ * Function: trace_write_json
+ * ----------------------------
+ *   writes the events of all the threads to a file, in the Chrome trace-event JSON format.
+ *   Timestamps are CLOCK_MONOTONIC microseconds; each thread of the library is a track.
+ *   Threads still recording may overwrite the events being written: call it when they are idle.
+ *
+ *   @param path: the file to write.
+ *
+ *   @return  Upon successful completion, the function returns the number of events written.
+ *            Otherwise, -1 is returned and errno is set to indicate the error.
+ */
+
+long trace_write_json(const char* path) {
+	struct trace_ring* ring;
+	struct trace_record* record;
+	unsigned long long written, first, i;
+	long events = 0;
+	int pid = (int)getpid();
+	FILE* file;
+
+	file = fopen(path, "w");
+	if (file == NULL) {
+		return -1;
+	}
+	fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+	pthread_mutex_lock(&trace_lock);
+	for (ring = trace_rings; ring != NULL; ring = ring->next) {
+		if (ring->thread_name[0] != '\0') {
+			fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %i, \"tid\": %i, \"args\": {\"name\": ", events > 0 ? "," : "", pid, ring->thread);
+			print_string(file, ring->thread_name);
+			fprintf(file, "}}");
+			events++;
+		}
+		written = atomic_load_explicit(&ring->written, memory_order_acquire);
+		first = atomic_load_explicit(&ring->cleared, memory_order_relaxed);
+		if (written - first > TRACE_RING_SIZE) {
+			first = written - TRACE_RING_SIZE;
+		}
+		for (i = first; i < written; i++) {
+			record = &ring->records[i & (TRACE_RING_SIZE - 1)];
+			fprintf(file, "%s\n{\"name\": ", events > 0 ? "," : "");
+			print_string(file, record->name);
+			fprintf(file, ", \"ph\": \"%c\", \"ts\": %llu.%03llu, \"pid\": %i, \"tid\": %i}",
+				record->phase, record->time / 1000ull, record->time % 1000ull, pid, ring->thread);
+			events++;
+		}
+	}
+	pthread_mutex_unlock(&trace_lock);
+	fprintf(file, "\n]}\n");
+	if (fclose(file) != 0) {
+		return -1;
+	}
+	return events;
+}
+
+
+/**
+ * Function: trace_clear
+ * ----------------------------
+ *   discards the events recorded so far by all the threads.
+ */
+
+void trace_clear() {
+	struct trace_ring* ring;
+
+	pthread_mutex_lock(&trace_lock);
+	for (ring = trace_rings; ring != NULL; ring = ring->next) {
+		atomic_store_explicit(&ring->cleared, atomic_load_explicit(&ring->written, memory_order_acquire), memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,159 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file test03_decode_plan_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test compares the decoding of binary messages (set_binary_no_names()) with a
+ * compiled decode plan against the generic decoder that switches on the type of every field.
+ * No Trick Variable Server is needed: the messages are built locally.
+ * Two layouts are measured: only doubles (specialized loop) and a mix of doubles, floats,
+ * integers and booleans (one converter per operation). subscription_decode(), which also checks
+ * that each message matches the plan, is measured too; its commands are written to a local
+ * socket pair.
+ * The program takes as optional input parameters the number of variables per message (default 64)
+ * and the number of messages to decode (default 1000000).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_decoder.h"
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static unsigned int build_frame(unsigned char* frame, int variables, int mixed) {
+	unsigned int offset = 12;
+	int i, type, size, zero = 0, count = variables;
+	double d;
+	float f;
+	int n;
+
+	for (i = 0; i < variables; i++) {
+		type = TRICK_TYPE_DOUBLE; size = 8;
+		if (mixed && i % 4 == 1) { type = TRICK_TYPE_FLOAT; size = 4; }
+		if (mixed && i % 4 == 2) { type = TRICK_TYPE_INTEGER; size = 4; }
+		if (mixed && i % 4 == 3) { type = TRICK_TYPE_BOOLEAN; size = 1; }
+		memcpy(frame + offset, &type, 4);
+		memcpy(frame + offset + 4, &size, 4);
+		offset += 8;
+		if (size == 8) { d = i * 0.5; memcpy(frame + offset, &d, 8); }
+		else if (type == TRICK_TYPE_FLOAT) { f = i * 0.25f; memcpy(frame + offset, &f, 4); }
+		else if (size == 4) { n = i; memcpy(frame + offset, &n, 4); }
+		else frame[offset] = 1;
+		offset += size;
+	}
+	memcpy(frame, &zero, 4);
+	size = offset - 4;
+	memcpy(frame + 4, &size, 4);
+	memcpy(frame + 8, &count, 4);
+	return offset;
+}
+
+
+int main (int narg, char** args)
+{
+	int variables = 64;
+	long messages = 1000000;
+	int mixed, i;
+	long m;
+	double start, generic_time, plan_time, subscription_time, check = 0.0;
+	struct decode_plan plan;
+	struct subscription subscription;
+	char name[32];
+	int sockets[2];
+	unsigned char* frame;
+	unsigned int length;
+	double* values;
+
+	if (narg > 1) variables = atoi(args[1]);
+	if (narg > 2) messages = atol(args[2]);
+
+	frame = malloc(12 + variables * 16);
+	values = malloc(sizeof(double) * variables);
+	memset(&plan, 0, sizeof(plan));
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+
+	for (mixed = 0; mixed < 2; mixed++) {
+		length = build_frame(frame, variables, mixed);
+
+		start = now();
+		for (m = 0; m < messages; m++) {
+			decode_frame_generic(frame, length, 0, values, variables);
+			check += values[m % variables];
+		}
+		generic_time = now() - start;
+
+		if (decode_plan_compile(&plan, frame, length, 0) < 0) {
+			puts("failed to compile the decode plan");
+			return 1;
+		}
+		start = now();
+		for (m = 0; m < messages; m++) {
+			decode_plan_decode(&plan, frame, length, values);
+			check += values[m % variables];
+		}
+		plan_time = now() - start;
+
+		subscription_init(&subscription, sockets[0], 0);
+		for (i = 0; i < variables; i++) {
+			snprintf(name, sizeof(name), "v[%i]", i);
+			subscription_add(&subscription, name);
+		}
+		start = now();
+		for (m = 0; m < messages; m++) {
+			subscription_decode(&subscription, frame, length, values);
+			check += values[m % variables];
+		}
+		subscription_time = now() - start;
+		subscription_destroy(&subscription);
+
+		printf("%s layout, %i variables, %li messages\n", mixed ? "mixed" : "double-only", variables, messages);
+		printf("  generic decoder: %8.1f ns/message  %8.2f Mvalues/s\n", generic_time * 1.0e9 / messages, variables * messages / generic_time * 1.0e-6);
+		printf("  decode plan:     %8.1f ns/message  %8.2f Mvalues/s\n", plan_time * 1.0e9 / messages, variables * messages / plan_time * 1.0e-6);
+		printf("  subscription:    %8.1f ns/message  %8.2f Mvalues/s\n", subscription_time * 1.0e9 / messages, variables * messages / subscription_time * 1.0e-6);
+		printf("  speedup:         %8.2f\n", generic_time / plan_time);
+	}
+	for (i = 0; i < variables; i++) check += values[i];
+	printf("(checksum %g)\n", check);
+
+	decode_plan_destroy(&plan);
+	close_socket(sockets[0]);
+	close_socket(sockets[1]);
+	free(values);
+	free(frame);
+	return 0;
+
+}
@@ -0,0 +1,140 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file test04_command_writer_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test measures the throughput of sending a multi-kilobyte setup script: one
+ * send_command_to_variable_server() per statement against the streaming command writer,
+ * which batches the short statements and references the long ones without copying them.
+ * No Trick Variable Server is needed: the commands are written to a local socket pair
+ * and drained by a thread, which checks that the expected number of bytes arrives.
+ * The program takes as optional input parameters the number of statements per script (default 200),
+ * the length of the long Python expressions (default 4096) and the number of scripts (default 2000).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_command_writer.h"
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void* drain(void* argument) {
+	int socket = *(int*)argument;
+	static char buffer[1 << 16];
+	long total = 0;
+	ssize_t n;
+
+	while ((n = recv(socket, buffer, sizeof(buffer), 0)) > 0) {
+		total += n;
+	}
+	*(long*)argument = total;
+	return NULL;
+}
+
+
+int main (int narg, char** args)
+{
+	int statements = 200, expression_length = 4096, i, k;
+	long scripts = 2000, s, expected = 0, received;
+	double start, plain_time, writer_time;
+	struct command_writer writer;
+	char** script;
+	char* p;
+	int sockets[2];
+	long reader_state;
+	pthread_t reader;
+
+	if (narg > 1) statements = atoi(args[1]);
+	if (narg > 2) expression_length = atoi(args[2]);
+	if (narg > 3) scripts = atol(args[3]);
+
+	/* every tenth statement is a long Python expression, the others are short assignments */
+	script = malloc(sizeof(char*) * statements);
+	for (i = 0; i < statements; i++) {
+		if (i % 10 == 9) {
+			script[i] = malloc(expression_length + 1);
+			p = script[i] + sprintf(script[i], "trick.var_set(\"ball.state.input.mass\", 1.0");
+			while (p - script[i] < expression_length - 8) p += sprintf(p, " + 0.0");
+			strcpy(p, ")");
+		}
+		else {
+			script[i] = malloc(128);
+			sprintf(script[i], "ball.state.input.position[%i] = %i.5", i % 3, i);
+		}
+		expected += strlen(script[i]) + 1;
+	}
+	expected *= scripts;
+
+	for (i = 0; i < 2; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		reader_state = sockets[1];
+		pthread_create(&reader, NULL, drain, &reader_state);
+
+		start = now();
+		command_writer_init(&writer, sockets[0]);
+		for (s = 0; s < scripts; s++) {
+			for (k = 0; k < statements; k++) {
+				if (i == 0) send_command_to_variable_server(sockets[0], script[k]);
+				else command_writer_command(&writer, script[k]);
+			}
+			if (i == 1) command_writer_flush(&writer);
+		}
+		if (i == 0) plain_time = now() - start;
+		else writer_time = now() - start;
+
+		shutdown(sockets[0], SHUT_WR);
+		pthread_join(reader, NULL);
+		received = reader_state;
+		close_socket(sockets[0]);
+		close_socket(sockets[1]);
+		if (received != expected) {
+			printf("%s: received %li bytes instead of %li\n", i == 0 ? "plain" : "writer", received, expected);
+			return 1;
+		}
+	}
+
+	printf("%i statements per script (%li bytes), %li scripts\n", statements, expected / scripts, scripts);
+	printf("  one send per command: %8.1f us/script  %8.1f MB/s  %8i writes/script\n", plain_time * 1.0e6 / scripts, expected / plain_time * 1.0e-6, statements);
+	printf("  command writer:       %8.1f us/script  %8.1f MB/s  %8.1f writes/script\n", writer_time * 1.0e6 / scripts, expected / writer_time * 1.0e-6, (double)writer.writes / scripts);
+	printf("  speedup:              %8.2f\n", plain_time / writer_time);
+
+	for (i = 0; i < statements; i++) free(script[i]);
+	free(script);
+	return 0;
+
+}
@@ -0,0 +1,196 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file test05_realtime_latency.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test measures the latency of the real-time receive path under synthetic CPU load.
+ * No Trick Variable Server is needed: a thread writes binary messages (set_binary_no_names())
+ * at a fixed period into a local socket pair, stamping each one with its CLOCK_MONOTONIC send time.
+ * The receiving thread applies the real-time profile (CPU 0, SCHED_FIFO, locked memory, which
+ * need the privileges to do so; the test goes on without them), then waits for every message with
+ * receiver_wait_for_frame() and decodes it with a compiled decode plan while busy threads load the CPUs.
+ * Build the library with -DTRICK_VS_MALLOC_GUARD: the receiving thread forbids its own allocations
+ * and the test fails if any is attempted.
+ * The program takes as optional input parameters the number of messages (default 5000), the number
+ * of load threads (default 2), the period in microseconds (default 1000) and the spin budget in
+ * nanoseconds (default 0).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_receiver.h"
+#include "../include/trick_variable_server_decoder.h"
+#include "../include/trick_variable_server_realtime.h"
+
+#define VARIABLES 32
+
+
+static volatile int running = 1;
+static int sockets[2];
+static long period_us = 1000;
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void* load(void* argument) {
+	volatile double x = 1.0;
+
+	while (running) {
+		x = x * 1.0000001 + 0.5;
+	}
+	return argument;
+}
+
+
+static void* produce(void* argument) {
+	unsigned char frame[12 + VARIABLES * 16];
+	struct timespec next;
+	int i, zero = 0, type = TRICK_TYPE_DOUBLE, size = 8, count = VARIABLES, offset;
+	double value;
+
+	for (i = 0, offset = 12; i < VARIABLES; i++, offset += 16) {
+		memcpy(frame + offset, &type, 4);
+		memcpy(frame + offset + 4, &size, 4);
+		value = i;
+		memcpy(frame + offset + 8, &value, 8);
+	}
+	memcpy(frame, &zero, 4);
+	size = sizeof(frame) - 4;
+	memcpy(frame + 4, &size, 4);
+	memcpy(frame + 8, &count, 4);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (running) {
+		next.tv_nsec += period_us * 1000;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		value = now();
+		memcpy(frame + 20, &value, 8);
+		if (send(sockets[0], frame, sizeof(frame), MSG_NOSIGNAL) < 0) break;
+	}
+	return argument;
+}
+
+
+static int compare(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+int main (int narg, char** args)
+{
+	long messages = 5000, spin_budget = 0, m;
+	int loaders = 2, i, result;
+	struct realtime_profile profile = { 0, 80, 1, 256 * 1024, 1 };
+	struct frame_receiver receiver;
+	struct receiver_frame frame;
+	struct decode_plan plan;
+	struct timespec deadline;
+	pthread_t producer, loader[64];
+	double values[VARIABLES];
+	double* latency;
+	double sum = 0.0;
+	long received = 0, timeouts = 0;
+
+	if (narg > 1) messages = atol(args[1]);
+	if (narg > 2) loaders = atoi(args[2]);
+	if (narg > 3) period_us = atol(args[3]);
+	if (narg > 4) spin_budget = atol(args[4]);
+	if (loaders > 64) loaders = 64;
+
+	latency = calloc(messages, sizeof(double));
+	memset(&plan, 0, sizeof(plan));
+	if (latency == NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0 || receiver_init(&receiver, sockets[1], RECEIVER_BINARY, 4096) < 0) {
+		perror("setup");
+		return 1;
+	}
+	for (i = 0; i < loaders; i++) pthread_create(&loader[i], NULL, load, NULL);
+	pthread_create(&producer, NULL, produce, NULL);
+
+	/* applied after creating the other threads, which would inherit it */
+	if (realtime_apply(&profile) < 0) {
+		printf("real-time profile not fully applied (%s): measuring without it\n", strerror(errno));
+	}
+	realtime_prepare_receiver(&receiver, 1024 * 1024);
+
+	/* the first message compiles the plan: it is the last allocation of the receiving thread */
+	if (receiver_wait_for_frame(&receiver, NULL, 0, &frame) <= 0 || decode_plan_compile(&plan, frame.data, frame.length, 0) < 0) {
+		perror("first message");
+		return 1;
+	}
+
+	realtime_guard_allocations(1);
+	while (received < messages) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += 4 * period_us * 1000;
+		while (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_nsec -= 1000000000L;
+			deadline.tv_sec++;
+		}
+		result = receiver_wait_for_frame(&receiver, &deadline, spin_budget, &frame);
+		if (result < 0) break;
+		if (result == 0) {
+			timeouts++;
+			continue;
+		}
+		decode_plan_decode(&plan, frame.data, frame.length, values);
+		latency[received++] = now() - values[0];
+	}
+	realtime_guard_allocations(0);
+
+	running = 0;
+	pthread_join(producer, NULL);
+	for (i = 0; i < loaders; i++) pthread_join(loader[i], NULL);
+
+	qsort(latency, received, sizeof(double), compare);
+	for (m = 0; m < received; m++) sum += latency[m];
+	printf("%li messages every %li us, %i load threads, spin budget %li ns\n", received, period_us, loaders, spin_budget);
+	if (received > 0) {
+		printf("  latency: min %8.1f us  mean %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n",
+			latency[0] * 1.0e6, sum / received * 1.0e6, latency[received * 99 / 100] * 1.0e6,
+			latency[received * 999 / 1000] * 1.0e6, latency[received - 1] * 1.0e6);
+	}
+	printf("  timeouts: %li  superseded: %lu  allocations on the receive path: %lu\n", timeouts, receiver.superseded, realtime_allocation_violations());
+
+	decode_plan_destroy(&plan);
+	receiver_destroy(&receiver);
+	free(latency);
+	return realtime_allocation_violations() == 0 ? 0 : 1;
+
+}
@@ -0,0 +1,187 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+/**
+ * @file test06_columns_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test compares the transposition of binary messages (set_binary_no_names()) into
+ * per-variable columns with the scalar, SSSE3 and AVX2 kernels, and with a compiled decode plan
+ * followed by a scatter of each decoded row into the columns (in the byte order of this host only,
+ * which is the one the decoder supports).
+ * No Trick Variable Server is needed: the messages are built locally, of doubles only, both in the
+ * byte order of this host and in the other one. Every kernel is checked against the scalar one.
+ * The program takes as optional input parameters the number of variables per message (default 64),
+ * the number of messages to transpose (default 1000000) and the rows of a batch (default 256).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/trick_variable_server_decoder.h"
+#include "../include/trick_variable_server_columns.h"
+
+#define RING 64
+
+
+static const char* names[] = { "auto", "scalar", "SSSE3", "AVX2" };
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void put(unsigned char* field, const void* value, int size, int swap) {
+	int i;
+
+	for (i = 0; i < size; i++) {
+		field[i] = ((const unsigned char*)value)[swap ? size - 1 - i : i];
+	}
+}
+
+
+static unsigned int build_frame(unsigned char* frame, int variables, int swap, int seed) {
+	unsigned int offset = 12;
+	int i, type = TRICK_TYPE_DOUBLE, size = 8, zero = 0;
+	double d;
+
+	for (i = 0; i < variables; i++, offset += 16) {
+		d = seed * 1000.0 + i * 0.5;
+		put(frame + offset, &type, 4, swap);
+		put(frame + offset + 4, &size, 4, swap);
+		put(frame + offset + 8, &d, 8, swap);
+	}
+	size = offset - 4;
+	put(frame, &zero, 4, swap);
+	put(frame + 4, &size, 4, swap);
+	put(frame + 8, &variables, 4, swap);
+	return offset;
+}
+
+
+static double run(struct column_set* set, const unsigned char* const* frames, const unsigned int* lengths, long messages, double* check) {
+	double start = now();
+	long m, done;
+	int appended;
+
+	for (m = 0; m < messages; m += done) {
+		done = messages - m < RING ? messages - m : RING;
+		appended = columns_append(set, frames, lengths, (int)done);
+		if (appended < 0) {
+			return -1.0;
+		}
+		done = appended;
+		if (set->rows == set->capacity) {
+			*check += columns_column(set, (int)(m % set->variables))[set->rows - 1];
+			columns_reset(set);
+		}
+	}
+	return now() - start;
+}
+
+
+int main (int narg, char** args)
+{
+	int variables = 64, capacity = 256;
+	long messages = 1000000, m;
+	int swap, kernel, i, row, failures = 0;
+	unsigned char* frames[RING];
+	unsigned int lengths[RING];
+	struct column_set reference, set;
+	struct decode_plan plan;
+	double start, time, scalar_time = 0.0, check = 0.0;
+	double* values;
+
+	if (narg > 1) variables = atoi(args[1]);
+	if (narg > 2) messages = atol(args[2]);
+	if (narg > 3) capacity = atoi(args[3]);
+
+	for (i = 0; i < RING; i++) frames[i] = malloc(12 + variables * 16);
+	values = malloc(sizeof(double) * variables);
+	memset(&plan, 0, sizeof(plan));
+
+	for (swap = 0; swap < 2; swap++) {
+		for (i = 0; i < RING; i++) lengths[i] = build_frame(frames[i], variables, swap, i);
+		printf("%s byte order, %i variables, %li messages, batches of %i rows\n", swap ? "other" : "host", variables, messages, capacity);
+
+		/* decode plan (host byte order only), then one row scattered into the columns */
+		if (!swap) {
+			if (columns_init(&set, variables, capacity, 0, COLUMNS_SCALAR) < 0 || decode_plan_compile(&plan, frames[0], lengths[0], 0) < 0) {
+				puts("setup failed");
+				return 1;
+			}
+			start = now();
+			for (m = 0; m < messages; m++) {
+				decode_plan_decode(&plan, frames[m % RING], lengths[m % RING], values);
+				for (i = 0; i < variables; i++) set.storage[(size_t)i * capacity + set.rows] = values[i];
+				if (++set.rows == capacity) {
+					check += set.storage[set.rows - 1];
+					set.rows = 0;
+				}
+			}
+			time = now() - start;
+			printf("  plan + scatter: %8.1f ns/message  %8.2f Mvalues/s\n", time * 1.0e9 / messages, variables * messages / time * 1.0e-6);
+			columns_destroy(&set);
+		}
+
+		/* the reference for the checks: the scalar kernel on one batch */
+		columns_init(&reference, variables, RING, swap, COLUMNS_SCALAR);
+		columns_append(&reference, (const unsigned char* const*)frames, lengths, RING);
+
+		for (kernel = COLUMNS_SCALAR; kernel <= COLUMNS_AVX2; kernel++) {
+			if (!columns_kernel_supported(kernel)) {
+				printf("  %-14s  not supported by this processor\n", names[kernel]);
+				continue;
+			}
+			columns_init(&set, variables, RING, swap, kernel);
+			columns_append(&set, (const unsigned char* const*)frames, lengths, RING);
+			for (i = 0; i < variables; i++) {
+				for (row = 0; row < RING; row++) {
+					if (columns_column(&set, i)[row] != columns_column(&reference, i)[row] || columns_column(&set, i)[row] != row * 1000.0 + i * 0.5) failures++;
+				}
+			}
+			columns_destroy(&set);
+
+			columns_init(&set, variables, capacity, swap, kernel);
+			time = run(&set, (const unsigned char* const*)frames, lengths, messages, &check);
+			columns_destroy(&set);
+			if (time < 0.0) {
+				puts("transposition failed");
+				return 1;
+			}
+			if (kernel == COLUMNS_SCALAR) scalar_time = time;
+			printf("  %-14s  %8.1f ns/message  %8.2f Mvalues/s  speedup %5.2f\n", names[kernel], time * 1.0e9 / messages, variables * messages / time * 1.0e-6, scalar_time / time);
+		}
+		columns_destroy(&reference);
+	}
+	printf("(checksum %g, %i mismatches)\n", check, failures);
+
+	decode_plan_destroy(&plan);
+	for (i = 0; i < RING; i++) free(frames[i]);
+	free(values);
+	return failures == 0 ? 0 : 1;
+
+}
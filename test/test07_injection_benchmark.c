@@ -0,0 +1,160 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test07_injection_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test measures the number of values injected per second with trick.var_set():
+ * one send_command_to_variable_server() per value formatted with snprintf("%.17g"), all the
+ * values of a cycle formatted with snprintf() into one write, and the injector (prepared
+ * commands, shortest round-trip formatting, one write per cycle).
+ * No Trick Variable Server is needed: the commands are written to a local socket pair and
+ * drained by a thread. The text of every value written by the injector is also read back
+ * with strtod() to check that it round-trips.
+ * The program takes as optional input parameters the number of variables (default 64) and
+ * the number of cycles (default 20000).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_injector.h"
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void* drain(void* argument) {
+	int socket = *(int*)argument;
+	static char buffer[1 << 16];
+	ssize_t n;
+
+	while ((n = recv(socket, buffer, sizeof(buffer), 0)) > 0);
+	return NULL;
+}
+
+
+static double value_of(long cycle, int variable) {
+	return (double)(cycle % 1000) * 0.001 + variable * 1.1 + 1.0 / (variable + 3);
+}
+
+
+int main (int narg, char** args)
+{
+	int variables = 64, mode, i, length, failures = 0;
+	long cycles = 20000, c;
+	double start, time[3];
+	char** names;
+	char* buffer;
+	char command[256], number[INJECTOR_NUMBER_SIZE + 1];
+	char* p;
+	struct injector injector;
+	int sockets[2], reader_socket;
+	pthread_t reader;
+	static const char* labels[3] = { "one send per value, %.17g:", "one write per cycle, %.17g:", "injector:" };
+
+	if (narg > 1) variables = atoi(args[1]);
+	if (narg > 2) cycles = atol(args[2]);
+
+	names = malloc(sizeof(char*) * variables);
+	buffer = malloc((size_t)variables * 128);
+	for (i = 0; i < variables; i++) {
+		names[i] = malloc(64);
+		sprintf(names[i], "hil.actuator[%i].command", i);
+	}
+
+	for (c = 0; c < 1000000; c++) {
+		double v = value_of(c, (int)(c % 7)) * (c % 2 ? 1.0e-9 : 1.0e9);
+		length = injector_format_double(v, number);
+		number[length] = '\0';
+		if (strtod(number, NULL) != v) failures++;
+	}
+
+	for (mode = 0; mode < 3; mode++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		reader_socket = sockets[1];
+		pthread_create(&reader, NULL, drain, &reader_socket);
+		if (mode == 2 && injector_bind(&injector, sockets[0], names, NULL, variables) < 0) {
+			perror("injector_bind");
+			return 1;
+		}
+
+		start = now();
+		for (c = 0; c < cycles; c++) {
+			if (mode == 0) {
+				for (i = 0; i < variables; i++) {
+					snprintf(command, sizeof(command), "trick.var_set(\"%s\", %.17g)", names[i], value_of(c, i));
+					send_command_to_variable_server(sockets[0], command);
+				}
+			}
+			else if (mode == 1) {
+				p = buffer;
+				for (i = 0; i < variables; i++) {
+					p += sprintf(p, "trick.var_set(\"%s\", %.17g)\n", names[i], value_of(c, i));
+				}
+				send(sockets[0], buffer, p - buffer, MSG_NOSIGNAL);
+			}
+			else {
+				for (i = 0; i < variables; i++) {
+					injector_set_double(&injector, i, value_of(c, i));
+				}
+				if (injector_send(&injector) != variables) {
+					perror("injector_send");
+					return 1;
+				}
+			}
+		}
+		time[mode] = now() - start;
+
+		shutdown(sockets[0], SHUT_WR);
+		pthread_join(reader, NULL);
+		close_socket(sockets[0]);
+		close_socket(sockets[1]);
+		if (mode == 2) injector_destroy(&injector);
+	}
+
+	printf("%i variables, %li cycles\n", variables, cycles);
+	for (mode = 0; mode < 3; mode++) {
+		printf("  %-28s %8.2f us/cycle  %8.2f Mvalues/s  speedup %6.2f\n", labels[mode], time[mode] * 1.0e6 / cycles,
+			variables * cycles / time[mode] * 1.0e-6, time[0] / time[mode]);
+	}
+	printf("  round-trip failures: %i\n", failures);
+
+	for (i = 0; i < variables; i++) free(names[i]);
+	free(names);
+	free(buffer);
+	return failures == 0 ? 0 : 1;
+
+}
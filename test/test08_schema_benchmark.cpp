@@ -0,0 +1,165 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test08_schema_benchmark.cpp
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test compares the parser generated from a compile-time schema (C++20) with the
+ * generic decoder and with a compiled decode plan on binary messages (set_binary_no_names()).
+ * No Trick Variable Server is needed: the messages are built locally with the layout of the
+ * schema, 16 variables mixing doubles, floats, integers and booleans.
+ * The program prints the subscription generated from the schema and takes as optional input
+ * parameter the number of messages to decode (default 10000000).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "../include/trick_variable_server_schema.hpp"
+
+
+struct vehicle {
+	double x, y, z;
+	float heading;
+	int mode;
+	bool engaged;
+	double vx, vy, vz;
+	float pitch;
+	int gear;
+	bool braking;
+	double ax, ay;
+	float roll;
+	bool fault;
+};
+
+using vehicle_schema = trick_vs::schema<vehicle,
+	trick_vs::field<"veh.state.position[0]", &vehicle::x, "m">,
+	trick_vs::field<"veh.state.position[1]", &vehicle::y, "m">,
+	trick_vs::field<"veh.state.position[2]", &vehicle::z, "m">,
+	trick_vs::field<"veh.state.heading", &vehicle::heading, "d">,
+	trick_vs::field<"veh.control.mode", &vehicle::mode>,
+	trick_vs::field<"veh.control.engaged", &vehicle::engaged>,
+	trick_vs::field<"veh.state.velocity[0]", &vehicle::vx, "m/s">,
+	trick_vs::field<"veh.state.velocity[1]", &vehicle::vy, "m/s">,
+	trick_vs::field<"veh.state.velocity[2]", &vehicle::vz, "m/s">,
+	trick_vs::field<"veh.state.pitch", &vehicle::pitch, "d">,
+	trick_vs::field<"veh.drive.gear", &vehicle::gear>,
+	trick_vs::field<"veh.drive.braking", &vehicle::braking>,
+	trick_vs::field<"veh.state.acceleration[0]", &vehicle::ax, "m/s2">,
+	trick_vs::field<"veh.state.acceleration[1]", &vehicle::ay, "m/s2">,
+	trick_vs::field<"veh.state.roll", &vehicle::roll, "d">,
+	trick_vs::field<"veh.status.fault", &vehicle::fault>>;
+
+static const int types[vehicle_schema::count] = {
+	TRICK_TYPE_DOUBLE, TRICK_TYPE_DOUBLE, TRICK_TYPE_DOUBLE, TRICK_TYPE_FLOAT, TRICK_TYPE_INTEGER, TRICK_TYPE_BOOLEAN,
+	TRICK_TYPE_DOUBLE, TRICK_TYPE_DOUBLE, TRICK_TYPE_DOUBLE, TRICK_TYPE_FLOAT, TRICK_TYPE_INTEGER, TRICK_TYPE_BOOLEAN,
+	TRICK_TYPE_DOUBLE, TRICK_TYPE_DOUBLE, TRICK_TYPE_FLOAT, TRICK_TYPE_BOOLEAN
+};
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void build_frame(unsigned char* frame) {
+	unsigned int offset = 12;
+	int i, size, zero = 0, count = vehicle_schema::count;
+	double d;
+	float f;
+
+	for (i = 0; i < vehicle_schema::count; i++) {
+		size = types[i] == TRICK_TYPE_DOUBLE ? 8 : types[i] == TRICK_TYPE_BOOLEAN ? 1 : 4;
+		std::memcpy(frame + offset, &types[i], 4);
+		std::memcpy(frame + offset + 4, &size, 4);
+		offset += 8;
+		if (types[i] == TRICK_TYPE_DOUBLE) { d = i * 0.5; std::memcpy(frame + offset, &d, 8); }
+		else if (types[i] == TRICK_TYPE_FLOAT) { f = i * 0.25f; std::memcpy(frame + offset, &f, 4); }
+		else if (types[i] == TRICK_TYPE_INTEGER) std::memcpy(frame + offset, &i, 4);
+		else frame[offset] = 1;
+		offset += size;
+	}
+	std::memcpy(frame, &zero, 4);
+	size = offset - 4;
+	std::memcpy(frame + 4, &size, 4);
+	std::memcpy(frame + 8, &count, 4);
+}
+
+
+int main (int narg, char** args)
+{
+	long messages = 10000000, m;
+	double start, generic_time, plan_time, schema_time, check = 0.0;
+	unsigned char frame[vehicle_schema::frame_length];
+	double values[vehicle_schema::count];
+	struct decode_plan plan;
+	vehicle state {};
+
+	if (narg > 1) messages = atol(args[1]);
+
+	std::printf("%s\n\n", vehicle_schema::commands.data());
+
+	build_frame(frame);
+	std::memset(&plan, 0, sizeof(plan));
+	if (!vehicle_schema::validate(frame, sizeof(frame)) || decode_plan_compile(&plan, frame, sizeof(frame), 0) < 0) {
+		std::puts("the message does not have the layout of the schema");
+		return 1;
+	}
+
+	start = now();
+	for (m = 0; m < messages; m++) {
+		decode_frame_generic(frame, sizeof(frame), 0, values, vehicle_schema::count);
+		check += values[m % vehicle_schema::count];
+	}
+	generic_time = now() - start;
+
+	start = now();
+	for (m = 0; m < messages; m++) {
+		decode_plan_decode(&plan, frame, sizeof(frame), values);
+		check += values[m % vehicle_schema::count];
+	}
+	plan_time = now() - start;
+
+	start = now();
+	for (m = 0; m < messages; m++) {
+		vehicle_schema::parse(frame, sizeof(frame), state);
+		check += state.x + state.heading + state.gear;
+		frame[20] ^= 1;
+	}
+	schema_time = now() - start;
+
+	std::printf("%i variables, %li messages\n", vehicle_schema::count, messages);
+	std::printf("  generic decoder: %8.1f ns/message\n", generic_time * 1.0e9 / messages);
+	std::printf("  decode plan:     %8.1f ns/message\n", plan_time * 1.0e9 / messages);
+	std::printf("  schema parser:   %8.1f ns/message\n", schema_time * 1.0e9 / messages);
+	std::printf("  speedup:         %8.2f over the generic decoder, %.2f over the decode plan\n", generic_time / schema_time, plan_time / schema_time);
+	std::printf("(checksum %g)\n", check);
+
+	decode_plan_destroy(&plan);
+	return 0;
+
+}
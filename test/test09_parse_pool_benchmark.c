@@ -0,0 +1,190 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test09_parse_pool_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test measures the throughput of the parse pool on a skewed load, from one worker
+ * to N, with and without work stealing.
+ * No Trick Variable Server is needed: 8 connections receive binary messages (set_binary_no_names())
+ * of 256 variables of mixed types, built locally; connections 0 and 1 receive 10 times the
+ * messages of the others. Two receive threads submit the messages of their connections and
+ * collect the results, checking that every connection gets them back in submission order.
+ * Without stealing, each connection is decoded by its home worker only, so the workers
+ * homing the busy connections are saturated while the others are idle.
+ * The program takes as optional input parameters the largest number of workers (default: the
+ * number of online processors) and the number of messages of a busy connection (default 200000).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../include/trick_variable_server_parse_pool.h"
+
+#define CONNECTIONS 8
+#define RECEIVERS 2
+#define VARIABLES 256
+#define DEPTH 256
+
+
+static struct parse_pool pool;
+static unsigned char frame[12 + VARIABLES * 16];
+static unsigned int frame_length;
+static long busy_messages = 200000;
+static int disorders = 0;
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static unsigned int build_frame(unsigned char* frame) {
+	unsigned int offset = 12;
+	int i, type, size, zero = 0, count = VARIABLES;
+	double d;
+	float f;
+	int n;
+
+	for (i = 0; i < VARIABLES; i++) {
+		type = TRICK_TYPE_DOUBLE; size = 8;
+		if (i % 4 == 1) { type = TRICK_TYPE_FLOAT; size = 4; }
+		if (i % 4 == 2) { type = TRICK_TYPE_INTEGER; size = 4; }
+		if (i % 4 == 3) { type = TRICK_TYPE_BOOLEAN; size = 1; }
+		memcpy(frame + offset, &type, 4);
+		memcpy(frame + offset + 4, &size, 4);
+		offset += 8;
+		if (size == 8) { d = i * 0.5; memcpy(frame + offset, &d, 8); }
+		else if (type == TRICK_TYPE_FLOAT) { f = i * 0.25f; memcpy(frame + offset, &f, 4); }
+		else if (size == 4) { n = i; memcpy(frame + offset, &n, 4); }
+		else frame[offset] = 1;
+		offset += size;
+	}
+	memcpy(frame, &zero, 4);
+	size = offset - 4;
+	memcpy(frame + 4, &size, 4);
+	memcpy(frame + 8, &count, 4);
+	return offset;
+}
+
+
+static long messages_of(int connection) {
+	return connection < 2 ? busy_messages : busy_messages / 10;
+}
+
+
+/* submits the messages of every RECEIVERS-th connection, the first value carrying the sequence number */
+static void* receive(void* argument) {
+	int first = (int)(long)argument, c, pending, progress;
+	long submitted[CONNECTIONS] = { 0 }, collected[CONNECTIONS] = { 0 };
+	unsigned char local[sizeof(frame)];
+	struct parse_result result;
+	double sequence;
+
+	memcpy(local, frame, frame_length);
+	do {
+		pending = 0;
+		progress = 0;
+		for (c = first; c < CONNECTIONS; c += RECEIVERS) {
+			while (submitted[c] < messages_of(c)) {
+				sequence = (double)submitted[c];
+				memcpy(local + 20, &sequence, 8);
+				if (parse_pool_submit(&pool, c, local, frame_length) < 0) break;
+				submitted[c]++;
+				progress = 1;
+				if (c >= 2 && submitted[c] % 10 != 0) continue;
+				break;
+			}
+			while (parse_pool_collect(&pool, c, &result) > 0) {
+				if (result.status != 1 || result.values[0] != (double)collected[c] || result.sequence != (unsigned long)collected[c]) {
+					__atomic_add_fetch(&disorders, 1, __ATOMIC_RELAXED);
+				}
+				collected[c]++;
+				progress = 1;
+				parse_pool_release(&pool, c);
+			}
+			if (collected[c] < messages_of(c)) pending = 1;
+		}
+		/* all the slots in flight: leave the processor to the workers */
+		if (!progress) sched_yield();
+	} while (pending);
+	return NULL;
+}
+
+
+static double measure(int workers, int steal, unsigned long* stolen) {
+	pthread_t receiver[RECEIVERS];
+	double start, elapsed;
+	long r;
+	int w;
+
+	if (parse_pool_init(&pool, workers, CONNECTIONS, DEPTH, sizeof(frame), VARIABLES, 0, steal) < 0) {
+		perror("parse_pool_init");
+		exit(1);
+	}
+	start = now();
+	for (r = 0; r < RECEIVERS; r++) pthread_create(&receiver[r], NULL, receive, (void*)r);
+	for (r = 0; r < RECEIVERS; r++) pthread_join(receiver[r], NULL);
+	elapsed = now() - start;
+	*stolen = 0;
+	for (w = 0; w < workers; w++) *stolen += pool.worker[w].stolen;
+	parse_pool_destroy(&pool);
+	return elapsed;
+}
+
+
+int main (int narg, char** args)
+{
+	int max_workers = (int)sysconf(_SC_NPROCESSORS_ONLN), workers, steal, c;
+	long total = 0;
+	unsigned long stolen;
+	double elapsed, base[2] = { 0.0, 0.0 };
+
+	if (narg > 1) max_workers = atoi(args[1]);
+	if (narg > 2) busy_messages = atol(args[2]);
+	if (max_workers < 1) max_workers = 1;
+
+	frame_length = build_frame(frame);
+	for (c = 0; c < CONNECTIONS; c++) total += messages_of(c);
+	printf("%i connections (2 busy, 10:1), %li messages of %i variables, %i receive threads\n", CONNECTIONS, total, VARIABLES, RECEIVERS);
+
+	for (workers = 1; workers <= max_workers; workers++) {
+		for (steal = 0; steal < 2; steal++) {
+			elapsed = measure(workers, steal, &stolen);
+			if (workers == 1) base[steal] = elapsed;
+			printf("  %2i workers, %-11s %8.3f Mmessages/s  scaling %5.2f  stolen %lu\n", workers, steal ? "stealing:" : "home only:",
+				total / elapsed * 1.0e-6, base[steal] / elapsed, stolen);
+		}
+	}
+	printf("messages out of order or not decoded: %i\n", disorders);
+	return disorders == 0 ? 0 : 1;
+
+}
@@ -0,0 +1,166 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test10_name_churn_benchmark.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test measures the throughput of subscription churn, i.e. adding and removing
+ * the same variables over and over: add_variable_to_server() and remove_variable_from_server()
+ * per call, the command writer building each command again, and the command writer copying
+ * the commands cached by the name table, either looking each name up first or by identifier.
+ * No Trick Variable Server is needed: the commands are written to a local socket pair
+ * and drained by a thread, which checks that the expected number of bytes arrives.
+ * The program takes as optional input parameters the number of variables (default 4000)
+ * and the number of rounds (default 200).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_command_writer.h"
+#include "../include/trick_variable_server_names.h"
+
+#define METHODS 4
+
+
+static double now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0e-9;
+}
+
+
+static void* drain(void* argument) {
+	int socket = *(int*)argument;
+	static char buffer[1 << 16];
+	long total = 0;
+	ssize_t n;
+
+	while ((n = recv(socket, buffer, sizeof(buffer), 0)) > 0) {
+		total += n;
+	}
+	*(long*)argument = total;
+	return NULL;
+}
+
+
+int main (int narg, char** args)
+{
+	int variables = 4000, i, v, id;
+	long rounds = 200, r, expected = 0, received;
+	static const char* labels[METHODS] = { "one send per command:", "command writer:", "cached, by name:", "cached, by identifier:" };
+	double start, elapsed[METHODS];
+	struct command_writer writer;
+	struct name_table table;
+	char command[256];
+	char** names;
+	int sockets[2];
+	long reader_state;
+	pthread_t reader;
+
+	if (narg > 1) variables = atoi(args[1]);
+	if (narg > 2) rounds = atol(args[2]);
+
+	names = malloc(sizeof(char*) * variables);
+	if (names == NULL || names_init(&table, variables) < 0) {
+		perror("setup");
+		return 1;
+	}
+	for (v = 0; v < variables; v++) {
+		names[v] = malloc(96);
+		sprintf(names[v], "vehicle_%i.dynamics.state.body_frame.attitude_quaternion[%i]", v / 4, v % 4);
+		expected += strlen("trick.var_add(\"\")\n") + strlen("trick.var_remove(\"\")\n") + 2 * strlen(names[v]);
+		if (names_intern(&table, names[v]) != v) {
+			printf("name %i not interned\n", v);
+			return 1;
+		}
+	}
+	expected *= rounds;
+
+	for (i = 0; i < METHODS; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		reader_state = sockets[1];
+		pthread_create(&reader, NULL, drain, &reader_state);
+
+		start = now();
+		command_writer_init(&writer, sockets[0]);
+		for (r = 0; r < rounds; r++) {
+			for (v = 0; v < variables; v++) {
+				if (i == 0) add_variable_to_server(sockets[0], names[v]);
+				else if (i == 1) {
+					snprintf(command, sizeof(command), "trick.var_add(\"%s\")", names[v]);
+					command_writer_command(&writer, command);
+				}
+				else if (i == 2) {
+					id = names_find(&table, names[v]);
+					names_write_add(&table, &writer, id);
+				}
+				else names_write_add(&table, &writer, v);
+			}
+			for (v = 0; v < variables; v++) {
+				if (i == 0) remove_variable_from_server(sockets[0], names[v]);
+				else if (i == 1) {
+					snprintf(command, sizeof(command), "trick.var_remove(\"%s\")", names[v]);
+					command_writer_command(&writer, command);
+				}
+				else if (i == 2) {
+					id = names_find(&table, names[v]);
+					names_write_remove(&table, &writer, id);
+				}
+				else names_write_remove(&table, &writer, v);
+			}
+			if (i > 0) command_writer_flush(&writer);
+		}
+		elapsed[i] = now() - start;
+
+		shutdown(sockets[0], SHUT_WR);
+		pthread_join(reader, NULL);
+		received = reader_state;
+		close_socket(sockets[0]);
+		close_socket(sockets[1]);
+		if (received != expected) {
+			printf("%s received %li bytes instead of %li\n", labels[i], received, expected);
+			return 1;
+		}
+	}
+
+	printf("%i variables, %li rounds of adding and removing all of them\n", variables, rounds);
+	for (i = 0; i < METHODS; i++) {
+		printf("  %-22s %8.2f Mops/s  %8.1f ns/op\n", labels[i], 2.0 * variables * rounds / elapsed[i] * 1.0e-6, elapsed[i] * 1.0e9 / (2.0 * variables * rounds));
+	}
+	printf("  speedup of the cached commands by identifier: %.2f over one send per command, %.2f over the command writer\n", elapsed[0] / elapsed[3], elapsed[1] / elapsed[3]);
+
+	names_destroy(&table);
+	for (v = 0; v < variables; v++) free(names[v]);
+	free(names);
+	return 0;
+
+}
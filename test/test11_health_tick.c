@@ -0,0 +1,107 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test11_health_tick.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test runs the wheel of the health monitor against its timerfd. No Trick Variable
+ * Server is needed: a link that never receives a message is added, the ticks are processed one
+ * call of health_process() at a time until the link is reported stalled, then the thread of
+ * the monitor is started and must keep processing ticks. Finally, the timerfd must be released
+ * by health_destroy().
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include "../include/trick_variable_server_health.h"
+
+
+static int stalls = 0;
+
+
+static void handle(void* context, const struct health_event* event) {
+	if (event->type == HEALTH_EVENT_STALL) {
+		stalls++;
+	}
+	(void)context;
+}
+
+
+int main (int narg, char** args)
+{
+	struct health_monitor monitor;
+	struct timespec pause_time = { 0, 50 * 1000000L };
+	unsigned long ticks;
+	int timer, calls, result;
+
+	if (health_init(&monitor, 4, 0.001, handle, NULL) < 0 || health_add(&monitor, "silent", 0.001, NULL) < 0) {
+		perror("health_init");
+		return 1;
+	}
+	timer = health_fd(&monitor);
+
+	/* a tick of the wheel */
+	if (health_process(&monitor, 1) < 0 || monitor.ticks == 0) {
+		perror("health_process");
+		return 1;
+	}
+
+	/* no message: stalled after HEALTH_STALL_PERIODS periods */
+	for (calls = 0; stalls == 0 && calls < 1000; calls++) {
+		result = health_process(&monitor, 1);
+		if (result < 0) {
+			perror("health_process");
+			return 1;
+		}
+	}
+	printf("stalled after %lu ticks (%lu checks)\n", monitor.ticks, monitor.checks);
+	if (stalls != 1) {
+		printf("the link was not reported stalled\n");
+		return 1;
+	}
+
+	/* the thread of the monitor goes on processing the ticks */
+	ticks = monitor.ticks;
+	if (health_start(&monitor) < 0) {
+		perror("health_start");
+		return 1;
+	}
+	nanosleep(&pause_time, NULL);
+	health_stop(&monitor);
+	printf("the thread processed %lu ticks in 50 ms\n", monitor.ticks - ticks);
+	if (monitor.ticks - ticks < 10) {
+		printf("the thread of the monitor stopped\n");
+		return 1;
+	}
+
+	health_destroy(&monitor);
+	if (fcntl(timer, F_GETFD) != -1 || errno != EBADF) {
+		printf("the timerfd was not released\n");
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+
+}
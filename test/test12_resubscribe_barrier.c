@@ -0,0 +1,117 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+/**
+ * @file test12_resubscribe_barrier.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test feeds subscription_prepare() and subscription_decode() the messages that
+ * follow a subscription_resubscribe(): a message of the prior layout, the reply to the barrier
+ * (message indicator 5, VS_SEND_ONCE) and messages of the new layout, which has the same number
+ * of variables and the same length but other types. No Trick Variable Server is needed: the
+ * commands are written to a local socket pair and the messages are built by the test.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_decoder.h"
+
+
+/**
+ * Function: build
+ * ----------------------------
+ *   builds a message without names of two 8-byte values of the given type.
+ */
+
+static unsigned int build(unsigned char* frame, int indicator, int type, const void* first, const void* second) {
+	int size = 8, count = 2, length = 12 + 2 * 16 - 4;
+
+	memcpy(frame, &indicator, 4);
+	memcpy(frame + 4, &length, 4);
+	memcpy(frame + 8, &count, 4);
+	memcpy(frame + 12, &type, 4);
+	memcpy(frame + 16, &size, 4);
+	memcpy(frame + 20, first, 8);
+	memcpy(frame + 28, &type, 4);
+	memcpy(frame + 32, &size, 4);
+	memcpy(frame + 36, second, 8);
+	return 12 + 2 * 16;
+}
+
+
+int main (int narg, char** args)
+{
+	static const char* variables[2] = { "ball.state.output.position[0]", "ball.state.output.position[1]" };
+	struct subscription subscription;
+	unsigned char frame[64];
+	unsigned int length;
+	double old_values[2] = { 1.5, 2.5 }, values[2];
+	long long new_values[2] = { 7, 9 }, tics = 100;
+	int sockets[2], failures = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	subscription_init(&subscription, sockets[0], 0);
+	if (subscription_resubscribe(&subscription, variables, NULL, 2) != 1 || subscription.barriers != 1) {
+		perror("subscription_resubscribe");
+		return 1;
+	}
+
+	/* still in flight from before the resubscription: discarded */
+	length = build(frame, 0, TRICK_TYPE_DOUBLE, &old_values[0], &old_values[1]);
+	if (subscription_prepare(&subscription, frame, length) != 0 || subscription.stale != 1) {
+		printf("the message of the prior layout was not discarded\n");
+		failures++;
+	}
+
+	/* the reply to the barrier */
+	length = build(frame, SUBSCRIPTION_SEND_ONCE_INDICATOR, TRICK_TYPE_LONG_LONG, &tics, &tics);
+	if (subscription_prepare(&subscription, frame, length) != 0 || subscription.barriers != 0) {
+		printf("the reply to the barrier was not consumed\n");
+		failures++;
+	}
+
+	/* the new layout, decoded with a plan compiled from it */
+	length = build(frame, 0, TRICK_TYPE_LONG_LONG, &new_values[0], &new_values[1]);
+	if (subscription_decode(&subscription, frame, length, values) != 1 || values[0] != 7.0 || values[1] != 9.0) {
+		printf("the message of the new layout was not decoded\n");
+		failures++;
+	}
+	new_values[0] = 11;
+	length = build(frame, 0, TRICK_TYPE_LONG_LONG, &new_values[0], &new_values[1]);
+	if (subscription_decode(&subscription, frame, length, values) != 1 || values[0] != 11.0 || subscription.stale != 1) {
+		printf("the following message was not decoded\n");
+		failures++;
+	}
+
+	printf("generation %lu: %lu stale messages discarded, %s\n", subscription.generation, subscription.stale, failures == 0 ? "ok" : "failed");
+	subscription_destroy(&subscription);
+	close_socket(sockets[0]);
+	close_socket(sockets[1]);
+	return failures == 0 ? 0 : 1;
+
+}
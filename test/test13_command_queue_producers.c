@@ -0,0 +1,113 @@
+/****************************************************************************
+ * Copyright (C) 2016 by Alfredo Garro                                      *
+ *                                                                          *
+ * This file is part of the Trick Variable Server Connection C library      *
+ *                                                                          *
+ *   TrickVariableServerConnection is free software: you can redistribute   *
+ *   it and/or modify it under the terms of the GNU Lesser General Public   *
+ *   License as published by the Free Software Foundation, either version   *
+ *   3 of the License, or (at your option) any later version.               *
+ *                                                                          *
+ *                                                                          *
+ *   The Trick Variable Server Connection libarry is distributed in the     *
+ *   hope that it will be useful but WITHOUT ANY WARRANTY; without even the *
+ *   implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR        *
+ *   PURPOSE. See theGNU Lesser General Public License for more details.    *
+ *                                                                          *
+ *   You should have received a copy of the GNU Lesser General Public       *
+ *   License along with TrickVariableServerConnection.                      *
+ *   If not, see <http://www.gnu.org/licenses/>.                            *
+ ****************************************************************************/
+
+
+
+/**
+ * @file test13_command_queue_producers.c
+ * @author Alfredo Garro, University of Calabria (Italy), alfredo.garro@unical.it
+ * @brief This test queues commands from several threads at once, each of them calling
+ * command_queue_flush() after every command, and checks that every command reaches the other
+ * end of a local socket pair without any further flush: a command queued while another thread
+ * is releasing the queue must be sent by one of the two threads. No Trick Variable Server is
+ * needed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "../include/trick_variable_server_connection.h"
+#include "../include/trick_variable_server_command_queue.h"
+
+
+#define PRODUCERS 4
+#define COMMANDS  20000
+
+
+static struct command_queue queue;
+static int failures = 0;
+
+
+static void* produce(void* argument) {
+	char command[32];
+	int i, producer = (int)(long)argument;
+
+	for (i = 0; i < COMMANDS; i++) {
+		snprintf(command, sizeof(command), "%d %05d", producer, i);
+		if (command_queue_submit(&queue, command, COMMAND_CLASS_NONE) < 0 || command_queue_flush(&queue) < 0) {
+			perror("command_queue");
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	return NULL;
+}
+
+
+int main (int narg, char** args)
+{
+	static char buffer[65536];
+	pthread_t producers[PRODUCERS];
+	struct timeval timeout = { 1, 0 };
+	long received = 0, expected = (long)PRODUCERS * COMMANDS * 8, lines = 0, i;
+	ssize_t result;
+	int sockets[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	setsockopt(sockets[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	command_queue_init(&queue, sockets[0]);
+	for (i = 0; i < PRODUCERS; i++) {
+		pthread_create(&producers[i], NULL, produce, (void*)i);
+	}
+
+	/* the producers block on a full socket buffer: read while they run */
+	while (received < expected) {
+		result = recv(sockets[1], buffer, sizeof(buffer), 0);
+		if (result <= 0) {
+			break;
+		}
+		for (i = 0; i < result; i++) {
+			lines += buffer[i] == '\n';
+		}
+		received += result;
+	}
+	for (i = 0; i < PRODUCERS; i++) {
+		pthread_join(producers[i], NULL);
+	}
+
+	printf("%ld of %d commands received\n", lines, PRODUCERS * COMMANDS);
+	if (lines != (long)PRODUCERS * COMMANDS || received != expected) {
+		printf("some commands were left in the queue\n");
+		failures++;
+	}
+	command_queue_destroy(&queue);
+	close_socket(sockets[0]);
+	close_socket(sockets[1]);
+	printf("%s\n", failures == 0 ? "ok" : "failed");
+	return failures == 0 ? 0 : 1;
+
+}